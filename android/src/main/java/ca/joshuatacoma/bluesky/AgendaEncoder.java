@@ -0,0 +1,262 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.List;
+
+/** Encode calendar instances as the agenda records the watch expects.
+ *
+ * See pebble/src/modules/agenda.h for the record format.
+ */
+public class AgendaEncoder
+{
+    /** Marks a record as repeating the event before it.  See
+     * pebble/src/modules/agenda.h.  Only sent to watches that advertise
+     * BlueSkyConstants.AGENDA_FORMAT_REPEATS.
+     */
+    static final int REPEAT_MARK = Short.MIN_VALUE;
+    static final int REPEAT_MAX = 256;
+
+    /** A run of instances of one event, evenly spaced and all equally long,
+     * in "short time".
+     */
+    private static class Run {
+        long eventId;
+        int start;
+        int duration;
+        int stride;
+        int count;
+        int lastStart;
+        ArrayList<long[]> instances = new ArrayList<long[]>();
+    }
+
+    /** Encode instances as agenda records, nearest first, up to capacity.
+     *
+     * instances: {begin, end, event id, ...}, times in Unix milliseconds,
+     * sorted by begin.  Anything past the event id is ignored.
+     *
+     * "short time" is time, in minutes, from an epoch.  This is not the Unix
+     * epoch, it is defined and kept in context with "short time" values so
+     * that they can be converted to absolute time later.
+     *
+     * Consecutive instances of the same event that share a duration and are
+     * evenly spaced, like a daily standup, become a single event record
+     * followed by a repeat record, rather than one record per instance.
+     */
+    public static byte[] encode(
+            List<long[]> instances,
+            long epoch_milliseconds,
+            int capacity_bytes)
+    {
+        return encode(instances, epoch_milliseconds, capacity_bytes, true, null);
+    }
+
+    /** As above, but with repeat records only if repeats is true, for
+     * watches that understand them.  Also append the instances the records
+     * actually describe to encoded, if it isn't null, leaving out any that
+     * didn't fit or were too far from the epoch.
+     */
+    public static byte[] encode(
+            List<long[]> instances,
+            long epoch_milliseconds,
+            int capacity_bytes,
+            boolean repeats,
+            List<long[]> encoded)
+    {
+        // Runs in the order of their first instance, plus the run still open
+        // for each event.
+        ArrayList<Run> runs = new ArrayList<Run>();
+        HashMap<Long, Run> open = new HashMap<Long, Run>();
+        for (long[] instance : instances) {
+            long[] as_short_time = new long[2];
+            boolean overflowed = false;
+            for (int i=0; i<2; ++i) {
+                as_short_time[i]
+                    = (instance[i] - epoch_milliseconds) / (60*1000);
+                overflowed = overflowed
+                    || as_short_time[i] < REPEAT_MARK + REPEAT_MAX
+                    || Short.MAX_VALUE < as_short_time[i];
+            }
+            if (overflowed) {
+                // Too far from the epoch to be represented.
+                continue;
+            }
+            int start = (int) as_short_time[0];
+            int duration = (int) (as_short_time[1] - as_short_time[0]);
+
+            Run run = repeats ? open.get(instance[2]) : null;
+            if (run != null && run.duration == duration && run.count <= REPEAT_MAX) {
+                int stride = start - run.lastStart;
+                boolean fits
+                    = stride > 0
+                    && stride <= Short.MAX_VALUE
+                    && (run.count == 1 || stride == run.stride);
+                if (fits) {
+                    run.stride = stride;
+                    run.count += 1;
+                    run.lastStart = start;
+                    run.instances.add(instance);
+                    continue;
+                }
+            }
+            run = new Run();
+            run.eventId = instance[2];
+            run.start = start;
+            run.duration = duration;
+            run.count = 1;
+            run.lastStart = start;
+            run.instances.add(instance);
+            runs.add(run);
+            open.put(run.eventId, run);
+        }
+
+        byte[] agenda = new byte[capacity_bytes];
+        int iagenda = 0;
+        for (Run run : runs) {
+            if (iagenda+4 > capacity_bytes) {
+                break;
+            }
+            iagenda = putRecord(agenda, iagenda, run.start, run.start+run.duration);
+            boolean repeated = run.count > 1 && iagenda+4 <= capacity_bytes;
+            if (repeated) {
+                iagenda = putRecord(agenda, iagenda, REPEAT_MARK+run.count-2, run.stride);
+            }
+            if (encoded != null) {
+                encoded.addAll(repeated
+                        ? run.instances
+                        : run.instances.subList(0, 1));
+            }
+        }
+        return Arrays.copyOfRange(agenda, 0, iagenda);
+    }
+
+    /** Size of the patch header: base version and new version.
+     */
+    static final int PATCH_HEADER_BYTES = 8;
+
+    /** Most records a single splice can remove or insert.
+     */
+    static final int SPLICE_MAX_RECORDS = 255;
+
+    /** Describe how to turn one encoded agenda into another, for watches
+     * that already have the first.  See pebble/src/modules/agenda.c for the
+     * patch format.
+     *
+     * Only the records between the longest common prefix and suffix are
+     * replaced, which is all a typical single edit changes.  Both agendas
+     * must share an epoch.
+     *
+     * @return the patch, or null if it wouldn't fit in max_bytes.
+     */
+    public static byte[] patch(
+            byte[] base,
+            int base_version,
+            byte[] target,
+            int version,
+            int max_bytes)
+    {
+        int base_records = base.length / 4;
+        int target_records = target.length / 4;
+        int prefix = 0;
+        while (prefix < base_records && prefix < target_records
+                && sameRecord(base, prefix, target, prefix)) {
+            ++prefix;
+        }
+        int suffix = 0;
+        while (suffix < base_records - prefix
+                && suffix < target_records - prefix
+                && sameRecord(
+                    base, base_records - 1 - suffix,
+                    target, target_records - 1 - suffix)) {
+            ++suffix;
+        }
+        int remove = base_records - prefix - suffix;
+        int insert = target_records - prefix - suffix;
+        if (prefix > 0xffff) {
+            return null;
+        }
+
+        int splices = Math.max(
+                (remove + SPLICE_MAX_RECORDS - 1) / SPLICE_MAX_RECORDS,
+                (insert + SPLICE_MAX_RECORDS - 1) / SPLICE_MAX_RECORDS);
+        int length = PATCH_HEADER_BYTES + splices * 4 + insert * 4;
+        if (length > max_bytes) {
+            return null;
+        }
+
+        byte[] patch = new byte[length];
+        int ipatch = putInt32(patch, 0, base_version);
+        ipatch = putInt32(patch, ipatch, version);
+        int index = prefix;
+        int itarget = prefix * 4;
+        while (remove > 0 || insert > 0) {
+            int remove_count = Math.min(remove, SPLICE_MAX_RECORDS);
+            int insert_count = Math.min(insert, SPLICE_MAX_RECORDS);
+            patch[ipatch++] = (byte) (index & 0xff);
+            patch[ipatch++] = (byte) ((index >> 8) & 0xff);
+            patch[ipatch++] = (byte) remove_count;
+            patch[ipatch++] = (byte) insert_count;
+            System.arraycopy(target, itarget, patch, ipatch, insert_count * 4);
+            ipatch += insert_count * 4;
+            itarget += insert_count * 4;
+            index += insert_count;
+            remove -= remove_count;
+            insert -= insert_count;
+        }
+        return patch;
+    }
+
+    private static boolean sameRecord(byte[] a, int ia, byte[] b, int ib) {
+        for (int i = 0; i < 4; ++i) {
+            if (a[ia*4 + i] != b[ib*4 + i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Write a little-endian 32-bit integer.
+     */
+    private static int putInt32(byte[] bytes, int ibytes, int value) {
+        for (int i = 0; i < 4; ++i) {
+            bytes[ibytes++] = (byte) ((value >> (8*i)) & 0xff);
+        }
+        return ibytes;
+    }
+
+    /** Read a little-endian 32-bit integer.
+     */
+    static int getInt32(byte[] bytes, int ibytes) {
+        int value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= (bytes[ibytes + i] & 0xff) << (8*i);
+        }
+        return value;
+    }
+
+    /** Write a pair of little-endian 16-bit integers.
+     */
+    private static int putRecord(byte[] agenda, int iagenda, int first, int second) {
+        for (int value : new int[] { first, second }) {
+            agenda[iagenda++] = (byte) (value & 0x00ff);
+            agenda[iagenda++] = (byte) ((value & 0xff00) >> 8);
+        }
+        return iagenda;
+    }
+};
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+/** Trace agenda updates from the calendar query to pixels on the watch.
+ *
+ * The phone stamps each update as it is built, queued, sent and ACKed.  Once
+ * the watch has drawn it, the watch reports how long after arrival it was
+ * persisted, reloaded and drawn; see pebble/src/modules/trace.h for the
+ * record.  The two are matched by agenda version, since the watch never sees
+ * transaction ids.
+ *
+ * This class is thread-safe.
+ */
+public class AgendaTrace
+{
+    static final int RECORD_VERSION = 1;
+    static final int RECORD_BYTES = 12;
+
+    /** Names of the watch's stages, in the order of the record.
+     */
+    static final String[] WATCH_STAGES = new String[] {
+        "persist",
+        "reload",
+        "draw",
+    };
+
+    /** What the watch reports for a stage it didn't see, or that took over
+     * a minute.
+     */
+    static final int UNSEEN = 0xffff;
+
+    /** Most updates kept waiting for the watch's report.  Reports that never
+     * come, say because the watch face was closed, are forgotten oldest
+     * first.
+     */
+    static final int MAX_PENDING = 8;
+
+    /** The phone's stages of one update, in Unix milliseconds, or -1 if not
+     * reached.
+     */
+    private static class Update {
+        long startMs;
+        long builtMs;
+        long queuedMs;
+        long sentMs = -1;
+        long ackedMs = -1;
+        int transactionId = 0;
+    }
+
+    private final LinkedHashMap<Integer, Update> pending
+        = new LinkedHashMap<Integer, Update>() {
+            @Override
+            protected boolean removeEldestEntry(Map.Entry<Integer, Update> eldest) {
+                return size() > MAX_PENDING;
+            }
+        };
+
+    /** Note that an update has been queued to be sent, superseding any
+     * earlier trace of the same version.
+     *
+     * @param startMs when work on the update began.
+     * @param builtMs when the agenda had been queried and encoded.
+     * @param queuedMs when it was queued.
+     */
+    public synchronized void queued(
+            int version,
+            long startMs,
+            long builtMs,
+            long queuedMs)
+    {
+        Update update = new Update();
+        update.startMs = startMs;
+        update.builtMs = builtMs;
+        update.queuedMs = queuedMs;
+        pending.remove(version);
+        pending.put(version, update);
+    }
+
+    /** Note that an update has been sent, or sent again, as a transaction.
+     */
+    public synchronized void sent(int version, int transactionId, long nowMs) {
+        Update update = pending.get(version);
+        if (update != null) {
+            update.transactionId = transactionId;
+            update.sentMs = nowMs;
+            update.ackedMs = -1;
+        }
+    }
+
+    /** Note that the watch has ACKed an update.
+     */
+    public synchronized void acked(int version, int transactionId, long nowMs) {
+        Update update = pending.get(version);
+        if (update != null && update.transactionId == transactionId) {
+            update.ackedMs = nowMs;
+        }
+    }
+
+    /** Decode a record from the watch into its agenda version followed by
+     * its stages, in the order of WATCH_STAGES.
+     *
+     * Returns null if the record is not one this code understands.
+     */
+    static int[] decode(byte[] record) {
+        if (record == null
+                || record.length < RECORD_BYTES
+                || record[0] != RECORD_VERSION) {
+            return null;
+        }
+        int[] values = new int[1 + WATCH_STAGES.length];
+        values[0] = AgendaEncoder.getInt32(record, 2);
+        for (int i=0; i<WATCH_STAGES.length; ++i) {
+            int offset = 6 + i*2;
+            values[1+i]
+                = (record[offset] & 0xff)
+                | ((record[offset+1] & 0xff) << 8);
+        }
+        return values;
+    }
+
+    /** Match a record from the watch with its update, and describe where
+     * the time went, end to end.
+     *
+     * The watch's stages are timed from the update's arrival, which is taken
+     * to be the ACK: the watch ACKs as soon as the message is in its inbox.
+     *
+     * @return a line for the log, or null if the record isn't understood or
+     * matches no update.
+     */
+    public synchronized String report(byte[] record, long nowMs) {
+        int[] values = decode(record);
+        if (values == null) {
+            return null;
+        }
+        Update update = pending.remove(values[0]);
+        if (update == null) {
+            return null;
+        }
+        int draw = values[WATCH_STAGES.length];
+        boolean acked = update.sentMs >= 0 && update.ackedMs >= 0;
+        StringBuilder line = new StringBuilder("agenda trace:");
+        line.append(" version=").append(values[0]);
+        line.append(" transaction=").append(update.transactionId);
+        appendMs(line, "query", update.builtMs - update.startMs, true);
+        appendMs(line, "queue", update.sentMs - update.queuedMs, update.sentMs >= 0);
+        appendMs(line, "radio", update.ackedMs - update.sentMs, acked);
+        for (int i=0; i<WATCH_STAGES.length; ++i) {
+            appendMs(line, WATCH_STAGES[i], values[1+i], values[1+i] != UNSEEN);
+        }
+        appendMs(line, "report", nowMs - update.ackedMs - draw,
+                acked && draw != UNSEEN);
+        appendMs(line, "total", update.ackedMs + draw - update.startMs,
+                acked && draw != UNSEEN);
+        return line.toString();
+    }
+
+    private static void appendMs(
+            StringBuilder line,
+            String name,
+            long milliseconds,
+            boolean known)
+    {
+        line.append(" ").append(name).append("=");
+        line.append(known ? String.valueOf(milliseconds)+"ms" : "?");
+    }
+};
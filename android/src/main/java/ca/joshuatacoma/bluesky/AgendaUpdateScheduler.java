@@ -0,0 +1,132 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+/** Decide when to rebuild and send the agenda, given a stream of requests.
+ *
+ * Calendar providers tend to change in bursts, during a sync for example, and
+ * every change would otherwise cause its own query and send.  Requests that
+ * arrive within QUIET_MILLIS of each other are merged into one update, which
+ * is never put off for more than MAX_DELAY_MILLIS after the first of them.
+ * An update that comes due while a transaction is in progress stays pending
+ * until the transaction finishes, so the latest state is always sent
+ * eventually.
+ *
+ * The time comes from a Clock, so that tests can use a fake one.  This class
+ * is thread-safe.
+ */
+public class AgendaUpdateScheduler
+{
+    /** Source of the current time, in milliseconds.
+     */
+    public interface Clock {
+        long currentTimeMillis();
+    }
+
+    public static final Clock SYSTEM_CLOCK = new Clock() {
+        @Override
+        public long currentTimeMillis() {
+            return System.currentTimeMillis();
+        }
+    };
+
+    /** How long to wait for more requests before updating.
+     */
+    static final long QUIET_MILLIS = 2*1000;
+
+    /** Longest an update can be put off by a steady stream of requests.
+     */
+    static final long MAX_DELAY_MILLIS = 10*1000;
+
+    private final Clock clock;
+
+    private boolean pending = false;
+    private long firstRequestTime;
+    private long lastRequestTime;
+    private long notBeforeTime;
+
+    public AgendaUpdateScheduler(Clock clock) {
+        this.clock = clock;
+    }
+
+    /** Ask for an update soon.
+     */
+    public synchronized void request() {
+        long now = clock.currentTimeMillis();
+        if (!pending) {
+            pending = true;
+            firstRequestTime = now;
+        }
+        lastRequestTime = now;
+    }
+
+    /** Ask for an update that is due right away.
+     *
+     * For when the request that scheduled an update has been forgotten, as
+     * happens when Android kills the process between the two.
+     */
+    public synchronized void requestNow() {
+        long now = clock.currentTimeMillis();
+        pending = true;
+        firstRequestTime = now - MAX_DELAY_MILLIS;
+        lastRequestTime = now - QUIET_MILLIS;
+        notBeforeTime = 0;
+    }
+
+    /** Keep an update pending, but not due before the given time.
+     */
+    public synchronized void defer(long notBeforeTime) {
+        if (!pending) {
+            request();
+        }
+        this.notBeforeTime = notBeforeTime;
+    }
+
+    public synchronized boolean isPending() {
+        return pending;
+    }
+
+    /** How long until the pending update is due.
+     *
+     * @return milliseconds, 0 if the update is due now, or -1 if there is no
+     * pending update.
+     */
+    public synchronized long millisUntilDue() {
+        if (!pending) {
+            return -1;
+        }
+        long due = Math.min(
+                lastRequestTime + QUIET_MILLIS,
+                firstRequestTime + MAX_DELAY_MILLIS);
+        due = Math.max(due, notBeforeTime);
+        return Math.max(0, due - clock.currentTimeMillis());
+    }
+
+    /** Claim the pending update if it is due.
+     *
+     * @param transactionInProgress whether a previous update is still in
+     * flight, in which case the update stays pending.
+     * @return true if and only if the caller should update now.
+     */
+    public synchronized boolean take(boolean transactionInProgress) {
+        if (transactionInProgress || millisUntilDue() != 0) {
+            return false;
+        }
+        pending = false;
+        notBeforeTime = 0;
+        return true;
+    }
+}
@@ -22,14 +22,63 @@ public class BlueSkyConstants
     static final UUID APP_UUID
         = new UUID(0xf205e9af41244829L, 0xa5bb53cc3f8b0362L);
 
+    // Generated by pebble/tools/data_keys.py, do not edit.
     static final int AGENDA_NEED_SECONDS_KEY = 1;
     static final int AGENDA_CAPACITY_BYTES_KEY = 2;
     static final int AGENDA_KEY = 3;
+    static final int AGENDA_VERSION_KEY = 4;
     static final int PEBBLE_NOW_UNIX_TIME_KEY = 5;
     static final int AGENDA_EPOCH_KEY = 6;
+    static final int FACE_HOURS_KEY = 7;
+    static final int FACE_ORIENTATION_KEY = 8;
+    static final int RENDER_QUALITY_KEY = 9;
+    static final int TELEMETRY_KEY = 10;
+    static final int AGENDA_PATCH_KEY = 11;
+    static final int FACE_COUNTDOWN_KEY = 12;
+    static final int AGENDA_TRACE_KEY = 13;
+    static final int AGENDA_FORMAT_KEY = 14;
+
+    /** Largest TELEMETRY value, in bytes.
+     */
+    static final int TELEMETRY_MAX_BYTES = 18;
+
+    /** Largest AGENDA_PATCH value, in bytes.
+     */
+    static final int AGENDA_PATCH_MAX_BYTES = 256;
+
+    /** Largest AGENDA_TRACE value, in bytes.
+     */
+    static final int AGENDA_TRACE_MAX_BYTES = 12;
+    // End of generated keys.
+
+    /** Agenda capacity to assume until the watch advertises its own.
+     *
+     * Every watch face build before capacity negotiation had a 1024 byte
+     * agenda buffer.
+     */
+    static final int DEFAULT_AGENDA_CAPACITY_BYTES = 1024;
+
+    /** Values of AGENDA_FORMAT: the newest agenda record format a watch
+     * understands.  Watch face builds from before repeat records send no
+     * format at all, which means PLAIN.  See pebble/src/modules/data.h.
+     */
+    static final int AGENDA_FORMAT_PLAIN = 0;
+    static final int AGENDA_FORMAT_REPEATS = 1;
+
+    /** How far ahead to look for events until the watch says otherwise.
+     */
+    static final long DEFAULT_AGENDA_NEED_SECONDS = 24*60*60;
+
+    /** How far ahead to look for events when the watch's need window leaves
+     * room to spare.
+     */
+    static final long MAX_AGENDA_WINDOW_SECONDS = 7*24*60*60;
 
     static final String ACTION_SEND_AGENDA = "action://ca.joshuatacoma.bluesky/send_agenda";
+    static final String ACTION_SEND_DUE_AGENDA = "action://ca.joshuatacoma.bluesky/send_due_agenda";
     static final String EXTRA_START_TIME = "ca.joshuatacoma.bluesky.extra.START_TIME";
     static final String EXTRA_END_TIME = "ca.joshuatacoma.bluesky.extra.END_TIME";
     static final String EXTRA_CAPACITY_BYTES = "ca.joshuatacoma.bluesky.extra.CAPACITY_BYTES";
+    static final String EXTRA_NEED_SECONDS = "ca.joshuatacoma.bluesky.extra.NEED_SECONDS";
+    static final String EXTRA_AGENDA_FORMAT = "ca.joshuatacoma.bluesky.extra.AGENDA_FORMAT";
 };
@@ -23,139 +23,486 @@ import android.net.Uri;
 import android.provider.CalendarContract.Instances;
 import android.util.Log;
 
-import com.getpebble.android.kit.PebbleKit;
 import com.getpebble.android.kit.util.PebbleDictionary;
 
-import java.util.Arrays;
+import java.util.ArrayList;
 import java.util.Date;
+import java.util.List;
 
 import ca.joshuatacoma.bluesky.BlueSkyConstants;
-import ca.joshuatacoma.bluesky.PebbleState;
 
 public class CalendarBridge
 {
     static final String TAG = "BlueSky";
 
+    /** How long an encoded agenda can be resent as it is, when the calendar
+     * hasn't changed.  Past this, instances that have ended are dropped and
+     * the window is moved forward.
+     */
+    static final long PAYLOAD_MAX_AGE_MILLISECONDS = 30*60*1000;
+
+    /** How long the watch's agenda can go on serving as the base for
+     * patches, and so lending them its epoch, before a whole new agenda is
+     * sent instead.  Must leave room within the 16-bit range of "short time"
+     * for MAX_AGENDA_WINDOW_SECONDS beyond it.
+     */
+    static final long PATCH_BASE_MAX_AGE_MILLISECONDS = 12*60*60*1000;
+
+    /** An encoded agenda, along with what it was built from.
+     */
+    static class Payload {
+        long generation;
+        long needSeconds;
+        int capacityBytes;
+        boolean repeats;
+        long builtMilliseconds;
+        long epochMilliseconds;
+        int version;
+        byte[] agenda;
+        InstanceSnapshot instances;
+    }
+
+    /** Counts calendar changes, so that a cached Payload built before the
+     * latest change is never reused.
+     */
+    private static long calendarGeneration = 0;
+
+    /** The last payload sent, or null.
+     */
+    private static Payload cachedPayload = null;
+
+    /** The payload the watch is known to have, or null if that's unknown.
+     */
+    private static Payload watchPayload = null;
+
+    /** Where the time goes in each agenda update, see AgendaTrace.
+     */
+    private static final AgendaTrace trace = new AgendaTrace();
+
+    /** Note that the calendar provider has changed.
+     */
+    static synchronized void onCalendarChanged() {
+        calendarGeneration += 1;
+    }
+
+    /** Get the cached payload if it can be sent again as it is.
+     */
+    private static synchronized Payload getCachedPayload(
+            long now_ms,
+            long need_seconds,
+            int capacity_bytes,
+            boolean repeats)
+    {
+        Payload payload = cachedPayload;
+        boolean fresh
+            = payload != null
+            && payload.generation == calendarGeneration
+            && payload.needSeconds == need_seconds
+            && payload.capacityBytes == capacity_bytes
+            && payload.repeats == repeats
+            && payload.builtMilliseconds <= now_ms
+            && now_ms - payload.builtMilliseconds < PAYLOAD_MAX_AGE_MILLISECONDS;
+        return fresh ? payload : null;
+    }
+
+    /** Get the payload the watch has, if a patch can be made against it.
+     */
+    static synchronized Payload getPatchBase(long now_ms) {
+        Payload base = watchPayload;
+        boolean usable
+            = base != null
+            && base.epochMilliseconds <= now_ms
+            && now_ms - base.epochMilliseconds < PATCH_BASE_MAX_AGE_MILLISECONDS;
+        return usable ? base : null;
+    }
+
+    /** The version an agenda or agenda patch message brings the watch to,
+     * or null.
+     */
+    private static Integer getAgendaVersion(PebbleDictionary message) {
+        if (message.contains(BlueSkyConstants.AGENDA_VERSION_KEY)) {
+            Long value = message.getInteger(BlueSkyConstants.AGENDA_VERSION_KEY);
+            return value == null ? null : value.intValue();
+        } else if (message.contains(BlueSkyConstants.AGENDA_PATCH_KEY)) {
+            byte[] patch = message.getBytes(BlueSkyConstants.AGENDA_PATCH_KEY);
+            return AgendaEncoder.getInt32(patch, 4);
+        }
+        return null;
+    }
+
+    /** Note that an agenda or agenda patch message has been sent.
+     */
+    static void onAgendaSent(PebbleDictionary message, int transactionId) {
+        Integer version = getAgendaVersion(message);
+        if (version != null) {
+            trace.sent(version, transactionId, new Date().getTime());
+        }
+    }
+
+    /** Note that the watch has ACKed an agenda or agenda patch message.
+     *
+     * An ACK only means the message arrived.  If a patch then fails to
+     * apply, the watch says so with onWatchAgendaVersion.
+     */
+    static synchronized void onAgendaAcked(
+            PebbleDictionary message,
+            int transactionId)
+    {
+        Integer version = getAgendaVersion(message);
+        if (version != null) {
+            trace.acked(version, transactionId, new Date().getTime());
+        }
+        if (version != null
+                && cachedPayload != null
+                && cachedPayload.version == version) {
+            watchPayload = cachedPayload;
+        }
+    }
+
+    /** Log where the time went in an agenda update, once the watch reports
+     * having drawn it.
+     */
+    static void onAgendaTrace(byte[] record) {
+        String line = trace.report(record, new Date().getTime());
+        if (line != null) {
+            Log.i(TAG, line);
+        } else {
+            Log.d(TAG, "ignoring agenda trace for an unknown update");
+        }
+    }
+
+    /** Note the agenda version the watch reports having.
+     */
+    static synchronized void onWatchAgendaVersion(int version) {
+        if (watchPayload != null && watchPayload.version != version) {
+            Log.i(TAG, "watch has agenda "+String.valueOf(version)
+                    +", not "+String.valueOf(watchPayload.version)
+                    +": next update will be whole");
+            watchPayload = null;
+        }
+    }
+
+    /** Note that the watch has asked for an agenda without saying which one
+     * it has, as it does when it has none at all: after a reinstall, a
+     * storage wipe, or a stored agenda that failed its checksum.
+     */
+    static synchronized void onWatchAgendaMissing() {
+        if (watchPayload != null) {
+            Log.i(TAG, "watch has no agenda, not "
+                    +String.valueOf(watchPayload.version)
+                    +": next update will be whole");
+            watchPayload = null;
+        }
+    }
+
+    static synchronized void setCachedPayload(Payload payload) {
+        cachedPayload = payload;
+    }
+
+    /** Whether a freshly built payload can be dropped in favour of the one
+     * the watch already has, because none of the instances the watch shows
+     * have changed.
+     *
+     * Calendar changes often touch nothing the watch displays: an all-day or
+     * hidden event, or something days away.  Those are left for the next
+     * routine update rather than costing a transaction each.
+     */
+    private static boolean isUnchangedForWatch(
+            Payload base,
+            Payload payload,
+            long now_ms)
+    {
+        return base != null
+            && base.instances != null
+            && base.needSeconds == payload.needSeconds
+            && base.capacityBytes == payload.capacityBytes
+            && base.repeats == payload.repeats
+            && base.builtMilliseconds <= now_ms
+            && now_ms - base.builtMilliseconds < PAYLOAD_MAX_AGE_MILLISECONDS
+            && base.instances.sameWithin(
+                    payload.instances,
+                    now_ms,
+                    now_ms + payload.needSeconds*1000L);
+    }
+
+    /** Go on treating the watch's payload as current for a later calendar
+     * generation.
+     */
+    private static synchronized void keepWatchPayload(
+            Payload base,
+            long generation)
+    {
+        base.generation = generation;
+        cachedPayload = base;
+    }
+
+    private static synchronized long getCalendarGeneration() {
+        return calendarGeneration;
+    }
+
+    /** Send the watch an agenda, or a patch to the one it has, unless it is
+     * already up to date.
+     *
+     * repeats: whether the watch understands repeat records.
+     */
     static public void sendAgenda(
             Context context,
             Date start_date,
-            Date end_date,
-            int agenda_capacity_bytes)
+            long need_seconds,
+            int agenda_capacity_bytes,
+            boolean repeats)
     {
         Log.d(TAG,
                 "sendAgenda start_date="
                 +String.valueOf(start_date)
-                +",end_date="
-                +String.valueOf(end_date)
+                +",need_seconds="
+                +String.valueOf(need_seconds)
                 +",agenda_capacity_bytes="
-                +String.valueOf(agenda_capacity_bytes));
+                +String.valueOf(agenda_capacity_bytes)
+                +",repeats="
+                +String.valueOf(repeats));
+        long trace_start_ms = new Date().getTime();
+
+        // Make sure we're dealing with a multiple of 4 bytes to hold pairs of 2
+        // byte integers.
+        agenda_capacity_bytes -= agenda_capacity_bytes % 4;
+
+        // TODO: handle the case that agenda_capacity_bytes is zero, or less
+        // than a sensible minimum.
+
+        // Retries and repeated requests usually find nothing has changed, in
+        // which case there's no need to touch the calendar provider at all.
+        Payload payload = getCachedPayload(
+                start_date.getTime(),
+                need_seconds,
+                agenda_capacity_bytes,
+                repeats);
+        Payload base = getPatchBase(start_date.getTime());
+        if (payload != null && base != null && base.version == payload.version) {
+            // Typically a message from the watch, such as a trace, that
+            // repeats the request it has already had answered.
+            Log.d(TAG, "watch already has agenda version "
+                    +String.valueOf(payload.version)+": not sending");
+            return;
+        } else if (payload != null) {
+            Log.d(TAG, "reusing agenda encoded at "
+                    +String.valueOf(new Date(payload.builtMilliseconds)));
+        } else {
+            // Encode against the watch's epoch when possible, so that
+            // unchanged events encode identically and can be left out of a
+            // patch.
+            payload = buildPayload(
+                    context,
+                    start_date.getTime(),
+                    base != null
+                        ? base.epochMilliseconds
+                        : start_date.getTime(),
+                    need_seconds,
+                    agenda_capacity_bytes,
+                    repeats);
+            if (isUnchangedForWatch(base, payload, start_date.getTime())) {
+                Log.d(TAG, "calendar changed, but not within the "
+                        +String.valueOf(need_seconds)
+                        +" seconds the watch shows: not sending");
+                keepWatchPayload(base, payload.generation);
+                return;
+            }
+            setCachedPayload(payload);
+        }
+
+        // Typically only a few events change, so send just those when the
+        // watch has an agenda to apply them to.
+        byte[] patch = null;
+        if (base != null && base.epochMilliseconds == payload.epochMilliseconds) {
+            patch = AgendaEncoder.patch(
+                    base.agenda,
+                    base.version,
+                    payload.agenda,
+                    payload.version,
+                    Math.min(
+                        BlueSkyConstants.AGENDA_PATCH_MAX_BYTES,
+                        agenda_capacity_bytes));
+        }
+
+        long trace_built_ms = new Date().getTime();
+
+        PebbleDictionary message = new PebbleDictionary();
+        if (patch != null) {
+            message.addBytes(
+                    BlueSkyConstants.AGENDA_PATCH_KEY,
+                    patch);
+        } else {
+            message.addBytes(
+                    BlueSkyConstants.AGENDA_KEY,
+                    payload.agenda);
+            message.addInt32(
+                    BlueSkyConstants.AGENDA_EPOCH_KEY,
+                    (int) (payload.epochMilliseconds/1000));
+            message.addInt32(
+                    BlueSkyConstants.AGENDA_VERSION_KEY,
+                    payload.version);
+        }
+        // Before sending, which may happen right away.
+        trace.queued(
+                payload.version,
+                trace_start_ms,
+                trace_built_ms,
+                new Date().getTime());
+        PebbleSender.send(context, PebbleSender.AGENDA, message);
+        Log.d(TAG, "queued agenda "
+                +(patch != null
+                    ? "patch of "+String.valueOf(patch.length)+" bytes"
+                    : "of "+String.valueOf(payload.agenda.length)+" bytes")
+                +" for Pebble");
+    }
+
+    /** Query the calendar and encode the result.
+     */
+    private static Payload buildPayload(
+            Context context,
+            long start_ms,
+            long epoch_ms,
+            long need_seconds,
+            int agenda_capacity_bytes,
+            boolean repeats)
+    {
+        Payload payload = new Payload();
+        payload.generation = getCalendarGeneration();
+        payload.needSeconds = need_seconds;
+        payload.capacityBytes = agenda_capacity_bytes;
+        payload.repeats = repeats;
+        payload.builtMilliseconds = start_ms;
+        payload.epochMilliseconds = epoch_ms;
+        payload.version = (int) (new Date().getTime() % 0xffffffffL);
 
         ContentResolver cr = context.getContentResolver();
 
+        // Start with the window the watch needs and, while there's capacity
+        // to spare, keep doubling it up to MAX_AGENDA_WINDOW_SECONDS.  Each
+        // round only queries the newly added slice of time, so nearer events
+        // are never crowded out by farther ones and a busy calendar is only
+        // read as far as the watch can hold.
+        long window_ms = Math.max(60, need_seconds) * 1000L;
+        long max_window_ms = Math.max(
+                window_ms,
+                BlueSkyConstants.MAX_AGENDA_WINDOW_SECONDS * 1000L);
+        ArrayList<long[]> instances = new ArrayList<long[]>();
+        // What the watch will actually have, for isUnchangedForWatch.
+        ArrayList<long[]> encoded = new ArrayList<long[]>();
+        long queried_end_ms = start_ms;
+        while (true) {
+            long end_ms = start_ms + Math.min(window_ms, max_window_ms);
+            queryInstances(cr, start_ms, queried_end_ms, end_ms, instances);
+            queried_end_ms = end_ms;
+            encoded.clear();
+            payload.agenda = AgendaEncoder.encode(
+                    instances,
+                    epoch_ms,
+                    agenda_capacity_bytes,
+                    repeats,
+                    encoded);
+            if (queried_end_ms >= start_ms + max_window_ms
+                    || payload.agenda.length + 4 > agenda_capacity_bytes) {
+                break;
+            }
+            window_ms *= 2;
+        }
+        payload.instances = InstanceSnapshot.of(encoded);
+        Log.d(TAG,
+                "queried "+String.valueOf(instances.size())+" instances over "
+                +String.valueOf((queried_end_ms-start_ms)/1000)+" seconds");
+        Log.d(TAG,
+                "agenda update: byte count="+String.valueOf(payload.agenda.length)
+                +", record count="+String.valueOf(payload.agenda.length/4));
+        return payload;
+    }
+
+    /** Append the instances that begin in a slice of a window to a list.
+     *
+     * window_start_ms: the start of the whole window.  Instances that began
+     * before it but haven't ended yet are included in the first slice.
+     * slice_start_ms, slice_end_ms: the slice of the window to query.
+     * instances: {begin, end, event id, instance id}, times in Unix
+     * milliseconds, sorted by begin.
+     */
+    private static void queryInstances(
+            ContentResolver cr,
+            long window_start_ms,
+            long slice_start_ms,
+            long slice_end_ms,
+            List<long[]> instances)
+    {
         Uri.Builder builder = Instances.CONTENT_URI.buildUpon();
-        ContentUris.appendId(builder, start_date.getTime());
-        ContentUris.appendId(builder, end_date.getTime());
+        ContentUris.appendId(builder, slice_start_ms);
+        ContentUris.appendId(builder, slice_end_ms);
 
         // Include only events from calendars the user has selected as
         // visible-by-default in the Calendar app.  Ignore all-day events just
         // because there's no obviously meaningful way to display them in this
         // system.  Finally, also ignore canceled events.
-        String filter
-            = Instances.VISIBLE+" = 1"
+        //
+        // The provider returns every instance overlapping the slice, so keep
+        // only those that begin within it, except that the first slice also
+        // keeps those already in progress.  That way no instance is seen
+        // twice.  Arguments are bound rather than spliced in so that the
+        // provider can reuse the statement.
+        String selection
+            = Instances.VISIBLE+" = ?"
+            + " AND "
+            + Instances.ALL_DAY+" = ?"
+            + " AND "
+            + Instances.STATUS+" <> ?"
             + " AND "
-            + Instances.ALL_DAY+" = 0"
+            + Instances.BEGIN+" >= ?"
             + " AND "
-            + Instances.STATUS+" <> "+String.valueOf(Instances.STATUS_CANCELED);
+            + Instances.BEGIN+" < ?";
+        String[] selection_args = new String[] {
+            "1",
+            "0",
+            String.valueOf(Instances.STATUS_CANCELED),
+            String.valueOf(
+                    slice_start_ms == window_start_ms
+                    ? Long.MIN_VALUE
+                    : slice_start_ms),
+            String.valueOf(slice_end_ms),
+        };
 
         // Sort events by their beginning time so that, if there are too many,
         // the current and imminent events will get preference.
         String sort_order = Instances.BEGIN + " ASC";
 
-        // Make sure we're dealing with a multiple of 4 bytes to hold pairs of 2
-        // byte integers.
-        agenda_capacity_bytes -= agenda_capacity_bytes % 4;
-        byte[] agenda = new byte[agenda_capacity_bytes];
-
-        // TODO: handle the case that agenda_capacity_bytes is zero, or less
-        // than a sensible minimum.
-
-        // "short time" is time, in minutes, from an epoch.  This is not the
-        // Unix epoch, it is defined and kept in context with "short time"
-        // values so that they can be converted to absolute time later.  In this
-        // case, the epoch will be start_date.
-
         Cursor cursor = cr.query(
                 builder.build(),
                 INSTANCE_PROJECTION,
-                filter,
-                null,
+                selection,
+                selection_args,
                 sort_order);
-
-        int iagenda = 0;
+        if (cursor == null) {
+            Log.w(TAG, "calendar query failed");
+            return;
+        }
         try {
-            while (iagenda<agenda_capacity_bytes && cursor.moveToNext()) {
-                long[] as_unix_milliseconds = new long[] {
+            while (cursor.moveToNext()) {
+                instances.add(new long[] {
                     cursor.getLong(PROJECTION_BEGIN_INDEX),
                     cursor.getLong(PROJECTION_END_INDEX),
-                };
-                short[] as_short_time = new short[2];
-                boolean overflowed = false;
-                for (int i=0; i<2; ++i) {
-                    long short_time
-                        = (as_unix_milliseconds[i] - start_date.getTime())
-                        / (60*1000);
-                    overflowed
-                        = short_time < Short.MIN_VALUE
-                        || Short.MAX_VALUE < short_time;
-                    if (overflowed) {
-                        Log.d(TAG,
-                                "short_overflow="+String.valueOf(short_time));
-                        break;
-                    }
-                    as_short_time[i] = (short) short_time;
-                }
-                if (overflowed) {
-                    continue;
-                }
-                for (int i=0; i<2; ++i) {
-                    agenda[iagenda++] = (byte) (as_short_time[i] & 0x00ff);
-                    agenda[iagenda++] = (byte) ((as_short_time[i] & 0xff00) >> 8);
-                }
+                    cursor.getLong(PROJECTION_EVENT_ID_INDEX),
+                    cursor.getLong(PROJECTION_ID_INDEX),
+                });
             }
         } finally {
             cursor.close();
         }
-
-        Log.d(TAG,
-                "agenda update: byte count="+String.valueOf(iagenda)
-                +", event count="+String.valueOf(iagenda/4));
-
-        int version = (int) (new Date().getTime() % 0xffffffffL);
-
-        PebbleDictionary message = new PebbleDictionary();
-        message.addBytes(
-                BlueSkyConstants.AGENDA_KEY,
-                Arrays.copyOfRange(agenda, 0, iagenda));
-        message.addInt32(
-                BlueSkyConstants.AGENDA_EPOCH_KEY,
-                (int) (start_date.getTime()/1000));
-        int transactionId = (int) (new Date().getTime() & 0x7F);
-        if (transactionId==0) {
-            transactionId = 1;
-        }
-        PebbleState.recordAttempt(context, transactionId);
-        PebbleKit.sendDataToPebbleWithTransactionId(
-                context,
-                BlueSkyConstants.APP_UUID,
-                message,
-                transactionId);
-        Log.d(TAG, "sent agenda to Pebble");
     }
 
     private static final String[] INSTANCE_PROJECTION = new String[] {
         Instances.BEGIN,
         Instances.END,
+        Instances.EVENT_ID,
+        Instances._ID,
     };
     private static final int PROJECTION_BEGIN_INDEX = 0;
     private static final int PROJECTION_END_INDEX = 1;
+    private static final int PROJECTION_EVENT_ID_INDEX = 2;
+    private static final int PROJECTION_ID_INDEX = 3;
 };
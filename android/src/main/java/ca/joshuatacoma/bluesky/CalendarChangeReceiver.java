@@ -0,0 +1,38 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import android.content.BroadcastReceiver;
+import android.content.Context;
+import android.content.Intent;
+import android.util.Log;
+
+import ca.joshuatacoma.bluesky.CalendarBridge;
+import ca.joshuatacoma.bluesky.MainService;
+
+/** Send an agenda update when the calendar provider reports a change.
+ */
+public class CalendarChangeReceiver extends BroadcastReceiver
+{
+    static final String TAG = "BlueSky";
+
+    @Override
+    public void onReceive(Context context, Intent intent) {
+        Log.d(TAG, "calendar changed: " + String.valueOf(intent.getData()));
+        CalendarBridge.onCalendarChanged();
+        MainService.maybeSendAgendaUpdate(context);
+    }
+};
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.List;
+
+/** A compact record of a set of calendar instances, for telling cheaply
+ * whether anything the watch shows has changed.
+ *
+ * Each instance is kept as its begin and end times, instance id and a hash of
+ * the columns that affect how it's drawn, in parallel arrays sorted by begin
+ * time and then id.
+ */
+public class InstanceSnapshot
+{
+    private final long[] begins;
+    private final long[] ends;
+    private final long[] ids;
+    private final long[] hashes;
+
+    private InstanceSnapshot(int size) {
+        begins = new long[size];
+        ends = new long[size];
+        ids = new long[size];
+        hashes = new long[size];
+    }
+
+    /** Take a snapshot of instances.
+     *
+     * @param instances {begin, end, event id, instance id}, in Unix
+     * milliseconds, in any order.
+     */
+    public static InstanceSnapshot of(List<long[]> instances) {
+        ArrayList<long[]> sorted = new ArrayList<long[]>(instances);
+        Collections.sort(sorted, new Comparator<long[]>() {
+            @Override
+            public int compare(long[] a, long[] b) {
+                if (a[0] != b[0]) {
+                    return a[0] < b[0] ? -1 : 1;
+                }
+                return a[3] < b[3] ? -1 : a[3] == b[3] ? 0 : 1;
+            }
+        });
+        InstanceSnapshot snapshot = new InstanceSnapshot(sorted.size());
+        for (int i = 0; i < sorted.size(); ++i) {
+            long[] instance = sorted.get(i);
+            snapshot.begins[i] = instance[0];
+            snapshot.ends[i] = instance[1];
+            snapshot.ids[i] = instance[3];
+            snapshot.hashes[i] = hash(instance[0], instance[1], instance[2]);
+        }
+        return snapshot;
+    }
+
+    public int size() {
+        return begins.length;
+    }
+
+    /** Whether both snapshots agree on every instance that overlaps a span
+     * of time, such as the part of the agenda the watch displays.
+     */
+    public boolean sameWithin(InstanceSnapshot other, long from_ms, long to_ms) {
+        int i = 0;
+        int j = 0;
+        while (true) {
+            i = nextOverlapping(i, from_ms, to_ms);
+            j = other.nextOverlapping(j, from_ms, to_ms);
+            if (i >= size() || j >= other.size()) {
+                return i >= size() && j >= other.size();
+            }
+            if (ids[i] != other.ids[j] || hashes[i] != other.hashes[j]) {
+                return false;
+            }
+            ++i;
+            ++j;
+        }
+    }
+
+    /** Index of the first instance at or after i that overlaps a span of
+     * time, or size() if there is none.
+     */
+    private int nextOverlapping(int i, long from_ms, long to_ms) {
+        while (i < size() && begins[i] < to_ms) {
+            if (ends[i] > from_ms) {
+                return i;
+            }
+            ++i;
+        }
+        return size();
+    }
+
+    /** 64-bit FNV-1a over the values that affect how an instance is drawn.
+     */
+    static long hash(long begin, long end, long eventId) {
+        long hash = 0xcbf29ce484222325L;
+        for (long value : new long[] { begin, end, eventId }) {
+            for (int i = 0; i < 8; ++i) {
+                hash ^= (value >> (8*i)) & 0xff;
+                hash *= 0x100000001b3L;
+            }
+        }
+        return hash;
+    }
+}
@@ -39,8 +39,9 @@ public class MainActivity extends Activity
         super.onResume();
         try {
             // Gather values from incoming data.
-            long agenda_need_seconds = 24*60*60;
-            long agenda_capacity_bytes = 1024;
+            long agenda_need_seconds = PebbleState.getAgendaNeedSeconds(this);
+            long agenda_capacity_bytes
+                = PebbleState.getAgendaCapacityBytes(this);
             long pebble_now_unix_time = new Date().getTime()/1000;
 
             // Convert to local data types and add fudge factor for end
@@ -61,6 +62,9 @@ public class MainActivity extends Activity
                 .putExtra(
                         BlueSkyConstants.EXTRA_END_TIME,
                         (long)end_unix_time*1000L)
+                .putExtra(
+                        BlueSkyConstants.EXTRA_NEED_SECONDS,
+                        agenda_need_seconds)
                 .putExtra(
                         BlueSkyConstants.EXTRA_CAPACITY_BYTES,
                         (int)agenda_capacity_bytes);
@@ -15,9 +15,12 @@
  */
 package ca.joshuatacoma.bluesky;
 
+import android.app.AlarmManager;
 import android.app.IntentService;
+import android.app.PendingIntent;
 import android.content.Context;
 import android.content.Intent;
+import android.os.Build;
 import android.os.IBinder;
 import android.util.Log;
 
@@ -35,11 +38,75 @@ public class MainService extends IntentService
         super("MainService");
     }
 
+    private static final AgendaUpdateScheduler scheduler
+        = new AgendaUpdateScheduler(AgendaUpdateScheduler.SYSTEM_CLOCK);
+
+    /** Ask for an agenda update.
+     *
+     * Requests are merged by AgendaUpdateScheduler, so calling this for every
+     * trigger is cheap: the calendar is queried once per burst.
+     */
     public static void maybeSendAgendaUpdate(Context context) {
-        if (PebbleState.getIsTransactionInProgress(context)) {
-            Log.d(TAG,
-                    "not attempting agenda update because another transaction"
-                    +" is in progress");
+        scheduler.request();
+        scheduleAgendaUpdate(context);
+    }
+
+    /** Let a pending agenda update go ahead now that the Pebble has ACKed or
+     * NACKed a transaction, making room in the window.
+     */
+    public static void onTransactionFinished(Context context) {
+        scheduleAgendaUpdate(context);
+    }
+
+    /** Whether this process has set the alarm, as opposed to one before it.
+     */
+    private static volatile boolean alarmSet = false;
+
+    /** Set an alarm for when the pending update is due or a transaction in
+     * flight times out, whichever is sooner, replacing any set before.
+     *
+     * An alarm rather than a Handler, because Android may kill the process
+     * as soon as the receiver that asked for the update returns.
+     */
+    static synchronized void scheduleAgendaUpdate(Context context) {
+        AlarmManager alarms
+            = (AlarmManager) context.getSystemService(Context.ALARM_SERVICE);
+        PendingIntent sendDue = PendingIntent.getService(
+                context,
+                0,
+                new Intent(context, MainService.class)
+                    .setAction(BlueSkyConstants.ACTION_SEND_DUE_AGENDA),
+                PendingIntent.FLAG_UPDATE_CURRENT);
+        // A full window has to wait for a reply or a timeout either way.
+        long delay = PebbleSender.isBusy() ? -1 : scheduler.millisUntilDue();
+        long timeout = PebbleSender.millisUntilTimeout();
+        if (delay < 0 || (timeout >= 0 && timeout < delay)) {
+            delay = timeout;
+        }
+        if (delay < 0) {
+            alarms.cancel(sendDue);
+            return;
+        }
+        alarmSet = true;
+        long due = AgendaUpdateScheduler.SYSTEM_CLOCK.currentTimeMillis()+delay;
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.KITKAT) {
+            alarms.setExact(AlarmManager.RTC_WAKEUP, due, sendDue);
+        } else {
+            alarms.set(AlarmManager.RTC_WAKEUP, due, sendDue);
+        }
+    }
+
+    private static void sendDueAgendaUpdate(Context context) {
+        boolean inProgress = PebbleSender.isBusy();
+        if (!scheduler.take(inProgress)) {
+            if (inProgress) {
+                // Still pending: onTransactionFinished or a timeout will try
+                // again.
+                Log.d(TAG,
+                        "not attempting agenda update because the"
+                        +" transaction window is full");
+            }
+            scheduleAgendaUpdate(context);
             return;
         }
 
@@ -47,12 +114,15 @@ public class MainService extends IntentService
         int nackCount = PebbleState.getNackCount(context);
 
         // If more than 5 NACKs since last ACKk and less than 10 seconds since
-        // last attempt, don't bother.
-        if (nackCount > 5 && lastAttempt.getTime() >= new Date().getTime()-10*1000) {
+        // last attempt, try again once 10 seconds have passed.
+        long retryTime = lastAttempt.getTime()+10*1000;
+        if (nackCount > 5 && retryTime >= new Date().getTime()) {
             Log.d(TAG,
-                    "not attempting agenda update because:"
+                    "deferring agenda update because:"
                     +" nack count="+String.valueOf(nackCount)
                     +", last attempt="+String.valueOf(lastAttempt));
+            scheduler.defer(retryTime);
+            scheduleAgendaUpdate(context);
             return;
         }
 
@@ -62,9 +132,15 @@ public class MainService extends IntentService
             Intent sendAgendaIntent
                 = new Intent(context, MainService.class)
                 .setAction(BlueSkyConstants.ACTION_SEND_AGENDA)
+                .putExtra(
+                        BlueSkyConstants.EXTRA_NEED_SECONDS,
+                        PebbleState.getAgendaNeedSeconds(context))
                 .putExtra(
                         BlueSkyConstants.EXTRA_CAPACITY_BYTES,
-                        PebbleState.getAgendaCapacityBytes(context));
+                        PebbleState.getAgendaCapacityBytes(context))
+                .putExtra(
+                        BlueSkyConstants.EXTRA_AGENDA_FORMAT,
+                        PebbleState.getAgendaFormat(context));
 
             if (context.startService(sendAgendaIntent)==null) {
                 // TODO: supposing this happens in real use, what could it mean?  A
@@ -81,15 +157,42 @@ public class MainService extends IntentService
     @Override
     protected void onHandleIntent(Intent intent) {
         Log.d(TAG, "service received intent");
-        if (intent.getAction()==BlueSkyConstants.ACTION_SEND_AGENDA) {
+        if (BlueSkyConstants.ACTION_SEND_DUE_AGENDA.equals(intent.getAction())) {
+            if (!alarmSet) {
+                // Scheduled by an earlier process, which took the request and
+                // its transactions with it.
+                scheduler.requestNow();
+            }
+            if (PebbleSender.retryTimedOut(this)) {
+                scheduler.request();
+            }
+            if (scheduler.isPending()) {
+                sendDueAgendaUpdate(this);
+            } else {
+                scheduleAgendaUpdate(this);
+            }
+        } else if (BlueSkyConstants.ACTION_SEND_AGENDA.equals(intent.getAction())) {
             Log.i(TAG, "service received intent to send agenda");
             Date start = new Date();
-            Date end = new Date(start.getTime()+7*24*60*60*1000);
+            long needSeconds
+                = intent.getLongExtra(
+                        BlueSkyConstants.EXTRA_NEED_SECONDS,
+                        PebbleState.getAgendaNeedSeconds(this));
             int capacityBytes
                 = intent.getIntExtra(
                         BlueSkyConstants.EXTRA_CAPACITY_BYTES,
-                        64);
-            CalendarBridge.sendAgenda(this, start, end, capacityBytes);
+                        PebbleState.getAgendaCapacityBytes(this));
+            int agendaFormat
+                = intent.getIntExtra(
+                        BlueSkyConstants.EXTRA_AGENDA_FORMAT,
+                        PebbleState.getAgendaFormat(this));
+            CalendarBridge.sendAgenda(
+                    this,
+                    start,
+                    needSeconds,
+                    capacityBytes,
+                    agendaFormat >= BlueSkyConstants.AGENDA_FORMAT_REPEATS);
         }
+        PebbleState.flush(this);
     }
 }
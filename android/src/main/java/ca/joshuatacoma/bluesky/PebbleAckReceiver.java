@@ -21,6 +21,8 @@ import android.util.Log;
 import com.getpebble.android.kit.PebbleKit;
 
 import ca.joshuatacoma.bluesky.BlueSkyConstants;
+import ca.joshuatacoma.bluesky.MainService;
+import ca.joshuatacoma.bluesky.PebbleState;
 
 public class PebbleAckReceiver extends PebbleKit.PebbleAckReceiver
 {
@@ -36,6 +38,8 @@ public class PebbleAckReceiver extends PebbleKit.PebbleAckReceiver
             int transactionId)
     {
         Log.d(TAG, "receiveAck(" + String.valueOf(transactionId) + ")");
-        PebbleState.recordAck(context, transactionId);
+        PebbleSender.onAck(context, transactionId);
+        MainService.onTransactionFinished(context);
+        PebbleState.flush(context);
     }
 };
@@ -24,6 +24,7 @@ import com.getpebble.android.kit.util.PebbleDictionary;
 
 import ca.joshuatacoma.bluesky.BlueSkyConstants;
 import ca.joshuatacoma.bluesky.MainService;
+import ca.joshuatacoma.bluesky.PebbleState;
 
 public class PebbleDataReceiver extends PebbleKit.PebbleDataReceiver
 {
@@ -45,10 +46,70 @@ public class PebbleDataReceiver extends PebbleKit.PebbleDataReceiver
 
         Log.d(TAG, "ACK");
 
+        if (data.contains(BlueSkyConstants.TELEMETRY_KEY))
+        {
+            WatchTelemetry.record(
+                    context,
+                    data.getBytes(BlueSkyConstants.TELEMETRY_KEY));
+        }
+
+        // A trace reports on an update the watch has just drawn.  It can share
+        // a message with a request for another, so the keys below still
+        // count.
+        if (data.contains(BlueSkyConstants.AGENDA_TRACE_KEY))
+        {
+            CalendarBridge.onAgendaTrace(
+                    data.getBytes(BlueSkyConstants.AGENDA_TRACE_KEY));
+        }
+
+        if (data.contains(BlueSkyConstants.AGENDA_VERSION_KEY))
+        {
+            // A patch that didn't apply shows up as the watch still having
+            // some other version.
+            Long version = data.getInteger(BlueSkyConstants.AGENDA_VERSION_KEY);
+            if (version != null) {
+                CalendarBridge.onWatchAgendaVersion(version.intValue());
+            }
+        }
+        else if (data.contains(BlueSkyConstants.AGENDA_CAPACITY_BYTES_KEY))
+        {
+            // The watch only sends its version once it has an agenda, so a
+            // request without one means whatever it had is gone.
+            CalendarBridge.onWatchAgendaMissing();
+        }
+
+        if (data.contains(BlueSkyConstants.AGENDA_NEED_SECONDS_KEY))
+        {
+            Long needSeconds
+                = data.getInteger(BlueSkyConstants.AGENDA_NEED_SECONDS_KEY);
+            if (needSeconds != null && needSeconds > 0) {
+                PebbleState.recordAgendaNeedSeconds(context, needSeconds);
+            }
+        }
+
         if (data.contains(BlueSkyConstants.AGENDA_CAPACITY_BYTES_KEY))
         {
+            // The watch sizes its agenda buffer at runtime, so believe
+            // whatever it says rather than any assumed default.
+            Long capacityBytes
+                = data.getInteger(BlueSkyConstants.AGENDA_CAPACITY_BYTES_KEY);
+            if (capacityBytes != null && capacityBytes > 0) {
+                PebbleState.recordAgendaCapacityBytes(
+                        context,
+                        capacityBytes.intValue());
+            }
+            // Sent along with the capacity by every watch face that knows
+            // about repeat records; older ones only understand plain records.
+            Long agendaFormat
+                = data.getInteger(BlueSkyConstants.AGENDA_FORMAT_KEY);
+            PebbleState.recordAgendaFormat(
+                    context,
+                    agendaFormat != null
+                        ? agendaFormat.intValue()
+                        : BlueSkyConstants.AGENDA_FORMAT_PLAIN);
             MainService.maybeSendAgendaUpdate(context);
         }
+        PebbleState.flush(context);
         Log.d(TAG, "done");
     }
 };
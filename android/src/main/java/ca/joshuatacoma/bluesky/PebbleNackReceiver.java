@@ -22,6 +22,7 @@ import com.getpebble.android.kit.PebbleKit;
 
 import ca.joshuatacoma.bluesky.BlueSkyConstants;
 import ca.joshuatacoma.bluesky.MainService;
+import ca.joshuatacoma.bluesky.PebbleState;
 
 public class PebbleNackReceiver extends PebbleKit.PebbleNackReceiver
 {
@@ -37,7 +38,12 @@ public class PebbleNackReceiver extends PebbleKit.PebbleNackReceiver
             int transactionId)
     {
         Log.d(TAG, "receiveNack(" + String.valueOf(transactionId) + ")");
-        PebbleState.recordNack(context, transactionId);
-        MainService.maybeSendAgendaUpdate(context);
+        if (PebbleSender.onNack(context, transactionId)) {
+            // Out of retries: try again later with whatever is current.
+            MainService.maybeSendAgendaUpdate(context);
+        } else {
+            MainService.onTransactionFinished(context);
+        }
+        PebbleState.flush(context);
     }
 };
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import android.content.Context;
+import android.os.SystemClock;
+import android.util.Log;
+
+import com.getpebble.android.kit.PebbleKit;
+import com.getpebble.android.kit.util.PebbleDictionary;
+
+import java.util.List;
+
+import ca.joshuatacoma.bluesky.BlueSkyConstants;
+import ca.joshuatacoma.bluesky.PebbleState;
+
+/** Send messages to the Pebble through a TransactionWindow.
+ */
+public class PebbleSender
+{
+    static final String TAG = "BlueSky";
+
+    /** Message key for agenda updates, whole or patched.  See
+     * TransactionWindow.enqueue.
+     */
+    static final String AGENDA = "agenda";
+
+    static final int WINDOW_SIZE = 4;
+    static final int MAX_ATTEMPTS = 3;
+
+    /** How long to wait for an ACK or NACK.  Well beyond the time PebbleKit
+     * takes to NACK a message it couldn't deliver, so that only replies that
+     * were lost altogether run into it.
+     */
+    static final long TRANSACTION_TIMEOUT_MILLIS = 30 * 1000;
+
+    private static final TransactionWindow<PebbleDictionary> window
+        = new TransactionWindow<PebbleDictionary>(
+                WINDOW_SIZE,
+                MAX_ATTEMPTS,
+                TRANSACTION_TIMEOUT_MILLIS);
+
+    /** Queue a message and send it as soon as the window has room.
+     */
+    public static void send(Context context, String key, PebbleDictionary message) {
+        window.enqueue(key, message);
+        pump(context);
+    }
+
+    /** Whether another send would have to wait for an ACK, a NACK or a
+     * timeout.
+     */
+    public static boolean isBusy() {
+        return window.isFull(SystemClock.elapsedRealtime());
+    }
+
+    /** How long until a transaction in flight times out, or -1 if there's
+     * nothing in flight.
+     */
+    public static long millisUntilTimeout() {
+        return window.millisUntilTimeout(SystemClock.elapsedRealtime());
+    }
+
+    /** Send again whatever has timed out, and anything queued behind it.
+     *
+     * @return true if and only if a message timed out for the last time, in
+     * which case the caller may want to send a fresh one.
+     */
+    public static boolean retryTimedOut(Context context) {
+        pump(context);
+        return window.takeAbandoned();
+    }
+
+    /** Handle an ACK from the Pebble.
+     */
+    public static void onAck(Context context, int transactionId) {
+        TransactionWindow.Transaction<PebbleDictionary> transaction
+            = window.ack(transactionId);
+        if (transaction != null) {
+            PebbleState.recordAck(context);
+            if (transaction.key.equals(AGENDA)) {
+                CalendarBridge.onAgendaAcked(transaction.message, transactionId);
+            }
+        } else {
+            Log.d(TAG, "ignoring ACK for unknown transaction "
+                    +String.valueOf(transactionId));
+        }
+        pump(context);
+    }
+
+    /** Handle a NACK from the Pebble.
+     *
+     * @return true if and only if a message was given up on, in which case
+     * the caller may want to send a fresh one.
+     */
+    public static boolean onNack(Context context, int transactionId) {
+        TransactionWindow.NackResult result = window.nack(transactionId);
+        if (result != TransactionWindow.NackResult.UNKNOWN) {
+            PebbleState.recordNack(context);
+        }
+        pump(context);
+        return result == TransactionWindow.NackResult.DROPPED;
+    }
+
+    private static void pump(Context context) {
+        List<TransactionWindow.Transaction<PebbleDictionary>> sendable
+            = window.takeSendable(SystemClock.elapsedRealtime());
+        for (TransactionWindow.Transaction<PebbleDictionary> transaction
+                : sendable) {
+            PebbleState.recordAttempt(context);
+            if (transaction.key.equals(AGENDA)) {
+                CalendarBridge.onAgendaSent(
+                        transaction.message,
+                        transaction.getId());
+            }
+            PebbleKit.sendDataToPebbleWithTransactionId(
+                    context,
+                    BlueSkyConstants.APP_UUID,
+                    transaction.message,
+                    transaction.getId());
+            Log.d(TAG, "sent "+transaction.key+" as transaction "
+                    +String.valueOf(transaction.getId()));
+        }
+        if (!sendable.isEmpty()) {
+            // Wake up to retry anything that never gets a reply.
+            MainService.scheduleAgendaUpdate(context);
+        }
+    }
+}
@@ -17,49 +17,151 @@ package ca.joshuatacoma.bluesky;
 
 import android.content.Context;
 import android.content.SharedPreferences;
+import android.os.Handler;
+import android.os.Looper;
 import android.util.Log;
 
-import com.getpebble.android.kit.util.PebbleDictionary;
-
 import java.util.Date;
 
-/** Track important Pebble state insofar as it is known.
+/** What the companion knows about its conversation with the Pebble.
+ *
+ * State lives in memory, where every getter reads it and every record method
+ * updates it atomically under the class lock.  Changes are written to
+ * SharedPreferences in batches, so that an attempt, an ACK and a NACK
+ * recorded while handling one broadcast or intent cost one write rather than
+ * one each.  Preferences are read once per process, the first time any state
+ * is needed.
+ *
+ * Android may kill the process as soon as a receiver or service returns, so
+ * each of them calls flush before returning.  Changes are also written
+ * FLUSH_DELAY_MILLISECONDS after they are made, for any recorded elsewhere.
  */
 public class PebbleState
 {
     private static final String TAG = "BlueSky";
 
+    /** How long to collect changes before writing them out.
+     */
+    static final long FLUSH_DELAY_MILLISECONDS = 2*1000;
+
+    private static boolean loaded = false;
+    private static boolean dirty = false;
+    private static Handler flushHandler = null;
+
+    private static long ackTime;
+    private static long attemptTime;
+    private static int agendaFormat;
+    private static int capacityBytes;
+    private static long needSeconds;
+    private static int nackCount;
+    private static long nackTime;
+
     private static SharedPreferences getSharedPreferences(Context context) {
         return context.getSharedPreferences("PebbleStatePrefs", 0);
     }
 
+    /** Read persisted state, if that hasn't been done yet.
+     *
+     * Callers must hold the class lock.
+     */
+    private static void load(Context context) {
+        if (loaded) {
+            return;
+        }
+        SharedPreferences storage = getSharedPreferences(context);
+        ackTime = storage.getLong("agenda.ack_time", 0);
+        attemptTime = storage.getLong("agenda.attempt_time", 0);
+        agendaFormat = storage.getInt(
+                "agenda.format",
+                BlueSkyConstants.AGENDA_FORMAT_PLAIN);
+        capacityBytes = storage.getInt(
+                "agenda.capacity_bytes",
+                BlueSkyConstants.DEFAULT_AGENDA_CAPACITY_BYTES);
+        needSeconds = storage.getLong(
+                "agenda.need_seconds",
+                BlueSkyConstants.DEFAULT_AGENDA_NEED_SECONDS);
+        nackCount = storage.getInt("agenda.nack_count", 0);
+        nackTime = storage.getLong("agenda.nack_time", 0);
+        loaded = true;
+    }
+
+    /** Arrange for state to be written out soon.
+     *
+     * Callers must hold the class lock.
+     */
+    private static void markDirty(Context context) {
+        if (dirty) {
+            return;
+        }
+        dirty = true;
+        final Context appContext = context.getApplicationContext();
+        if (flushHandler == null) {
+            flushHandler = new Handler(Looper.getMainLooper());
+        }
+        flushHandler.postDelayed(
+                new Runnable() {
+                    @Override
+                    public void run() {
+                        flush(appContext);
+                    }
+                },
+                FLUSH_DELAY_MILLISECONDS);
+    }
+
+    /** Write all state out now, in one batch, if anything has changed.
+     */
+    public static synchronized void flush(Context context) {
+        if (!dirty) {
+            return;
+        }
+        SharedPreferences.Editor editor = getSharedPreferences(context).edit();
+        editor.putLong("agenda.ack_time", ackTime);
+        editor.putLong("agenda.attempt_time", attemptTime);
+        editor.putInt("agenda.format", agendaFormat);
+        editor.putInt("agenda.capacity_bytes", capacityBytes);
+        editor.putLong("agenda.need_seconds", needSeconds);
+        editor.putInt("agenda.nack_count", nackCount);
+        editor.putLong("agenda.nack_time", nackTime);
+        // Transactions are tracked by PebbleSender now; don't let one that
+        // was in progress under an older version block sends forever.
+        editor.remove("agenda.transaction");
+        editor.apply();
+        dirty = false;
+    }
+
     /** When the last ACK was received.
      */
-    public static Date getAckTime(Context context) {
-        long time = getSharedPreferences(context).getLong("agenda.ack_time", 0);
-        return new Date(time);
+    public static synchronized Date getAckTime(Context context) {
+        load(context);
+        return new Date(ackTime);
+    }
+
+    /** The newest agenda record format the Pebble understands.
+     */
+    public static synchronized int getAgendaFormat(Context context) {
+        load(context);
+        return agendaFormat;
     }
 
     /** The size of the Pebble's buffer for incoming agenda updates.
      */
-    public static int getAgendaCapacityBytes(Context context) {
-        return getSharedPreferences(context).getInt("agenda.capacity_bytes", 64);
+    public static synchronized int getAgendaCapacityBytes(Context context) {
+        load(context);
+        return capacityBytes;
     }
 
-    /** When the last attempt to send an update to Pebble was made.
+    /** How far ahead the Pebble needs to know about events.
      */
-    public static Date getAttemptTime(Context context) {
-        long time = getSharedPreferences(context).getLong("agenda.attempt_time", 0);
-        return new Date(time);
+    public static synchronized long getAgendaNeedSeconds(Context context) {
+        load(context);
+        return needSeconds;
     }
 
-    /** Estimate whether a transaction is in progress.
-     *
-     * It may be possible for this to be incorrect, but it's about as correct
-     * as possible given the available information.
+    /** When the last attempt to send an update to Pebble was made.
      */
-    public static boolean getIsTransactionInProgress(Context context) {
-        return getSharedPreferences(context).getInt("agenda.transaction", 0) != 0;
+    public static synchronized Date getAttemptTime(Context context) {
+        load(context);
+        return new Date(attemptTime);
     }
 
     /** How many NACKs have been received since the last ACK.
@@ -67,81 +169,75 @@ public class PebbleState
      * If no ACKs have been received, then this is the total number of NACKs
      * that have been received.
      */
-    public static int getNackCount(Context context) {
-        return getSharedPreferences(context).getInt("agenda.nack_count", 0);
+    public static synchronized int getNackCount(Context context) {
+        load(context);
+        return nackCount;
     }
 
     /** When the last NACK was received.
      */
-    public static Date getNackTime(Context context) {
-        long time = getSharedPreferences(context).getLong("agenda.nack_time", 0);
-        return new Date(time);
+    public static synchronized Date getNackTime(Context context) {
+        load(context);
+        return new Date(nackTime);
+    }
+
+    /** Record the newest agenda record format the Pebble understands.
+     */
+    public static synchronized void recordAgendaFormat(Context context, int agendaFormat) {
+        load(context);
+        if (PebbleState.agendaFormat != agendaFormat) {
+            PebbleState.agendaFormat = agendaFormat;
+            markDirty(context);
+            Log.i(TAG, "recorded agenda format="+String.valueOf(agendaFormat));
+        }
     }
 
     /** Record the size of the Pebble's buffer for agenda updates.
      */
-    public static void recordAgendaCapacityBytes(Context context, int capacityBytes) {
-        SharedPreferences.Editor editor = getSharedPreferences(context).edit();
-        editor.putInt("agenda.capacity_bytes", capacityBytes);
-        editor.apply();
+    public static synchronized void recordAgendaCapacityBytes(Context context, int capacityBytes) {
+        load(context);
+        PebbleState.capacityBytes = capacityBytes;
+        markDirty(context);
         Log.i(TAG, "recorded agenda capacity bytes="+String.valueOf(capacityBytes));
     }
 
-    /** Record the outgoing Pebble message for the identified transaction.
-     * 
-     * Record the given agenda update message and transaction id so that
-     * sending the same message can be re-attempted later with the same
-     * transaction id.
+    /** Record how far ahead the Pebble needs to know about events.
      */
-    public static void recordAttempt(Context context, int transactionId) {
-        SharedPreferences.Editor editor = getSharedPreferences(context).edit();
-        editor.putInt("agenda.transaction", transactionId);
-        editor.putLong("agenda.attempt_time", new Date().getTime());
-        editor.apply();
+    public static synchronized void recordAgendaNeedSeconds(Context context, long needSeconds) {
+        load(context);
+        PebbleState.needSeconds = needSeconds;
+        markDirty(context);
+        Log.i(TAG, "recorded agenda need seconds="+String.valueOf(needSeconds));
+    }
+
+    /** Record that a message has been sent to the Pebble.
+     */
+    public static synchronized void recordAttempt(Context context) {
+        load(context);
+        attemptTime = new Date().getTime();
+        markDirty(context);
         Log.i(TAG, "beginning attempted send to Pebble");
     }
 
-    /** Record an ACK received from the Pebble.
-     *
-     * Has no effect if transactionId does not match the transactionId most
-     * recently passed to recordAttempt.
+    /** Record an ACK received from the Pebble for a transaction in flight.
      */
-    public static void recordAck(Context context, int transactionId) {
-        SharedPreferences storage = getSharedPreferences(context);
+    public static synchronized void recordAck(Context context) {
+        load(context);
         Log.i(TAG, "received ACK from Pebble");
-        SharedPreferences.Editor editor = storage.edit();
-        if (storage.getInt("agenda.transaction", 0) == transactionId) {
-            editor.putLong("agenda.ack_time", new Date().getTime());
-            editor.putInt("agenda.nack_count", 0);
-        }
-        editor.putInt("agenda.transaction", 0);
-        editor.apply();
+        ackTime = new Date().getTime();
+        nackCount = 0;
+        markDirty(context);
     }
 
-    /** Record a NACK received from the Pebble.
-     *
-     * Has no effect if transactionId does not match the transactionId most
-     * recently passed to recordAttempt.
-     *
-     * This method is not thread-safe.
+    /** Record a NACK received from the Pebble for a transaction in flight.
      */
-    public static void recordNack(Context context, int transactionId) {
-        SharedPreferences storage = getSharedPreferences(context);
+    public static synchronized void recordNack(Context context) {
+        load(context);
         Log.i(TAG, "received NACK from Pebble");
-        SharedPreferences.Editor editor = storage.edit();
-        if (storage.getInt("agenda.transaction", 0) == transactionId) {
-            editor.putLong("agenda.nack_time", new Date().getTime());
-
-            // The following line is not thread-safe because two threads
-            // attempting the same update at about the same time can cause
-            // one nack to be skipped:
-            int nackCount = storage.getInt("agenda.nack_count", 0);
-            editor.putInt("agenda.nack_count", nackCount+1);
-
-            Log.w(TAG, "agenda.nack_count="+String.valueOf(nackCount)
-                    +", agenda.ack_time="+String.valueOf(getAckTime(context)));
-        }
-        editor.putInt("agenda.transaction", 0);
-        editor.apply();
+        nackTime = new Date().getTime();
+        nackCount += 1;
+        Log.w(TAG, "agenda.nack_count="+String.valueOf(nackCount)
+                +", agenda.ack_time="+String.valueOf(new Date(ackTime)));
+        markDirty(context);
     }
 }
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+
+/** Keep several transactions with the Pebble in flight at once.
+ *
+ * Messages are queued, given transaction ids as room opens up in the window,
+ * and matched to ACKs and NACKs by id.  Only NACKed transactions are sent
+ * again, each under a fresh id so that a late reply to the old one can't be
+ * mistaken for a reply to the new one.
+ *
+ * Each message has a key saying what it updates, such as the agenda.  Queuing
+ * a message supersedes any queued or in-flight message with the same key:
+ * queued ones are dropped, and in-flight ones are not retried if NACKed, so a
+ * stale update can never be retransmitted over a newer one.
+ *
+ * A reply can be lost altogether, for instance if the Pebble app is restarted
+ * while a message is in flight.  So a transaction that has had no reply for
+ * too long is treated as NACKed, rather than holding its place in the window
+ * forever.
+ *
+ * This class is thread-safe.
+ */
+public class TransactionWindow<T>
+{
+    /** PebbleKit transaction ids are 8 bits on the wire; stay within 7 bits
+     * and never use 0, which this app has always treated as "none".
+     */
+    static final int MIN_TRANSACTION_ID = 1;
+    static final int MAX_TRANSACTION_ID = 0x7F;
+
+    /** What became of a NACKed transaction.
+     */
+    public enum NackResult {
+        /** The id didn't match any transaction in flight.
+         */
+        UNKNOWN,
+
+        /** The message has been queued to be sent again.
+         */
+        RETRYING,
+
+        /** The message was superseded or ran out of attempts.
+         */
+        DROPPED,
+    }
+
+    public static class Transaction<T> {
+        public final String key;
+        public final T message;
+        int id = 0;
+        int attempts = 0;
+        long sentAtMillis = 0;
+        boolean superseded = false;
+
+        Transaction(String key, T message) {
+            this.key = key;
+            this.message = message;
+        }
+
+        public int getId() {
+            return id;
+        }
+    }
+
+    private final int windowSize;
+    private final int maxAttempts;
+    private final long timeoutMillis;
+    private final ArrayDeque<Transaction<T>> queue
+        = new ArrayDeque<Transaction<T>>();
+    private final LinkedHashMap<Integer, Transaction<T>> outstanding
+        = new LinkedHashMap<Integer, Transaction<T>>();
+    private int nextId = MIN_TRANSACTION_ID;
+    private boolean abandoned = false;
+
+    /**
+     * @param windowSize how many transactions may be in flight at once.
+     * @param maxAttempts how many times a message is sent before giving up.
+     * @param timeoutMillis how long to wait for a reply before treating a
+     * transaction as NACKed.
+     */
+    public TransactionWindow(int windowSize, int maxAttempts, long timeoutMillis) {
+        this.windowSize = windowSize;
+        this.maxAttempts = maxAttempts;
+        this.timeoutMillis = timeoutMillis;
+    }
+
+    /** Queue a message, superseding any others with the same key.
+     */
+    public synchronized void enqueue(String key, T message) {
+        Iterator<Transaction<T>> queued = queue.iterator();
+        while (queued.hasNext()) {
+            if (queued.next().key.equals(key)) {
+                queued.remove();
+            }
+        }
+        for (Transaction<T> transaction : outstanding.values()) {
+            if (transaction.key.equals(key)) {
+                transaction.superseded = true;
+            }
+        }
+        queue.addLast(new Transaction<T>(key, message));
+    }
+
+    /** Assign ids to as many queued messages as the window has room for.
+     *
+     * @param nowMillis the current time, on a monotonic clock.
+     * @return the transactions to send now, in order.
+     */
+    public synchronized List<Transaction<T>> takeSendable(long nowMillis) {
+        expire(nowMillis);
+        ArrayList<Transaction<T>> sendable = new ArrayList<Transaction<T>>();
+        while (outstanding.size() < windowSize && !queue.isEmpty()) {
+            Transaction<T> transaction = queue.removeFirst();
+            transaction.id = allocateId();
+            transaction.attempts += 1;
+            transaction.sentAtMillis = nowMillis;
+            outstanding.put(transaction.id, transaction);
+            sendable.add(transaction);
+        }
+        return sendable;
+    }
+
+    /** Match an ACK to a transaction in flight.
+     *
+     * @return the transaction, or null if the id didn't match any.
+     */
+    public synchronized Transaction<T> ack(int transactionId) {
+        return outstanding.remove(transactionId);
+    }
+
+    /** Match a NACK to a transaction in flight, and queue it to be sent
+     * again if it's still worth sending.
+     */
+    public synchronized NackResult nack(int transactionId) {
+        Transaction<T> transaction = outstanding.remove(transactionId);
+        if (transaction == null) {
+            return NackResult.UNKNOWN;
+        }
+        if (!isWorthRetrying(transaction)) {
+            return NackResult.DROPPED;
+        }
+        // Retry ahead of anything queued since, to keep messages in order.
+        queue.addFirst(transaction);
+        return NackResult.RETRYING;
+    }
+
+    public synchronized int outstandingCount() {
+        return outstanding.size();
+    }
+
+    /** Whether the window has no room for another transaction.
+     *
+     * @param nowMillis the current time, on the same clock as takeSendable.
+     */
+    public synchronized boolean isFull(long nowMillis) {
+        expire(nowMillis);
+        return outstanding.size() >= windowSize;
+    }
+
+    /** How long until the oldest transaction in flight times out.
+     *
+     * @return milliseconds, 0 if one has timed out already, or -1 if nothing
+     * is in flight.
+     */
+    public synchronized long millisUntilTimeout(long nowMillis) {
+        if (outstanding.isEmpty()) {
+            return -1;
+        }
+        long oldest = Long.MAX_VALUE;
+        for (Transaction<T> transaction : outstanding.values()) {
+            oldest = Math.min(oldest, transaction.sentAtMillis);
+        }
+        return Math.max(0, oldest + timeoutMillis - nowMillis);
+    }
+
+    /** Whether a transaction has timed out on its last attempt since this
+     * was last called.  Such a message is dropped just as if it had been
+     * NACKed, and the caller may want to send a fresh one.
+     */
+    public synchronized boolean takeAbandoned() {
+        boolean result = abandoned;
+        abandoned = false;
+        return result;
+    }
+
+    /** Whether nothing is queued or in flight.
+     */
+    public synchronized boolean isIdle() {
+        return outstanding.isEmpty() && queue.isEmpty();
+    }
+
+    private boolean isWorthRetrying(Transaction<T> transaction) {
+        return !transaction.superseded && transaction.attempts < maxAttempts;
+    }
+
+    /** Treat every transaction that has waited too long for a reply as
+     * NACKed.  Retries go ahead of anything queued, in the order they were
+     * sent.
+     */
+    private void expire(long nowMillis) {
+        ArrayList<Transaction<T>> retries = new ArrayList<Transaction<T>>();
+        Iterator<Transaction<T>> inFlight = outstanding.values().iterator();
+        while (inFlight.hasNext()) {
+            Transaction<T> transaction = inFlight.next();
+            if (nowMillis - transaction.sentAtMillis >= timeoutMillis) {
+                inFlight.remove();
+                if (isWorthRetrying(transaction)) {
+                    retries.add(transaction);
+                } else if (!transaction.superseded) {
+                    abandoned = true;
+                }
+            }
+        }
+        for (int i = retries.size() - 1; i >= 0; --i) {
+            queue.addFirst(retries.get(i));
+        }
+    }
+
+    /** Next id not already in flight.  There are always more ids than room
+     * in the window, so this terminates.
+     */
+    private int allocateId() {
+        while (true) {
+            int id = nextId;
+            nextId = nextId >= MAX_TRANSACTION_ID
+                ? MIN_TRANSACTION_ID
+                : nextId + 1;
+            if (!outstanding.containsKey(id)) {
+                return id;
+            }
+        }
+    }
+}
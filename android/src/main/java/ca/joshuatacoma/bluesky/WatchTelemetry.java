@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import android.content.Context;
+import android.content.SharedPreferences;
+import android.util.Log;
+
+import java.util.Date;
+
+/** Decode and keep health telemetry records sent by the watch face.
+ *
+ * See pebble/src/modules/telemetry.h for the record layout.  The most recent
+ * record is kept as-is and every record is also added to running totals, so
+ * that both "how is it doing now" and "how has it done overall" can be
+ * answered.
+ */
+public class WatchTelemetry
+{
+    private static final String TAG = "BlueSky";
+
+    static final int VERSION = 1;
+    static final int RECORD_BYTES = 18;
+
+    /** Names of the 16-bit fields following the 2-byte header, in order.
+     */
+    static final String[] FIELDS = new String[] {
+        "minutes",
+        "inbox_dropped",
+        "outbox_failed",
+        "agenda_reloads",
+        "renders",
+        "render_ms_max",
+        "render_ms_mean",
+        "heap_min_free",
+    };
+
+    /** Fields that make sense to add up across records.
+     */
+    private static final boolean[] CUMULATIVE = new boolean[] {
+        true, true, true, true, true, false, false, false,
+    };
+
+    private static SharedPreferences getSharedPreferences(Context context) {
+        return context.getSharedPreferences("WatchTelemetryPrefs", 0);
+    }
+
+    /** Decode a record into its fields, in the order of FIELDS.
+     *
+     * Returns null if the record is not one this code understands.
+     */
+    static int[] decode(byte[] record) {
+        if (record == null
+                || record.length < RECORD_BYTES
+                || record[0] != VERSION) {
+            return null;
+        }
+        int[] values = new int[FIELDS.length];
+        for (int i=0; i<FIELDS.length; ++i) {
+            int offset = 2 + i*2;
+            values[i]
+                = (record[offset] & 0xff)
+                | ((record[offset+1] & 0xff) << 8);
+        }
+        return values;
+    }
+
+    /** Decode and store a record received from the watch.
+     */
+    public static void record(Context context, byte[] record) {
+        int[] values = decode(record);
+        if (values == null) {
+            Log.w(TAG, "ignoring unrecognized telemetry record");
+            return;
+        }
+        SharedPreferences storage = getSharedPreferences(context);
+        SharedPreferences.Editor editor = storage.edit();
+        StringBuilder summary = new StringBuilder("watch telemetry:");
+        for (int i=0; i<FIELDS.length; ++i) {
+            editor.putInt("last."+FIELDS[i], values[i]);
+            if (CUMULATIVE[i]) {
+                long total = storage.getLong("total."+FIELDS[i], 0);
+                editor.putLong("total."+FIELDS[i], total+values[i]);
+            }
+            summary.append(" ").append(FIELDS[i]).append("=").append(values[i]);
+        }
+        editor.putLong("last.received_time", new Date().getTime());
+        editor.putLong("total.records", storage.getLong("total.records", 0)+1);
+        editor.apply();
+        Log.i(TAG, summary.toString());
+    }
+};
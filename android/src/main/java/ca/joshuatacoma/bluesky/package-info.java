@@ -0,0 +1,24 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** The Blue Sky companion app.
+ *
+ * The scheduling, encoding and bookkeeping classes (AgendaUpdateScheduler,
+ * AgendaEncoder, InstanceSnapshot, TransactionWindow and AgendaTrace) use
+ * only plain Java and no Android APIs, so that they can be unit tested on the
+ * JVM.  Keep them that way; the Android glue lives in the services and
+ * receivers that call them.
+ */
+package ca.joshuatacoma.bluesky;
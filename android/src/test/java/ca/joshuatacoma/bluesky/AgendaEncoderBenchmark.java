@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import org.junit.Ignore;
+import org.junit.Test;
+
+/** How long AgendaEncoder takes, which is what each cache miss in
+ * CalendarBridge costs on top of the provider query.
+ *
+ * Timings depend on the machine, so this is kept out of the unit suite.
+ * Remove the @Ignore locally to run it.
+ */
+@Ignore("benchmark, run by hand")
+public class AgendaEncoderBenchmark {
+
+    private static final long EPOCH = 1460000000000L;
+    private static final long MINUTE = 60*1000;
+    private static final long DAY = 24*60*MINUTE;
+
+    @Test
+    public void busyWeek() {
+        List<long[]> instances = new ArrayList<long[]>();
+        for (long begin = 0; begin < 7*DAY; begin += 30*MINUTE) {
+            long eventId = (begin / (30*MINUTE)) % 48;
+            instances.add(new long[] {
+                EPOCH + begin,
+                EPOCH + begin + 25*MINUTE,
+                eventId,
+            });
+        }
+        int iterations = 2000;
+        int bytes = 0;
+        // Warm up the JIT before timing.
+        for (int i = 0; i < iterations; ++i) {
+            bytes += AgendaEncoder.encode(instances, EPOCH, 2048).length;
+        }
+        long start = System.nanoTime();
+        for (int i = 0; i < iterations; ++i) {
+            bytes += AgendaEncoder.encode(instances, EPOCH, 2048).length;
+        }
+        long elapsed = System.nanoTime() - start;
+        System.out.println(
+                "AgendaEncoder: "+String.valueOf(instances.size())
+                +" instances in "+String.valueOf(elapsed/iterations/1000)
+                +" us per encode ("+String.valueOf(bytes)+" bytes total)");
+    }
+}
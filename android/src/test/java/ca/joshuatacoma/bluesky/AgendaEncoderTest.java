@@ -0,0 +1,181 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNull;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import org.junit.Test;
+
+public class AgendaEncoderTest {
+
+    private static final long EPOCH = 1460000000000L;
+    private static final long MINUTE = 60*1000;
+    private static final long DAY = 24*60*MINUTE;
+
+    private static long[] instance(long beginMinutes, long endMinutes, long eventId) {
+        return new long[] {
+            EPOCH + beginMinutes*MINUTE,
+            EPOCH + endMinutes*MINUTE,
+            eventId,
+        };
+    }
+
+    private static byte[] records(int... values) {
+        byte[] bytes = new byte[values.length*2];
+        for (int i = 0; i < values.length; ++i) {
+            bytes[2*i] = (byte) (values[i] & 0xff);
+            bytes[2*i+1] = (byte) ((values[i] >> 8) & 0xff);
+        }
+        return bytes;
+    }
+
+    @Test
+    public void encodesSingleEvents() {
+        List<long[]> instances = new ArrayList<long[]>();
+        instances.add(instance(10, 40, 1));
+        instances.add(instance(60, 120, 2));
+        assertArrayEquals(
+                records(10, 40, 60, 120),
+                AgendaEncoder.encode(instances, EPOCH, 1024));
+    }
+
+    @Test
+    public void encodesDailyEventAsRepeat() {
+        List<long[]> instances = new ArrayList<long[]>();
+        for (int day = 0; day < 5; ++day) {
+            instances.add(instance(day*24*60 + 9*60, day*24*60 + 9*60 + 15, 7));
+        }
+        assertArrayEquals(
+                records(9*60, 9*60 + 15, AgendaEncoder.REPEAT_MARK + 3, 24*60),
+                AgendaEncoder.encode(instances, EPOCH, 1024));
+    }
+
+    @Test
+    public void encodesDailyEventPlainForOlderWatches() {
+        List<long[]> instances = new ArrayList<long[]>();
+        for (int day = 0; day < 3; ++day) {
+            instances.add(instance(day*24*60 + 9*60, day*24*60 + 9*60 + 15, 7));
+        }
+        assertArrayEquals(
+                records(
+                    9*60, 9*60 + 15,
+                    33*60, 33*60 + 15,
+                    57*60, 57*60 + 15),
+                AgendaEncoder.encode(instances, EPOCH, 1024, false, null));
+    }
+
+    @Test
+    public void truncatesToCapacity() {
+        List<long[]> instances = new ArrayList<long[]>();
+        for (int i = 0; i < 10; ++i) {
+            instances.add(instance(i*60, i*60 + 30, i));
+        }
+        assertEquals(12, AgendaEncoder.encode(instances, EPOCH, 12).length);
+    }
+
+    @Test
+    public void reportsOnlyInstancesThatFit() {
+        List<long[]> instances = new ArrayList<long[]>();
+        for (int day = 0; day < 3; ++day) {
+            instances.add(instance(day*24*60, day*24*60 + 15, 1));
+        }
+        instances.add(instance(60, 90, 2));
+        instances.add(instance(120, 150, 3));
+        List<long[]> encoded = new ArrayList<long[]>();
+        // Room for event 1 and its repeat, then event 2 but not 3.
+        AgendaEncoder.encode(instances, EPOCH, 12, true, encoded);
+        assertEquals(4, encoded.size());
+        assertEquals(2, encoded.get(3)[2]);
+        // Without room for the repeat, only event 1's first instance.
+        encoded.clear();
+        AgendaEncoder.encode(instances, EPOCH, 4, true, encoded);
+        assertEquals(1, encoded.size());
+        assertEquals(EPOCH, encoded.get(0)[0]);
+    }
+
+    private static byte[] patchHeader(int baseVersion, int version) {
+        byte[] bytes = new byte[8];
+        for (int i = 0; i < 4; ++i) {
+            bytes[i] = (byte) (baseVersion >> (8*i));
+            bytes[4+i] = (byte) (version >> (8*i));
+        }
+        return bytes;
+    }
+
+    private static byte[] concat(byte[]... parts) {
+        int length = 0;
+        for (byte[] part : parts) {
+            length += part.length;
+        }
+        byte[] bytes = new byte[length];
+        int offset = 0;
+        for (byte[] part : parts) {
+            System.arraycopy(part, 0, bytes, offset, part.length);
+            offset += part.length;
+        }
+        return bytes;
+    }
+
+    @Test
+    public void patchReplacesOnlyChangedRecords() {
+        byte[] base = records(0, 30, 60, 90, 120, 150);
+        byte[] target = records(0, 30, 60, 100, 120, 150);
+        assertArrayEquals(
+                concat(
+                    patchHeader(5, 6),
+                    new byte[] { 1, 0, 1, 1 },
+                    records(60, 100)),
+                AgendaEncoder.patch(base, 5, target, 6, 256));
+    }
+
+    @Test
+    public void patchInsertsAndRemoves() {
+        byte[] base = records(0, 30, 120, 150);
+        assertArrayEquals(
+                concat(
+                    patchHeader(1, 2),
+                    new byte[] { 1, 0, 0, 1 },
+                    records(60, 90)),
+                AgendaEncoder.patch(
+                    base, 1, records(0, 30, 60, 90, 120, 150), 2, 256));
+        assertArrayEquals(
+                concat(patchHeader(1, 2), new byte[] { 0, 0, 1, 0 }),
+                AgendaEncoder.patch(base, 1, records(120, 150), 2, 256));
+    }
+
+    @Test
+    public void patchOfUnchangedAgendaIsJustHeader() {
+        byte[] base = records(0, 30);
+        assertArrayEquals(
+                patchHeader(3, 3),
+                AgendaEncoder.patch(base, 3, base, 3, 256));
+    }
+
+    @Test
+    public void patchTooLargeIsNull() {
+        assertNull(AgendaEncoder.patch(
+                records(0, 30),
+                1,
+                records(1, 31, 2, 32, 3, 33),
+                2,
+                16));
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+
+import org.junit.Test;
+
+public class AgendaTraceTest {
+
+    /** A record as the watch would send it, see pebble/src/modules/trace.h.
+     */
+    private static byte[] record(int version, int persist, int reload, int draw) {
+        byte[] record = new byte[AgendaTrace.RECORD_BYTES];
+        record[0] = AgendaTrace.RECORD_VERSION;
+        for (int i = 0; i < 4; ++i) {
+            record[2 + i] = (byte) ((version >> (8*i)) & 0xff);
+        }
+        int[] stages = new int[] { persist, reload, draw };
+        for (int i = 0; i < stages.length; ++i) {
+            record[6 + i*2] = (byte) (stages[i] & 0xff);
+            record[7 + i*2] = (byte) ((stages[i] >> 8) & 0xff);
+        }
+        return record;
+    }
+
+    @Test
+    public void reportBreaksDownWholeUpdate() {
+        AgendaTrace trace = new AgendaTrace();
+        trace.queued(7, 1000, 1040, 1050);
+        trace.sent(7, 3, 1100);
+        trace.acked(7, 3, 1300);
+        String line = trace.report(record(7, 60, 120, 200), 1700);
+        assertNotNull(line);
+        assertTrue(line, line.contains(" version=7 transaction=3 "));
+        assertTrue(line, line.contains(" query=40ms queue=50ms radio=200ms "));
+        assertTrue(line, line.contains(" persist=60ms reload=120ms draw=200ms "));
+        assertTrue(line, line.endsWith(" report=200ms total=500ms"));
+    }
+
+    @Test
+    public void negativeVersionsSurviveTheRecord() {
+        AgendaTrace trace = new AgendaTrace();
+        trace.queued(-123456, 0, 0, 0);
+        assertEquals(-123456, AgendaTrace.decode(record(-123456, 1, 2, 3))[0]);
+        assertNotNull(trace.report(record(-123456, 1, 2, 3), 10));
+    }
+
+    @Test
+    public void eachUpdateIsReportedOnce() {
+        AgendaTrace trace = new AgendaTrace();
+        trace.queued(7, 0, 0, 0);
+        assertNull(trace.report(record(8, 1, 2, 3), 10));
+        assertNotNull(trace.report(record(7, 1, 2, 3), 10));
+        assertNull(trace.report(record(7, 1, 2, 3), 10));
+    }
+
+    @Test
+    public void unseenStagesAreUnknown() {
+        AgendaTrace trace = new AgendaTrace();
+        trace.queued(7, 0, 0, 0);
+        trace.sent(7, 3, 10);
+        trace.acked(7, 3, 20);
+        String line = trace.report(
+                record(7, AgendaTrace.UNSEEN, 5, AgendaTrace.UNSEEN), 100);
+        assertTrue(line, line.contains(" persist=? reload=5ms draw=? "));
+        assertTrue(line, line.endsWith(" report=? total=?"));
+    }
+
+    @Test
+    public void ackOfEarlierAttemptIsIgnored() {
+        AgendaTrace trace = new AgendaTrace();
+        trace.queued(7, 0, 0, 0);
+        trace.sent(7, 3, 10);
+        trace.sent(7, 4, 20);
+        trace.acked(7, 3, 30);
+        String line = trace.report(record(7, 1, 2, 3), 100);
+        assertTrue(line, line.contains(" transaction=4 "));
+        assertTrue(line, line.contains(" radio=? "));
+    }
+
+    @Test
+    public void oldestUnreportedUpdatesAreForgotten() {
+        AgendaTrace trace = new AgendaTrace();
+        for (int version = 1; version <= AgendaTrace.MAX_PENDING + 1; ++version) {
+            trace.queued(version, 0, 0, 0);
+        }
+        assertNull(trace.report(record(1, 1, 2, 3), 10));
+        assertNotNull(trace.report(record(2, 1, 2, 3), 10));
+    }
+
+    @Test
+    public void unrecognizedRecordsAreRejected() {
+        byte[] wrongVersion = record(7, 1, 2, 3);
+        wrongVersion[0] = AgendaTrace.RECORD_VERSION + 1;
+        assertNull(AgendaTrace.decode(wrongVersion));
+        assertNull(AgendaTrace.decode(new byte[AgendaTrace.RECORD_BYTES - 1]));
+        assertNull(AgendaTrace.decode(null));
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import org.junit.Before;
+import org.junit.Test;
+
+public class AgendaUpdateSchedulerTest {
+
+    private static class FakeClock implements AgendaUpdateScheduler.Clock {
+        long now = 1000000;
+
+        @Override
+        public long currentTimeMillis() {
+            return now;
+        }
+    }
+
+    private FakeClock clock;
+    private AgendaUpdateScheduler scheduler;
+
+    @Before
+    public void setUp() {
+        clock = new FakeClock();
+        scheduler = new AgendaUpdateScheduler(clock);
+    }
+
+    @Test
+    public void nothingPendingWithoutRequest() {
+        assertEquals(-1, scheduler.millisUntilDue());
+        assertFalse(scheduler.take(false));
+    }
+
+    @Test
+    public void burstIsMergedIntoOneUpdate() {
+        for (int i = 0; i < 5; ++i) {
+            scheduler.request();
+            clock.now += 500;
+        }
+        assertFalse(scheduler.take(false));
+        clock.now += AgendaUpdateScheduler.QUIET_MILLIS;
+        assertTrue(scheduler.take(false));
+        assertFalse(scheduler.isPending());
+        assertFalse(scheduler.take(false));
+    }
+
+    @Test
+    public void steadyRequestsCannotPostponeForever() {
+        long first = clock.now;
+        while (clock.now < first + AgendaUpdateScheduler.MAX_DELAY_MILLIS) {
+            scheduler.request();
+            clock.now += AgendaUpdateScheduler.QUIET_MILLIS / 2;
+        }
+        assertEquals(0, scheduler.millisUntilDue());
+        assertTrue(scheduler.take(false));
+    }
+
+    @Test
+    public void staysPendingUntilTransactionFinishes() {
+        scheduler.request();
+        clock.now += AgendaUpdateScheduler.QUIET_MILLIS;
+        assertFalse(scheduler.take(true));
+        assertTrue(scheduler.isPending());
+        clock.now += 60 * 1000;
+        assertTrue(scheduler.take(false));
+    }
+
+    @Test
+    public void deferHoldsUpdateUntilGivenTime() {
+        scheduler.request();
+        clock.now += AgendaUpdateScheduler.QUIET_MILLIS;
+        scheduler.defer(clock.now + 5000);
+        assertEquals(5000, scheduler.millisUntilDue());
+        clock.now += 5000;
+        assertTrue(scheduler.take(false));
+        scheduler.request();
+        assertEquals(
+                AgendaUpdateScheduler.QUIET_MILLIS,
+                scheduler.millisUntilDue());
+    }
+
+    @Test
+    public void requestNowIsDueImmediately() {
+        scheduler.requestNow();
+        assertTrue(scheduler.isPending());
+        assertEquals(0, scheduler.millisUntilDue());
+        assertFalse(scheduler.take(true));
+        assertTrue(scheduler.take(false));
+        assertEquals(-1, scheduler.millisUntilDue());
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
+
+import com.getpebble.android.kit.util.PebbleDictionary;
+
+import org.junit.Before;
+import org.junit.Test;
+
+public class CalendarBridgeTest {
+
+    private static final long NOW = 1460000000000L;
+
+    /** Have the watch ACK a whole agenda with the given version, as though
+     * sendAgenda had just sent it.
+     */
+    private static void ackAgenda(int version) {
+        CalendarBridge.Payload payload = new CalendarBridge.Payload();
+        payload.builtMilliseconds = NOW;
+        payload.epochMilliseconds = NOW;
+        payload.version = version;
+        payload.agenda = new byte[0];
+        CalendarBridge.setCachedPayload(payload);
+        PebbleDictionary message = new PebbleDictionary();
+        message.addInt32(BlueSkyConstants.AGENDA_VERSION_KEY, version);
+        CalendarBridge.onAgendaAcked(message, 1);
+    }
+
+    @Before
+    public void watchHasAgenda() {
+        ackAgenda(7);
+        assertNotNull(CalendarBridge.getPatchBase(NOW));
+    }
+
+    @Test
+    public void sameVersionKeepsPatchBase() {
+        CalendarBridge.onWatchAgendaVersion(7);
+        assertEquals(7, CalendarBridge.getPatchBase(NOW).version);
+    }
+
+    @Test
+    public void otherVersionDropsPatchBase() {
+        CalendarBridge.onWatchAgendaVersion(6);
+        assertNull(CalendarBridge.getPatchBase(NOW));
+    }
+
+    @Test
+    public void missingAgendaDropsPatchBase() {
+        CalendarBridge.onWatchAgendaMissing();
+        assertNull(CalendarBridge.getPatchBase(NOW));
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+
+import org.junit.Test;
+
+public class InstanceSnapshotTest {
+
+    private static final long HOUR = 60*60*1000;
+    private static final long DAY = 24*HOUR;
+
+    private static long[] instance(long begin, long end, long eventId, long id) {
+        return new long[] { begin, end, eventId, id };
+    }
+
+    private static List<long[]> agenda() {
+        List<long[]> instances = new ArrayList<long[]>();
+        instances.add(instance(1*HOUR, 2*HOUR, 1, 10));
+        instances.add(instance(3*HOUR, 4*HOUR, 2, 20));
+        instances.add(instance(3*DAY, 3*DAY+HOUR, 3, 30));
+        return instances;
+    }
+
+    @Test
+    public void sameInstancesInAnyOrderAreSame() {
+        List<long[]> reversed = agenda();
+        Collections.reverse(reversed);
+        InstanceSnapshot a = InstanceSnapshot.of(agenda());
+        InstanceSnapshot b = InstanceSnapshot.of(reversed);
+        assertEquals(3, b.size());
+        assertTrue(a.sameWithin(b, 0, 7*DAY));
+    }
+
+    @Test
+    public void movedEventWithinWindowDiffers() {
+        List<long[]> moved = agenda();
+        moved.set(1, instance(3*HOUR, 5*HOUR, 2, 20));
+        assertFalse(InstanceSnapshot.of(agenda()).sameWithin(
+                    InstanceSnapshot.of(moved), 0, DAY));
+    }
+
+    @Test
+    public void addedOrRemovedEventWithinWindowDiffers() {
+        List<long[]> added = agenda();
+        added.add(instance(6*HOUR, 7*HOUR, 4, 40));
+        List<long[]> removed = agenda();
+        removed.remove(0);
+        InstanceSnapshot snapshot = InstanceSnapshot.of(agenda());
+        assertFalse(snapshot.sameWithin(InstanceSnapshot.of(added), 0, DAY));
+        assertFalse(InstanceSnapshot.of(added).sameWithin(snapshot, 0, DAY));
+        assertFalse(snapshot.sameWithin(InstanceSnapshot.of(removed), 0, DAY));
+    }
+
+    @Test
+    public void changesOutsideWindowAreIgnored() {
+        List<long[]> changed = agenda();
+        changed.set(2, instance(4*DAY, 4*DAY+HOUR, 3, 30));
+        changed.add(instance(5*DAY, 5*DAY+HOUR, 5, 50));
+        assertTrue(InstanceSnapshot.of(agenda()).sameWithin(
+                    InstanceSnapshot.of(changed), 0, DAY));
+        assertFalse(InstanceSnapshot.of(agenda()).sameWithin(
+                    InstanceSnapshot.of(changed), 0, 7*DAY));
+    }
+
+    @Test
+    public void eventsInProgressAreInWindow() {
+        List<long[]> before = new ArrayList<long[]>();
+        before.add(instance(0, 2*HOUR, 1, 10));
+        List<long[]> after = new ArrayList<long[]>();
+        after.add(instance(0, 3*HOUR, 1, 10));
+        assertFalse(InstanceSnapshot.of(before).sameWithin(
+                    InstanceSnapshot.of(after), HOUR, DAY));
+        assertTrue(InstanceSnapshot.of(before).sameWithin(
+                    InstanceSnapshot.of(after), 4*HOUR, DAY));
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package ca.joshuatacoma.bluesky;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotEquals;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+
+import java.util.HashSet;
+import java.util.List;
+
+import org.junit.Test;
+
+public class TransactionWindowTest {
+
+    static final long TIMEOUT = 30 * 1000;
+
+    @Test
+    public void keepsSeveralInFlightWithDistinctIds() {
+        TransactionWindow<String> window = new TransactionWindow<String>(3, 2, TIMEOUT);
+        for (int i = 0; i < 5; ++i) {
+            window.enqueue("part" + i, "message" + i);
+        }
+        List<TransactionWindow.Transaction<String>> sent = window.takeSendable(0);
+        assertEquals(3, sent.size());
+        assertTrue(window.isFull(0));
+        HashSet<Integer> ids = new HashSet<Integer>();
+        for (TransactionWindow.Transaction<String> transaction : sent) {
+            ids.add(transaction.getId());
+        }
+        assertEquals(3, ids.size());
+
+        assertNotNull(window.ack(sent.get(1).getId()));
+        assertNull(window.ack(sent.get(1).getId()));
+        List<TransactionWindow.Transaction<String>> more = window.takeSendable(0);
+        assertEquals(1, more.size());
+        assertEquals("message3", more.get(0).message);
+    }
+
+    @Test
+    public void retransmitsOnlyNackedUnderFreshId() {
+        TransactionWindow<String> window = new TransactionWindow<String>(4, 3, TIMEOUT);
+        window.enqueue("a", "A");
+        window.enqueue("b", "B");
+        List<TransactionWindow.Transaction<String>> sent = window.takeSendable(0);
+        int nackedId = sent.get(0).getId();
+
+        assertEquals(
+                TransactionWindow.NackResult.RETRYING,
+                window.nack(nackedId));
+        List<TransactionWindow.Transaction<String>> resent = window.takeSendable(0);
+        assertEquals(1, resent.size());
+        assertEquals("A", resent.get(0).message);
+        assertNotEquals(nackedId, resent.get(0).getId());
+        assertEquals(
+                TransactionWindow.NackResult.UNKNOWN,
+                window.nack(nackedId));
+    }
+
+    @Test
+    public void givesUpAfterMaxAttempts() {
+        TransactionWindow<String> window = new TransactionWindow<String>(1, 2, TIMEOUT);
+        window.enqueue("a", "A");
+        int id = window.takeSendable(0).get(0).getId();
+        assertEquals(TransactionWindow.NackResult.RETRYING, window.nack(id));
+        id = window.takeSendable(0).get(0).getId();
+        assertEquals(TransactionWindow.NackResult.DROPPED, window.nack(id));
+        assertTrue(window.isIdle());
+    }
+
+    @Test
+    public void newerMessageSupersedesOlderWithSameKey() {
+        TransactionWindow<String> window = new TransactionWindow<String>(1, 3, TIMEOUT);
+        window.enqueue("agenda", "old");
+        int oldId = window.takeSendable(0).get(0).getId();
+        window.enqueue("agenda", "queued");
+        window.enqueue("agenda", "new");
+        assertEquals(
+                TransactionWindow.NackResult.DROPPED,
+                window.nack(oldId));
+        List<TransactionWindow.Transaction<String>> sent = window.takeSendable(0);
+        assertEquals(1, sent.size());
+        assertEquals("new", sent.get(0).message);
+    }
+
+    @Test
+    public void idsStayWithinSevenBitsAndSkipZero() {
+        TransactionWindow<String> window = new TransactionWindow<String>(1, 1, TIMEOUT);
+        for (int i = 0; i < 300; ++i) {
+            window.enqueue("a", "A");
+            int id = window.takeSendable(0).get(0).getId();
+            assertTrue(id >= 1 && id <= 0x7F);
+            assertNotNull(window.ack(id));
+        }
+    }
+
+    @Test
+    public void lostRepliesTimeOutInsteadOfFillingTheWindow() {
+        TransactionWindow<String> window
+            = new TransactionWindow<String>(2, 2, TIMEOUT);
+        window.enqueue("a", "A");
+        window.enqueue("b", "B");
+        List<TransactionWindow.Transaction<String>> sent
+            = window.takeSendable(1000);
+        int lostId = sent.get(0).getId();
+        assertTrue(window.isFull(1000 + TIMEOUT - 1));
+        window.enqueue("c", "C");
+        assertTrue(window.takeSendable(1000 + TIMEOUT - 1).isEmpty());
+
+        // Neither reply ever arrives: both are sent again, in order, ahead of
+        // what was queued behind them.
+        assertFalse(window.isFull(1000 + TIMEOUT));
+        List<TransactionWindow.Transaction<String>> resent
+            = window.takeSendable(1000 + TIMEOUT);
+        assertEquals(2, resent.size());
+        assertEquals("A", resent.get(0).message);
+        assertEquals("B", resent.get(1).message);
+        assertNotEquals(lostId, resent.get(0).getId());
+        assertNull(window.ack(lostId));
+
+        assertEquals(TIMEOUT, window.millisUntilTimeout(1000 + TIMEOUT));
+        assertFalse(window.takeAbandoned());
+
+        // Out of attempts, so the next timeout drops them.
+        List<TransactionWindow.Transaction<String>> last
+            = window.takeSendable(1000 + 2 * TIMEOUT);
+        assertTrue(window.takeAbandoned());
+        assertFalse(window.takeAbandoned());
+        assertEquals(1, last.size());
+        assertEquals("C", last.get(0).message);
+        assertNotNull(window.ack(last.get(0).getId()));
+        assertTrue(window.isIdle());
+        assertEquals(-1, window.millisUntilTimeout(1000 + 2 * TIMEOUT));
+    }
+}
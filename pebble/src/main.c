@@ -17,18 +17,28 @@
 
 #include "modules/data.h"
 #include "modules/agenda.h"
+#include "modules/memory.h"
+#include "modules/quality.h"
+#include "modules/telemetry.h"
+#include "modules/trace.h"
 #include "windows/main_window.h"
 
 static void init() {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "init()");
     bsky_data_init();
+    bsky_quality_init();
+    bsky_telemetry_init();
     bsky_agenda_init();
+    bsky_memory_checkpoint("init");
     main_window_push();
 }
 
 static void deinit() {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "deinit()");
     bsky_agenda_deinit();
+    bsky_trace_deinit();
+    bsky_telemetry_deinit();
+    bsky_quality_deinit();
     bsky_data_deinit();
 }
 
@@ -17,94 +17,508 @@
 
 #include "data.h"
 #include "agenda.h"
+#include "memory.h"
+#include "snapshot.h"
+#include "store.h"
+#include "telemetry.h"
+#include "trace.h"
+
+// How long to wait for the background worker to report a snapshot before
+// building it in the foreground instead.
+//
+#define BSKY_AGENDA_WORKER_TIMEOUT_MS 3000
+
+// An agenda patch, as received in BSKY_DATAKEY_AGENDA_PATCH, is this header
+// followed by any number of splices.  Each splice is a BSKY_AgendaPatchSplice
+// followed by insert_count agenda records, and applies to the agenda as left
+// by the splice before it.  All values are little-endian.
+//
+// A patch only applies to the agenda whose version is base_version; anything
+// else gets the whole agenda requested again instead.
+//
+struct BSKY_AgendaPatchHeader {
+    int32_t base_version;
+    int32_t version;
+};
+
+struct BSKY_AgendaPatchSplice {
+    uint16_t index;
+    uint8_t remove_count;
+    uint8_t insert_count;
+};
 
 // The next time it would be acceptable to request an update.
 //
 static time_t s_next_attempt_update;
 
-// Using the built-in qsort function to sort an array of indices by the values
-// they index in another array requires making that other array available to
-// the "compare" function passed to qsort.
+static struct BSKY_Agenda s_agenda;
+
+// The allocation s_agenda.starts and s_agenda.durations point into, or NULL.
+//
+static void * s_instances;
+
+// Scheduled fallback for a snapshot requested from the worker, or NULL.
 //
-// See cmp_agenda_events_by_height.
+static AppTimer * s_worker_timer;
+
+// The last answer from bsky_agenda_moment, valid until the agenda changes.
+//
+static struct BSKY_AgendaMoment s_moment;
+static bool s_moment_valid;
+
+// What bsky_agenda_bins last built, in an allocation made on first use.
+//
+static struct BSKY_AgendaBins s_bins;
+static void * s_bins_buffer;
+static bool s_bins_valid;
+
+// Subscribers to agenda updates.  See bsky_agenda_subscribe.
 //
-static const struct BSKY_AgendaEvent * cmp_agenda_events_by_height_agenda;
+struct BSKY_AgendaReceiverInfo {
+    BSKY_AgendaReceiver receiver;
+    void * context;
+};
 
-// Compare two indices in a list of indices based on the values they index in
-// the cmp_agenda_events_by_height_agenda array.
+static struct BSKY_AgendaReceiverInfo s_receivers [4];
+
+// Compare instances packed by bsky_agenda_expand, for qsort.
 //
-// See bsky_agenda_update_events_by_height.
+static int cmp_agenda_instances(const void * a, const void * b) {
+    const uint32_t instances [2] = { *(const uint32_t *)a, *(const uint32_t *)b };
+    return instances[0] < instances[1] ? -1 : instances[0] > instances[1];
+}
+
+// Restore the max-heap property of instances packed by bsky_agenda_expand,
+// given that it holds everywhere below index i.
 //
-static int cmp_agenda_events_by_height(const void * a, const void * b) {
-    uint16_t index [2] = { *((uint16_t*)a), *((uint16_t*)b) };
-    int32_t duration[2];
-    for (int i=0; i<2; ++i) {
-        int32_t start = cmp_agenda_events_by_height_agenda[index[i]].rel_start;
-        int32_t end = cmp_agenda_events_by_height_agenda[index[i]].rel_end;
-        duration[i] = end-start;
+static void sift_agenda_instances(uint32_t * heap, int32_t length, int32_t i) {
+    for (;;) {
+        int32_t largest = i;
+        const int32_t left = 2 * i + 1;
+        const int32_t right = left + 1;
+        if (left < length && heap[left] > heap[largest]) {
+            largest = left;
+        }
+        if (right < length && heap[right] > heap[largest]) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+        const uint32_t swap = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = swap;
+        i = largest;
     }
-    return duration[0]-duration[1];
 }
 
-// Re-generate the events_by_height index.
+// Expand every instance of the events in a snapshot into the agenda's arrays,
+// sorted by start.  Past BSKY_AGENDA_INSTANCES_MAX only the earliest are kept.
+//
+// Returns: the allocation the arrays point into, or NULL if there are no
+// instances or no room for them.
 //
-static void bsky_agenda_update_events_by_height(struct BSKY_Agenda * agenda) {
-    if (agenda->events_by_height) {
-        free(agenda->events_by_height);
+static void * bsky_agenda_expand(
+        struct BSKY_Agenda * agenda,
+        const struct BSKY_SnapshotHeader * snapshot) {
+    const struct BSKY_AgendaEvent * events = bsky_snapshot_events(snapshot);
+    const int32_t events_length = snapshot->events_length;
+    agenda->starts = NULL;
+    agenda->durations = NULL;
+    agenda->instances_length = 0;
+    agenda->duration_max = 0;
+
+    int32_t length = 0;
+    for (int32_t ievent=0; ievent<events_length; ++ievent) {
+        int32_t stride;
+        if (!bsky_agenda_is_repeat(&events[ievent])) {
+            length += bsky_agenda_event_instances(
+                    events, events_length, ievent, &stride);
+        }
+    }
+    const bool truncate = length > BSKY_AGENDA_INSTANCES_MAX;
+    if (truncate) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_agenda_expand: keeping the earliest %d of %ld instances",
+                BSKY_AGENDA_INSTANCES_MAX,
+                length);
+        length = BSKY_AGENDA_INSTANCES_MAX;
     }
-    agenda->events_by_height
-        = calloc(agenda->events_length,
-                 sizeof(agenda->events_by_height[0]));
-    if (!agenda->events_by_height) {
+
+    // Each instance packed as its start, offset to sort unsigned, over its
+    // duration, so that sorting by start is a plain integer sort.  When there
+    // are too many, the packed instances become a max-heap once full, and
+    // each later instance replaces the latest one kept if it starts earlier.
+    uint32_t * packed = malloc(length * sizeof(packed[0]) + 1);
+    void * instances = malloc(
+            length * (sizeof(agenda->starts[0]) + sizeof(agenda->durations[0]))
+            + 1);
+    if (!packed || !instances) {
         APP_LOG(APP_LOG_LEVEL_ERROR,
-                "bsky_agenda_update_events_by_height:"
-                " calloc failed for %lu x %u bytes",
-                agenda->events_length,
-                sizeof(agenda->events_by_height[0]));
-    } else {
-        for (int16_t i=0; i<agenda->events_length; ++i) {
-            agenda->events_by_height[i] = i;
+                "bsky_agenda_expand: malloc failed for %ld instances",
+                length);
+        free(instances);
+        free(packed);
+        return NULL;
+    }
+    int32_t ipacked = 0;
+    for (int32_t ievent=0; ievent<events_length; ++ievent) {
+        const int32_t rel_start = events[ievent].rel_start;
+        const int32_t duration = events[ievent].rel_end - rel_start;
+        if (bsky_agenda_is_repeat(&events[ievent])
+                || duration <= 0
+                || duration > UINT16_MAX) {
+            continue;
+        }
+        int32_t stride;
+        const int32_t count = bsky_agenda_event_instances(
+                events, events_length, ievent, &stride);
+        for (int32_t k=0; k<count; ++k) {
+            const int32_t start = rel_start + k * stride;
+            if (start > INT16_MAX) {
+                break;
+            }
+            const uint32_t instance
+                = (uint32_t)(start - INT16_MIN) << 16 | (uint32_t)duration;
+            if (ipacked < length) {
+                packed[ipacked++] = instance;
+                if (truncate && ipacked == length) {
+                    for (int32_t i=length/2-1; i>=0; --i) {
+                        sift_agenda_instances(packed, length, i);
+                    }
+                }
+            } else if (instance < packed[0]) {
+                packed[0] = instance;
+                sift_agenda_instances(packed, length, 0);
+            }
         }
-        cmp_agenda_events_by_height_agenda = agenda->events;
-        qsort (agenda->events_by_height,
-                agenda->events_length,
-                sizeof(agenda->events_by_height[0]),
-                cmp_agenda_events_by_height);
-        cmp_agenda_events_by_height_agenda = NULL;
     }
+    length = ipacked;
+    qsort(packed, length, sizeof(packed[0]), cmp_agenda_instances);
+
+    int16_t * starts = instances;
+    uint16_t * durations = (uint16_t *)(starts + length);
+    int32_t duration_max = 0;
+    for (int32_t i=0; i<length; ++i) {
+        starts[i] = (int32_t)(packed[i] >> 16) + INT16_MIN;
+        durations[i] = packed[i] & 0xffff;
+        if (durations[i] > duration_max) {
+            duration_max = durations[i];
+        }
+    }
+    free(packed);
+
+    agenda->starts = starts;
+    agenda->durations = durations;
+    agenda->instances_length = length;
+    agenda->duration_max = duration_max;
+    return instances;
 }
 
-static void bsky_agenda_reload(struct BSKY_Agenda * agenda) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_agenda_reload");
+// Point the agenda at a new snapshot, taking ownership of it, and let the
+// subscribers know.  Only the expanded instances are kept; the snapshot itself
+// is freed.
+//
+static void bsky_agenda_install(
+        struct BSKY_Agenda * agenda,
+        struct BSKY_SnapshotHeader * snapshot) {
+    free(s_instances);
+    s_instances = bsky_agenda_expand(agenda, snapshot);
+    agenda->epoch = snapshot->epoch;
+    s_moment_valid = false;
+    s_bins_valid = false;
+    agenda->version = snapshot->version;
+    free(snapshot);
+    bsky_telemetry_count(BSKY_TELEMETRY_AGENDA_RELOADS);
+    bsky_trace_mark(BSKY_TRACE_RELOADED, agenda->version);
+    bsky_memory_checkpoint("bsky_agenda_install");
+    for (size_t i=0; i<sizeof(s_receivers)/sizeof(s_receivers[0]); ++i) {
+        if (s_receivers[i].receiver) {
+            s_receivers[i].receiver(s_receivers[i].context);
+        }
+    }
+}
 
-    int32_t epoch = bsky_data_int(BSKY_DATAKEY_AGENDA_EPOCH);
+// Use the persisted snapshot if it was built from the given agenda.
+//
+// Returns true if and only if the persisted snapshot was installed.
+//
+static bool bsky_agenda_load_snapshot(
+        struct BSKY_Agenda * agenda,
+        int32_t version,
+        int32_t raw_epoch) {
+    if (!version) {
+        // Without a version there's nothing to tell agendas apart.
+        return false;
+    }
+    const size_t capacity = bsky_store_length(BSKY_SNAPSHOT_STORE_KEY);
+    if (capacity < sizeof(struct BSKY_SnapshotHeader)) {
+        return false;
+    }
+    struct BSKY_SnapshotHeader * snapshot = malloc(capacity);
+    if (!snapshot) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_agenda_load_snapshot: malloc failed for %u bytes",
+                capacity);
+        return false;
+    }
+    size_t length;
+    const bool ok
+        = bsky_store_read(BSKY_SNAPSHOT_STORE_KEY, snapshot, capacity, &length)
+        && length == sizeof(*snapshot)
+            + snapshot->events_length * sizeof(struct BSKY_AgendaEvent)
+        && snapshot->version == version
+        && snapshot->raw_epoch == raw_epoch;
+    if (!ok) {
+        free(snapshot);
+        return false;
+    }
+    bsky_agenda_install(agenda, snapshot);
+    return true;
+}
 
+// Build a snapshot from the received agenda without the worker's help.
+//
+static void bsky_agenda_build_snapshot(
+        struct BSKY_Agenda * agenda,
+        int32_t version,
+        int32_t raw_epoch) {
     size_t num_bytes;
     const void * bytes = bsky_data_ptr(BSKY_DATAKEY_AGENDA, &num_bytes);
     if (!bytes || num_bytes==0) {
         APP_LOG(APP_LOG_LEVEL_INFO,
-                "bsky_agenda_reload: no agenda data available yet");
-        agenda->events_length = 0;
+                "bsky_agenda_build_snapshot: no agenda data available yet");
         return;
     }
-
     APP_LOG(APP_LOG_LEVEL_DEBUG,
-            "bsky_agenda_reload: %u bytes",
+            "bsky_agenda_build_snapshot: %u bytes",
             num_bytes);
-    agenda->epoch = epoch;
-    struct tm * epoch_wall_time = localtime(&agenda->epoch);
-    agenda->epoch_wall_time = *epoch_wall_time;
-    agenda->events_length = num_bytes / sizeof(agenda->events[0]);
-    agenda->events = bytes;
-    if (agenda->epoch_wall_time.tm_sec) {
-        // TODO: fix this in the remote code by always rounding epoch down to
-        // the minute.
-        agenda->epoch += (60 - agenda->epoch_wall_time.tm_sec);
-        agenda->epoch_wall_time.tm_sec = 0;
-    }
-    bsky_agenda_update_events_by_height(agenda);
-    APP_LOG(APP_LOG_LEVEL_INFO,
-            "bsky_agenda_reload: finished loading agenda data");
+    size_t length;
+    struct BSKY_SnapshotHeader * snapshot = bsky_snapshot_build(
+            bytes,
+            num_bytes / sizeof(struct BSKY_AgendaEvent),
+            version,
+            raw_epoch,
+            time(NULL),
+            &length);
+    if (!snapshot) {
+        return;
+    }
+    // The agenda itself stays persisted too, as the base for patches.
+    if (version) {
+        bsky_store_write(BSKY_SNAPSHOT_STORE_KEY, snapshot, length);
+    }
+    bsky_agenda_install(agenda, snapshot);
+}
+
+// Stop waiting for the worker, if it was asked for a snapshot.
+//
+static void bsky_agenda_cancel_worker() {
+    if (s_worker_timer) {
+        app_timer_cancel(s_worker_timer);
+        s_worker_timer = NULL;
+    }
+}
+
+// Give up waiting for the worker.
+//
+// Matches AppTimerCallback.
+//
+static void bsky_agenda_worker_timeout(void * context) {
+    APP_LOG(APP_LOG_LEVEL_WARNING,
+            "bsky_agenda_worker_timeout: building snapshot in the foreground");
+    s_worker_timer = NULL;
+    bsky_agenda_build_snapshot(
+            context,
+            bsky_data_int(BSKY_DATAKEY_AGENDA_VERSION),
+            bsky_data_int(BSKY_DATAKEY_AGENDA_EPOCH));
+}
+
+// Ask the worker to build a snapshot for the given version, if it is running.
+// The worker is only ever started by the user choosing it as the background
+// app: launching it from here would ask the user to replace whatever
+// background app they chose instead, on every calendar sync.
+//
+// Returns true if and only if the worker will report back.
+//
+static bool bsky_agenda_ask_worker(
+        struct BSKY_Agenda * agenda,
+        int32_t version) {
+    if (!app_worker_is_running()) {
+        return false;
+    }
+    AppWorkerMessage message = {
+        .data0 = (uint32_t)version & 0xffff,
+        .data1 = (uint32_t)version >> 16,
+    };
+    app_worker_send_message(BSKY_SNAPSHOT_MSG_BUILD, &message);
+    bsky_agenda_cancel_worker();
+    s_worker_timer = app_timer_register(
+            BSKY_AGENDA_WORKER_TIMEOUT_MS,
+            bsky_agenda_worker_timeout,
+            agenda);
+    return true;
+}
+
+static void bsky_agenda_reload(struct BSKY_Agenda * agenda) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_agenda_reload");
+
+    const int32_t raw_epoch = bsky_data_int(BSKY_DATAKEY_AGENDA_EPOCH);
+    const int32_t version = bsky_data_int(BSKY_DATAKEY_AGENDA_VERSION);
+
+    if (bsky_agenda_load_snapshot(agenda, version, raw_epoch)) {
+        APP_LOG(APP_LOG_LEVEL_INFO,
+                "bsky_agenda_reload: using persisted snapshot for version %ld",
+                version);
+        bsky_agenda_cancel_worker();
+    } else if (version && bsky_agenda_ask_worker(agenda, version)) {
+        // Keep drawing the current agenda until the worker reports back.
+    } else {
+        bsky_agenda_cancel_worker();
+        bsky_agenda_build_snapshot(agenda, version, raw_epoch);
+    }
+}
+
+// Reload once the worker has persisted a snapshot.
+//
+// Matches AppWorkerMessageHandler.
+//
+static void bsky_agenda_worker_message(
+        uint16_t type,
+        AppWorkerMessage * message) {
+    if (type != BSKY_SNAPSHOT_MSG_READY) {
+        return;
+    }
+    const int32_t version
+        = (int32_t)((uint32_t)message->data1 << 16 | message->data0);
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "bsky_agenda_worker_message: snapshot ready for version %ld",
+            version);
+    // Anything older, the worker has been asked to build over again.
+    if (version == bsky_data_int(BSKY_DATAKEY_AGENDA_VERSION)) {
+        bsky_agenda_reload(&s_agenda);
+    }
+}
+
+// Set the values that ask the phone for an agenda.
+//
+static void bsky_agenda_set_request(time_t now) {
+    bsky_data_set_outgoing_int(BSKY_DATAKEY_AGENDA_NEED_SECONDS, 24*60*60);
+    bsky_data_set_outgoing_int(
+            BSKY_DATAKEY_AGENDA_CAPACITY_BYTES,
+            bsky_data_capacity(BSKY_DATAKEY_AGENDA));
+    bsky_data_set_outgoing_int(BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME, now);
+}
+
+// Check that every splice in a patch is complete and in range.
+//
+// Returns: the number of records the agenda will have once patched, or -1 if
+// the patch doesn't apply.
+//
+static int32_t bsky_agenda_check_patch(
+        const uint8_t * splices,
+        size_t splices_bytes,
+        int32_t events_length,
+        int32_t events_capacity) {
+    size_t offset = 0;
+    while (offset < splices_bytes) {
+        struct BSKY_AgendaPatchSplice splice;
+        if (offset + sizeof(splice) > splices_bytes) {
+            return -1;
+        }
+        memcpy(&splice, splices + offset, sizeof(splice));
+        offset += sizeof(splice)
+            + splice.insert_count * sizeof(struct BSKY_AgendaEvent);
+        if (offset > splices_bytes
+                || splice.index + splice.remove_count > events_length) {
+            return -1;
+        }
+        events_length += splice.insert_count - splice.remove_count;
+        if (events_length > events_capacity) {
+            return -1;
+        }
+    }
+    return events_length;
+}
+
+// Apply splices already checked by bsky_agenda_check_patch.
+//
+static void bsky_agenda_apply_patch(
+        const uint8_t * splices,
+        size_t splices_bytes,
+        struct BSKY_AgendaEvent * events,
+        int32_t events_length) {
+    size_t offset = 0;
+    while (offset < splices_bytes) {
+        struct BSKY_AgendaPatchSplice splice;
+        memcpy(&splice, splices + offset, sizeof(splice));
+        offset += sizeof(splice);
+        const int32_t tail = splice.index + splice.remove_count;
+        memmove(&events[splice.index + splice.insert_count],
+                &events[tail],
+                (events_length - tail) * sizeof(events[0]));
+        memcpy(&events[splice.index],
+                splices + offset,
+                splice.insert_count * sizeof(events[0]));
+        offset += splice.insert_count * sizeof(events[0]);
+        events_length += splice.insert_count - splice.remove_count;
+    }
+}
+
+// Patch the received agenda in place, or ask for the whole agenda if the
+// patch doesn't apply.  The patched agenda is persisted and reloaded just as
+// though it had been received whole.
+//
+// Matches function type BSKY_DataReceiver.
+//
+static void bsky_agenda_receive_patch(void * context) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_agenda_receive_patch");
+    size_t patch_bytes;
+    const uint8_t * patch = bsky_data_ptr(BSKY_DATAKEY_AGENDA_PATCH, &patch_bytes);
+    if (!patch || patch_bytes < sizeof(struct BSKY_AgendaPatchHeader)) {
+        return;
+    }
+    struct BSKY_AgendaPatchHeader header;
+    memcpy(&header, patch, sizeof(header));
+    const uint8_t * splices = patch + sizeof(header);
+    const size_t splices_bytes = patch_bytes - sizeof(header);
+
+    const int32_t version = bsky_data_int(BSKY_DATAKEY_AGENDA_VERSION);
+    size_t events_bytes;
+    struct BSKY_AgendaEvent * events
+        = bsky_data_edit(BSKY_DATAKEY_AGENDA, &events_bytes);
+    const int32_t events_length = events_bytes / sizeof(events[0]);
+    const int32_t patched_length
+        = !events || !version || header.base_version != version
+        ? -1
+        : bsky_agenda_check_patch(
+                splices,
+                splices_bytes,
+                events_length,
+                bsky_data_capacity(BSKY_DATAKEY_AGENDA) / sizeof(events[0]));
+    if (patched_length < 0) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_agenda_receive_patch: can't patch %ld from %ld,"
+                " asking for the whole agenda",
+                version,
+                header.base_version);
+        bsky_agenda_set_request(time(NULL));
+        bsky_data_send_outgoing();
+        return;
+    }
+
+    // Don't request another update for at least a few hours.
+    s_next_attempt_update = time(NULL) + 6*60*60;
+
+    // An empty patch to the same version just confirms the watch is up to
+    // date.
+    if (splices_bytes > 0 || header.version != version) {
+        bsky_agenda_apply_patch(splices, splices_bytes, events, events_length);
+        bsky_data_commit(
+                BSKY_DATAKEY_AGENDA,
+                patched_length * sizeof(events[0]));
+        bsky_data_commit_int(BSKY_DATAKEY_AGENDA_VERSION, header.version);
+    }
 }
 
 // Update static state according to received data.
@@ -120,38 +534,253 @@ static void bsky_agenda_receive_data(void * context) {
     bsky_agenda_reload(context);
 }
 
-static struct BSKY_Agenda s_agenda;
-
-const struct BSKY_Agenda * bsky_agenda_read () {
+const struct BSKY_Agenda * bsky_agenda_read (time_t now) {
     // Take this opportunity to trigger an update?
-    time_t now = time(NULL);
     if (now >= s_next_attempt_update) {
         APP_LOG(APP_LOG_LEVEL_DEBUG,
                 "bsky_agenda_read: update-hungry for at least %ld seconds",
                 now-s_next_attempt_update);
         s_next_attempt_update = now + 30;
-        bsky_data_set_outgoing_int(BSKY_DATAKEY_AGENDA_NEED_SECONDS, 24*60*60);
-        bsky_data_set_outgoing_int(BSKY_DATAKEY_AGENDA_CAPACITY_BYTES, 1024);
-        bsky_data_set_outgoing_int(BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME, now);
+        bsky_agenda_set_request(now);
         //bsky_data_send_outgoing();
     }
     return &s_agenda;
 }
 
+void bsky_agenda_find(
+        const struct BSKY_Agenda * agenda,
+        int32_t first_minute,
+        int32_t last_minute,
+        int32_t * begin,
+        int32_t * end) {
+    // Nothing that starts this early can still be going at first_minute.
+    const int32_t bounds [2] = {
+        first_minute - agenda->duration_max + 1,
+        last_minute + 1,
+    };
+    int32_t * const results [2] = { begin, end };
+    for (int b=0; b<2; ++b) {
+        // The first instance that starts at or after the bound.
+        int32_t low = 0;
+        int32_t high = agenda->instances_length;
+        while (low < high) {
+            const int32_t middle = low + (high - low) / 2;
+            if (agenda->starts[middle] < bounds[b]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        *results[b] = low;
+    }
+}
+
+const struct BSKY_AgendaMoment * bsky_agenda_moment(time_t time) {
+    if (s_moment_valid && s_moment.time == time) {
+        return &s_moment;
+    }
+    const struct BSKY_Agenda * agenda = &s_agenda;
+
+    // Instances start and end on whole minutes, so one that starts at or
+    // before this minute has started, and one that ends after it hasn't
+    // ended.
+    int32_t minute = (time - agenda->epoch) / SECONDS_PER_MINUTE;
+    if (time < agenda->epoch && (time - agenda->epoch) % SECONDS_PER_MINUTE) {
+        minute -= 1;
+    }
+    int32_t begin;
+    int32_t end;
+    bsky_agenda_find(agenda, minute, minute, &begin, &end);
+
+    int32_t current_count = 0;
+    int32_t free_minute = minute;
+    for (int32_t i=begin; i<end; ++i) {
+        const int32_t instance_end = agenda->starts[i] + agenda->durations[i];
+        if (instance_end > minute) {
+            current_count += 1;
+            if (instance_end > free_minute) {
+                free_minute = instance_end;
+            }
+        }
+    }
+    // Back-to-back instances keep the stretch going.
+    for (int32_t i=end;
+            current_count
+            && i<agenda->instances_length
+            && agenda->starts[i] <= free_minute;
+            ++i) {
+        const int32_t instance_end = agenda->starts[i] + agenda->durations[i];
+        if (instance_end > free_minute) {
+            free_minute = instance_end;
+        }
+    }
+
+    s_moment = (struct BSKY_AgendaMoment) {
+        .time = time,
+        .current_count = current_count,
+        .free_at = current_count
+            ? agenda->epoch + free_minute * SECONDS_PER_MINUTE
+            : time,
+        .next_start = end < agenda->instances_length
+            ? agenda->epoch + agenda->starts[end] * SECONDS_PER_MINUTE
+            : 0,
+    };
+    s_moment_valid = true;
+    return &s_moment;
+}
+
+const struct BSKY_AgendaBins * bsky_agenda_bins(
+        int32_t first_minute,
+        int32_t last_minute) {
+    const int32_t span_minutes = BSKY_AGENDA_BINS_MAX * BSKY_AGENDA_BIN_MINUTES;
+    if (s_bins_valid
+            && first_minute >= s_bins.first_minute
+            && last_minute < s_bins.first_minute + span_minutes) {
+        return &s_bins;
+    }
+    // Start on a whole bin, rounding down even before the epoch.
+    const int32_t bins_first_minute = first_minute
+        - ((first_minute % BSKY_AGENDA_BIN_MINUTES) + BSKY_AGENDA_BIN_MINUTES)
+        % BSKY_AGENDA_BIN_MINUTES;
+    if (last_minute >= bins_first_minute + span_minutes) {
+        return NULL;
+    }
+    if (!s_bins_buffer) {
+        s_bins_buffer = malloc(
+                BSKY_AGENDA_BINS_MAX * (sizeof(uint16_t) + sizeof(uint8_t)));
+        if (!s_bins_buffer) {
+            APP_LOG(APP_LOG_LEVEL_ERROR, "bsky_agenda_bins: malloc failed");
+            return NULL;
+        }
+    }
+    uint16_t * peak_durations = s_bins_buffer;
+    uint8_t * counts = (uint8_t *)(peak_durations + BSKY_AGENDA_BINS_MAX);
+    memset(s_bins_buffer,
+            0,
+            BSKY_AGENDA_BINS_MAX * (sizeof(uint16_t) + sizeof(uint8_t)));
+
+    const struct BSKY_Agenda * agenda = &s_agenda;
+    int32_t begin;
+    int32_t end;
+    bsky_agenda_find(
+            agenda,
+            bins_first_minute,
+            bins_first_minute + span_minutes - 1,
+            &begin,
+            &end);
+    for (int32_t i=begin; i<end; ++i) {
+        const int32_t start = agenda->starts[i] - bins_first_minute;
+        const int32_t last = start + agenda->durations[i] - 1;
+        if (last < 0) {
+            continue;
+        }
+        const int32_t first_bin
+            = start < 0 ? 0 : start / BSKY_AGENDA_BIN_MINUTES;
+        const int32_t last_bin = last / BSKY_AGENDA_BIN_MINUTES;
+        for (int32_t bin=first_bin;
+                bin<=last_bin && bin<BSKY_AGENDA_BINS_MAX;
+                ++bin) {
+            if (peak_durations[bin] < agenda->durations[i]) {
+                peak_durations[bin] = agenda->durations[i];
+            }
+            if (counts[bin] < UINT8_MAX) {
+                counts[bin] += 1;
+            }
+        }
+    }
+
+    s_bins = (struct BSKY_AgendaBins) {
+        .first_minute = bins_first_minute,
+        .length = BSKY_AGENDA_BINS_MAX,
+        .peak_durations = peak_durations,
+        .counts = counts,
+    };
+    s_bins_valid = true;
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "bsky_agenda_bins: binned %ld instances from minute %ld",
+            end - begin,
+            bins_first_minute);
+    return &s_bins;
+}
+
+void bsky_agenda_angles(
+        const int16_t * restrict starts,
+        const uint16_t * restrict durations,
+        int32_t length,
+        const struct BSKY_AgendaAngleMap * map,
+        int32_t * restrict start_angles,
+        int32_t * restrict end_angles) {
+    // Copied out of map so that they stay in registers through the loop, and
+    // so that the loop has no branches to stop a host compiler vectorizing it.
+    const int32_t first = map->first_minute;
+    const int32_t last = map->last_minute;
+    const int32_t origin = map->origin_minute;
+    const int32_t origin_angle = map->origin_angle;
+    const int32_t per_minute = map->angle_per_minute_q;
+    for (int32_t i=0; i<length; ++i) {
+        int32_t start = starts[i];
+        int32_t end = start + durations[i];
+        start = start < first ? first : start > last ? last : start;
+        end = end < first ? first : end > last ? last : end;
+        start_angles[i]
+            = origin_angle
+            + (((start - origin) * per_minute) >> BSKY_AGENDA_ANGLE_Q);
+        end_angles[i]
+            = origin_angle
+            + (((end - origin) * per_minute) >> BSKY_AGENDA_ANGLE_Q);
+    }
+}
+
+void bsky_agenda_subscribe (BSKY_AgendaReceiver receiver, void * context) {
+    for (size_t i=0; i<sizeof(s_receivers)/sizeof(s_receivers[0]); ++i) {
+        if (!s_receivers[i].receiver) {
+            s_receivers[i].receiver = receiver;
+            s_receivers[i].context = context;
+            return;
+        }
+    }
+    APP_LOG(APP_LOG_LEVEL_ERROR,
+            "bsky_agenda_subscribe: no room for %p",
+            context);
+}
+
+void bsky_agenda_unsubscribe (BSKY_AgendaReceiver receiver, void * context) {
+    for (size_t i=0; i<sizeof(s_receivers)/sizeof(s_receivers[0]); ++i) {
+        if (s_receivers[i].receiver == receiver
+                && s_receivers[i].context == context) {
+            s_receivers[i].receiver = NULL;
+            s_receivers[i].context = NULL;
+        }
+    }
+}
+
 void bsky_agenda_init () {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_agenda_init()");
+    app_worker_message_subscribe(bsky_agenda_worker_message);
     bsky_agenda_reload(&s_agenda);
     bsky_data_subscribe(
             bsky_agenda_receive_data,
             &s_agenda,
             BSKY_DATAKEY_AGENDA);
+    bsky_data_subscribe(
+            bsky_agenda_receive_patch,
+            &s_agenda,
+            BSKY_DATAKEY_AGENDA_PATCH);
 }
 
 void bsky_agenda_deinit () {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_agenda_deinit()");
     bsky_data_unsubscribe(bsky_agenda_receive_data, &s_agenda);
-    if (s_agenda.events_by_height) {
-        free (s_agenda.events_by_height);
-        s_agenda.events_by_height = NULL;
-    }
+    bsky_data_unsubscribe(bsky_agenda_receive_patch, &s_agenda);
+    app_worker_message_unsubscribe();
+    bsky_agenda_cancel_worker();
+    s_agenda.starts = NULL;
+    s_agenda.durations = NULL;
+    s_agenda.instances_length = 0;
+    free(s_instances);
+    s_instances = NULL;
+    s_moment_valid = false;
+    free(s_bins_buffer);
+    s_bins_buffer = NULL;
+    s_bins_valid = false;
 }
@@ -17,23 +17,236 @@
 
 // Start and end times for an event as minutes relative to a custom epoch.
 //
+// A record whose rel_start is within BSKY_AGENDA_REPEAT_MAX of
+// BSKY_AGENDA_REPEAT_MARK is not an event but marks the event just before it
+// as repeating: rel_start - BSKY_AGENDA_REPEAT_MARK + 1 more times, every
+// rel_end minutes.  See bsky_agenda_event_instances.  The phone only sends
+// these to watches advertising BSKY_DATA_AGENDA_FORMAT_REPEATS.
+//
 struct BSKY_AgendaEvent {
     int16_t rel_start;
     int16_t rel_end;
 };
 
+#define BSKY_AGENDA_REPEAT_MARK INT16_MIN
+#define BSKY_AGENDA_REPEAT_MAX 256
+
 // TODO: Hide this struct, which is only allocated once and statically anyway.
 //       Provide functions to retrieve its values separately.
+//
+// Every instance of every event in the snapshot, expanded and sorted by start,
+// as two parallel arrays so that the renderer can convert a whole visible
+// range at once with bsky_agenda_angles.  Instances are in minutes relative to
+// epoch, as in struct BSKY_AgendaEvent, and none of them are empty.  See
+// snapshot.h for how they were chosen.
+//
 struct BSKY_Agenda {
-    const struct BSKY_AgendaEvent * events;
-    int32_t events_length;
+    const int16_t * starts;
+    const uint16_t * durations;
+    int32_t instances_length;
+    // The longest of durations, which bounds how far before a time the
+    // instances overlapping it can start.
+    int32_t duration_max;
     int32_t epoch;
-    struct tm epoch_wall_time;
-    int16_t * events_by_height;
+    int32_t version;
 };
 
+// Most instances kept once repeating events are expanded.  Far more than any
+// real day's agenda, but a few runs of tightly repeating events could expand
+// to more than would fit on the heap, so past this only the earliest are kept.
+//
+#define BSKY_AGENDA_INSTANCES_MAX 512
+
+// How bsky_agenda_angles maps minutes relative to the agenda epoch onto the
+// face: clamped to [first_minute, last_minute], then
+//
+//     origin_angle + (minute - origin_minute) * angle_per_minute_q
+//         >> BSKY_AGENDA_ANGLE_Q
+//
+// so that the conversion needs no division per instance.  With
+// BSKY_AGENDA_ANGLE_Q at 10 the products stay within 32 bits as long as
+// origin_minute is no more than a day before first_minute and the face shows
+// at least an hour.
+//
+#define BSKY_AGENDA_ANGLE_Q 10
+
+struct BSKY_AgendaAngleMap {
+    int32_t first_minute;
+    int32_t last_minute;
+    int32_t origin_minute;
+    int32_t origin_angle;
+    int32_t angle_per_minute_q;
+};
+
+// Convert a single minute, as bsky_agenda_angles does.
+//
+static inline int32_t bsky_agenda_angle(
+        const struct BSKY_AgendaAngleMap * map,
+        int32_t minute) {
+    minute = minute < map->first_minute ? map->first_minute
+        : minute > map->last_minute ? map->last_minute
+        : minute;
+    return map->origin_angle
+        + (((minute - map->origin_minute) * map->angle_per_minute_q)
+           >> BSKY_AGENDA_ANGLE_Q);
+}
+
+// Find the instances that overlap minutes [first_minute, last_minute]
+// relative to the agenda epoch: that is, that end after first_minute and
+// start no later than last_minute.
+//
+// Instances in [*begin, *end) may still end too soon, at most
+// agenda->duration_max minutes before first_minute; check durations while
+// drawing.
+//
+void bsky_agenda_find(
+        const struct BSKY_Agenda * agenda,
+        int32_t first_minute,
+        int32_t last_minute,
+        int32_t * begin,
+        int32_t * end);
+
+// The agenda as it stands at a moment, see bsky_agenda_moment.
+//
+struct BSKY_AgendaMoment {
+
+    // The moment described.
+    //
+    time_t time;
+
+    // Instances in progress at time.
+    //
+    int32_t current_count;
+
+    // When the instances in progress, and any that follow on from them
+    // without a gap, are over; time itself if none are in progress.
+    //
+    time_t free_at;
+
+    // The start of the first instance after time, or 0 if there is none.
+    // While nothing is in progress, this is when free time ends.
+    //
+    time_t next_start;
+};
+
+// Describe the agenda at a moment, which should come from the current tick.
+//
+// Each query is a binary search of the instances sorted by start, plus a scan
+// of those that overlap the moment.  The last answer is kept until the moment
+// or the agenda changes, so every layer can ask on every tick.
+//
+const struct BSKY_AgendaMoment * bsky_agenda_moment(time_t time);
+
+// Instances binned by time, for drawing crowded stretches of the agenda at
+// the face's resolution rather than event by event.  See bsky_agenda_bins.
+//
+struct BSKY_AgendaBins {
+
+    // Bin i covers BSKY_AGENDA_BIN_MINUTES minutes from
+    // first_minute + i * BSKY_AGENDA_BIN_MINUTES, relative to the agenda
+    // epoch.
+    //
+    int32_t first_minute;
+    int32_t length;
+
+    // The longest instance overlapping each bin, in minutes, or 0 if none.
+    //
+    const uint16_t * peak_durations;
+
+    // How many instances overlap each bin, saturating at UINT8_MAX.
+    //
+    const uint8_t * counts;
+};
+
+// A little under a pixel at the edge of a 180 pixel face showing 24 hours,
+// and about one and a half at 12 hours.
+//
+#define BSKY_AGENDA_BIN_MINUTES 2
+
+// Bins cover this long from where they start, so that a 24 hour face can be
+// drawn from them for six hours before they need building again.
+//
+#define BSKY_AGENDA_BINS_MAX (30 * MINUTES_PER_HOUR / BSKY_AGENDA_BIN_MINUTES)
+
+// Get bins covering at least minutes [first_minute, last_minute] relative to
+// the agenda epoch.
+//
+// Bins are built on the first call after the agenda changes, and again only
+// when a call asks for minutes they don't cover, so this is cheap to call on
+// every render.
+//
+// Returns: the bins, or NULL if the span is too long or there's no room.
+//
+const struct BSKY_AgendaBins * bsky_agenda_bins(
+        int32_t first_minute,
+        int32_t last_minute);
+
+// Convert the start and end of length instances to angles on the face.
+//
+// starts, durations: the first instance to convert in each of the agenda's
+// arrays.
+// start_angles, end_angles: where length angles each will be written.
+//
+void bsky_agenda_angles(
+        const int16_t * starts,
+        const uint16_t * durations,
+        int32_t length,
+        const struct BSKY_AgendaAngleMap * map,
+        int32_t * start_angles,
+        int32_t * end_angles);
+
+// Whether a record marks the event before it as repeating, rather than being
+// an event itself.
+//
+static inline bool bsky_agenda_is_repeat(const struct BSKY_AgendaEvent * event) {
+    return event->rel_start < BSKY_AGENDA_REPEAT_MARK + BSKY_AGENDA_REPEAT_MAX;
+}
+
+// Count the instances of an event, without expanding them.
+//
+// events, events_length: a sequence of agenda records.
+// ievent: index of an event, not a repeat record.
+// stride_minutes: the address where the time between the starts of
+// consecutive instances will be written, or zero if there is only one.
+//
+// Returns: the number of instances, at least 1.  Instance k runs from
+// rel_start + k * stride_minutes to rel_end + k * stride_minutes.
+//
+static inline int32_t bsky_agenda_event_instances (
+        const struct BSKY_AgendaEvent * events,
+        int32_t events_length,
+        int32_t ievent,
+        int32_t * stride_minutes) {
+    const int32_t inext = ievent + 1;
+    if (inext < events_length
+            && bsky_agenda_is_repeat(&events[inext])
+            && events[inext].rel_end > 0) {
+        *stride_minutes = events[inext].rel_end;
+        return events[inext].rel_start - BSKY_AGENDA_REPEAT_MARK + 2;
+    }
+    *stride_minutes = 0;
+    return 1;
+}
+
 void bsky_agenda_init ();
 
 void bsky_agenda_deinit ();
 
-const struct BSKY_Agenda * bsky_agenda_read ();
+// Function type for agenda update subscriber callback functions.
+//
+typedef void (*BSKY_AgendaReceiver) (void * context);
+
+// Be called back whenever a new agenda is ready to draw.  There is room for a
+// few subscribers at once; any more are logged as errors and never called.
+//
+void bsky_agenda_subscribe (BSKY_AgendaReceiver receiver, void * context);
+
+// Has no effect unless bsky_agenda_subscribe was called with the same
+// receiver and context.
+//
+void bsky_agenda_unsubscribe (BSKY_AgendaReceiver receiver, void * context);
+
+// Get the agenda as of the given time, which should come from the current
+// tick rather than a fresh call to time().
+//
+const struct BSKY_Agenda * bsky_agenda_read (time_t now);
@@ -0,0 +1,567 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "clock_layer.h"
+#include "palette.h"
+#include "tick.h"
+
+// Every glyph the clock can show, as indices into the atlas.  Digits come
+// in two fonts, one for each line.
+//
+enum {
+    BSKY_CLOCK_GLYPH_TIME_DIGIT = 0,
+    BSKY_CLOCK_GLYPH_TIME_COLON = BSKY_CLOCK_GLYPH_TIME_DIGIT + 10,
+    BSKY_CLOCK_GLYPH_DATE_DIGIT,
+    BSKY_CLOCK_GLYPH_DATE_SPACE = BSKY_CLOCK_GLYPH_DATE_DIGIT + 10,
+    BSKY_CLOCK_GLYPH_WEEKDAY,
+    BSKY_CLOCK_GLYPH_MAX = BSKY_CLOCK_GLYPH_WEEKDAY + 7,
+};
+
+// The lines of the clock, each in its own font.
+//
+enum {
+    BSKY_CLOCK_LINE_TIME,
+    BSKY_CLOCK_LINE_DATE,
+    BSKY_CLOCK_LINE_MAX,
+};
+
+// Most glyphs on a line: "12:45" or "Wed 05".
+//
+#define BSKY_CLOCK_LINE_MAX_GLYPHS 5
+
+// One entry in the atlas.
+//
+struct BSKY_ClockGlyph {
+
+    // What the glyph shows, as text in its line's font.
+    //
+    char text[4];
+
+    // Whether the glyph has been cut from the frame buffer.  Until it has,
+    // it is drawn as text.
+    //
+    bool cached;
+
+    // The glyph's ink, or NULL if it has none.  Only the rows between the
+    // first and last with any ink are kept, starting top rows down from the
+    // top of the line.
+    //
+    GBitmap * bitmap;
+    int16_t top;
+
+    // How far the glyph advances along its line.
+    //
+    int16_t width;
+};
+
+// One line of the clock, and the glyphs it currently shows.
+//
+struct BSKY_ClockLine {
+    GFont font;
+    GColor color;
+    GRect box;
+    uint8_t length;
+    uint8_t glyphs[BSKY_CLOCK_LINE_MAX_GLYPHS];
+    int16_t xs[BSKY_CLOCK_LINE_MAX_GLYPHS];
+};
+
+// Custom state per clock layer.
+//
+typedef struct {
+    struct BSKY_ClockGlyph glyphs[BSKY_CLOCK_GLYPH_MAX];
+    struct BSKY_ClockLine lines[BSKY_CLOCK_LINE_MAX];
+
+    // Whether building the atlas has been attempted.  It is only attempted
+    // once: glyphs that could not be cached are drawn as text for good.
+    //
+    bool atlas_attempted;
+} BSKY_ClockLayerData;
+
+// Glyphs are rendered against the white cloud the clock is drawn over, see
+// sky_layer.c, so that their anti-aliased edges blend with what will really
+// be under them.  Pixels of exactly this color are left transparent.
+//
+#define BSKY_CLOCK_BACKGROUND (GColorWhite)
+
+static uint8_t bsky_clock_glyph_line(uint8_t glyph) {
+    return glyph < BSKY_CLOCK_GLYPH_DATE_DIGIT
+        ? BSKY_CLOCK_LINE_TIME
+        : BSKY_CLOCK_LINE_DATE;
+}
+
+// How far apart two colors are, channel by channel.
+//
+static int32_t bsky_clock_color_distance(GColor a, GColor b) {
+    int32_t distance = 0;
+    for (int32_t shift = 0; shift < 6; shift += 2) {
+        distance += abs(((a.argb >> shift) & 3) - ((b.argb >> shift) & 3));
+    }
+    return distance;
+}
+
+// Copy a rect of pixels out of an 8-bit frame buffer, or back into it.
+//
+// pixels: rect.size.w by rect.size.h, row by row.
+//
+static void bsky_clock_copy_pixels(
+        GBitmap * frame,
+        GRect rect,
+        uint8_t * pixels,
+        bool restore) {
+    for (int16_t y = 0; y < rect.size.h; ++y) {
+        const GBitmapDataRowInfo row
+            = gbitmap_get_data_row_info(frame, rect.origin.y + y);
+        for (int16_t x = 0; x < rect.size.w; ++x) {
+            const int16_t frame_x = rect.origin.x + x;
+            if (frame_x < row.min_x || row.max_x < frame_x) {
+                continue;
+            }
+            if (restore) {
+                row.data[frame_x] = pixels[y * rect.size.w + x];
+            } else {
+                pixels[y * rect.size.w + x] = row.data[frame_x];
+            }
+        }
+    }
+}
+
+// Cut a glyph, just rendered into rect, out of the frame buffer.
+//
+// The glyph is kept as a 2-bit palettized bitmap: transparent, plus the text
+// color and the two shades anti-aliasing blends it with.  Should a font ever
+// use more shades than that, the rest take the nearest.
+//
+static void bsky_clock_glyph_cut(
+        struct BSKY_ClockGlyph * glyph,
+        GBitmap * frame,
+        GRect rect) {
+    GColor palette[4] = { GColorClear };
+    int32_t palette_length = 1;
+    int16_t top = rect.size.h;
+    int16_t bottom = 0;
+    for (int16_t y = 0; y < rect.size.h; ++y) {
+        const GBitmapDataRowInfo row
+            = gbitmap_get_data_row_info(frame, rect.origin.y + y);
+        for (int16_t x = rect.origin.x; x < rect.origin.x + rect.size.w; ++x) {
+            if (x < row.min_x || row.max_x < x
+                    || row.data[x] == BSKY_CLOCK_BACKGROUND.argb) {
+                continue;
+            }
+            top = y < top ? y : top;
+            bottom = y + 1;
+            bool known = false;
+            for (int32_t i = 1; i < palette_length; ++i) {
+                known = known || palette[i].argb == row.data[x];
+            }
+            if (!known && palette_length < 4) {
+                palette[palette_length++].argb = row.data[x];
+            }
+        }
+    }
+
+    glyph->cached = true;
+    glyph->bitmap = NULL;
+    glyph->top = 0;
+    if (bottom <= top) {
+        // Nothing to draw, such as a space.
+        return;
+    }
+
+    GBitmap * bitmap = gbitmap_create_blank(
+            GSize(rect.size.w, bottom - top),
+            GBitmapFormat2BitPalette);
+    if (!bitmap) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_clock_glyph_cut: out of memory, drawing '%s' as text",
+                glyph->text);
+        glyph->cached = false;
+        return;
+    }
+    memcpy(gbitmap_get_palette(bitmap), palette, sizeof(palette));
+    uint8_t * bits = gbitmap_get_data(bitmap);
+    const uint16_t bytes_per_row = gbitmap_get_bytes_per_row(bitmap);
+    for (int16_t y = top; y < bottom; ++y) {
+        const GBitmapDataRowInfo row
+            = gbitmap_get_data_row_info(frame, rect.origin.y + y);
+        for (int16_t x = 0; x < rect.size.w; ++x) {
+            const int16_t frame_x = rect.origin.x + x;
+            if (frame_x < row.min_x || row.max_x < frame_x
+                    || row.data[frame_x] == BSKY_CLOCK_BACKGROUND.argb) {
+                continue;
+            }
+            const GColor color = { .argb = row.data[frame_x] };
+            uint8_t index = 1;
+            for (int32_t i = 2; i < palette_length; ++i) {
+                if (bsky_clock_color_distance(color, palette[i])
+                        < bsky_clock_color_distance(color, palette[index])) {
+                    index = i;
+                }
+            }
+            // Leftmost pixel in the most significant bits.
+            bits[(y - top) * bytes_per_row + x / 4]
+                |= index << (6 - 2 * (x % 4));
+        }
+    }
+    glyph->bitmap = bitmap;
+    glyph->top = top;
+}
+
+// Render every glyph once and cut it out of the frame buffer, so that from
+// now on it can be copied instead of laid out.
+//
+// SDK 3 can't render into a bitmap of our own, so each glyph is rendered in
+// turn into a scratch rect in the middle of the frame being drawn, and what
+// was there is put back afterwards.
+//
+static void bsky_clock_layer_build_atlas(
+        Layer * layer,
+        GContext * ctx,
+        BSKY_ClockLayerData * data) {
+    data->atlas_attempted = true;
+
+    const GRect bounds = layer_get_bounds(layer);
+    const GPoint origin = layer_get_frame(layer).origin;
+    GSize scratch_size = GSize(0, 0);
+    for (int32_t i = 0; i < BSKY_CLOCK_GLYPH_MAX; ++i) {
+        const GRect box = data->lines[bsky_clock_glyph_line(i)].box;
+        if (data->glyphs[i].width > scratch_size.w) {
+            scratch_size.w = data->glyphs[i].width;
+        }
+        if (box.size.h > scratch_size.h) {
+            scratch_size.h = box.size.h;
+        }
+    }
+    const GRect scratch = GRect(
+            bounds.size.w / 2 - scratch_size.w / 2,
+            bounds.size.h / 2 - scratch_size.h / 2,
+            scratch_size.w,
+            scratch_size.h);
+    const GRect scratch_on_screen = GRect(
+            origin.x + scratch.origin.x,
+            origin.y + scratch.origin.y,
+            scratch.size.w,
+            scratch.size.h);
+
+    uint8_t * saved = malloc(scratch.size.w * scratch.size.h);
+    if (!saved) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_clock_layer_build_atlas: out of memory");
+        return;
+    }
+    GBitmap * frame = graphics_capture_frame_buffer(ctx);
+    if (!frame) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_clock_layer_build_atlas: no frame buffer");
+        free(saved);
+        return;
+    }
+    bsky_clock_copy_pixels(frame, scratch_on_screen, saved, false);
+    graphics_release_frame_buffer(ctx, frame);
+
+    for (int32_t i = 0; i < BSKY_CLOCK_GLYPH_MAX; ++i) {
+        struct BSKY_ClockGlyph * glyph = &data->glyphs[i];
+        const struct BSKY_ClockLine * line
+            = &data->lines[bsky_clock_glyph_line(i)];
+        graphics_context_set_fill_color(ctx, BSKY_CLOCK_BACKGROUND);
+        graphics_fill_rect(ctx, scratch, 0, GCornerNone);
+        graphics_context_set_text_color(ctx, line->color);
+        graphics_draw_text(
+                ctx,
+                glyph->text,
+                line->font,
+                GRect(scratch.origin.x,
+                    scratch.origin.y,
+                    glyph->width,
+                    line->box.size.h),
+                GTextOverflowModeFill,
+                GTextAlignmentLeft,
+                NULL);
+        frame = graphics_capture_frame_buffer(ctx);
+        if (!frame) {
+            break;
+        }
+        bsky_clock_glyph_cut(
+                glyph,
+                frame,
+                GRect(scratch_on_screen.origin.x,
+                    scratch_on_screen.origin.y,
+                    glyph->width,
+                    line->box.size.h));
+        graphics_release_frame_buffer(ctx, frame);
+    }
+
+    frame = graphics_capture_frame_buffer(ctx);
+    if (frame) {
+        bsky_clock_copy_pixels(frame, scratch_on_screen, saved, true);
+        graphics_release_frame_buffer(ctx, frame);
+    }
+    free(saved);
+}
+
+// Pebble Layer callback to do the rendering work.
+//
+// Unlike the sky layer, this doesn't log: it is drawn in every frame and
+// meant to cost next to nothing.
+//
+static void bsky_clock_layer_update(Layer * layer, GContext * ctx) {
+    BSKY_ClockLayerData * data = layer_get_data(layer);
+    if (!data->atlas_attempted) {
+        bsky_clock_layer_build_atlas(layer, ctx, data);
+    }
+
+    graphics_context_set_compositing_mode(ctx, GCompOpSet);
+    for (int32_t iline = 0; iline < BSKY_CLOCK_LINE_MAX; ++iline) {
+        const struct BSKY_ClockLine * line = &data->lines[iline];
+        graphics_context_set_text_color(ctx, line->color);
+        for (int32_t i = 0; i < line->length; ++i) {
+            const struct BSKY_ClockGlyph * glyph
+                = &data->glyphs[line->glyphs[i]];
+            if (glyph->bitmap) {
+                const GRect bitmap_bounds = gbitmap_get_bounds(glyph->bitmap);
+                graphics_draw_bitmap_in_rect(
+                        ctx,
+                        glyph->bitmap,
+                        GRect(line->xs[i],
+                            line->box.origin.y + glyph->top,
+                            bitmap_bounds.size.w,
+                            bitmap_bounds.size.h));
+            } else if (!glyph->cached) {
+                graphics_draw_text(
+                        ctx,
+                        glyph->text,
+                        line->font,
+                        GRect(line->xs[i],
+                            line->box.origin.y,
+                            glyph->width,
+                            line->box.size.h),
+                        GTextOverflowModeFill,
+                        GTextAlignmentLeft,
+                        NULL);
+            }
+        }
+    }
+    graphics_context_set_compositing_mode(ctx, GCompOpAssign);
+}
+
+// Work out which glyphs a line shows for the given time.
+//
+// Returns: the number of glyphs.
+//
+static uint8_t bsky_clock_time_glyphs(
+        const struct tm * wall_time,
+        uint8_t glyphs[BSKY_CLOCK_LINE_MAX_GLYPHS]) {
+    uint8_t length = 0;
+    const bool is_24h = clock_is_24h_style();
+    int32_t hour = wall_time->tm_hour;
+    if (!is_24h) {
+        hour = hour % 12 ? hour % 12 : 12;
+    }
+    // "%H:%M" or "%l:%M" without the leading space.
+    if (is_24h || hour >= 10) {
+        glyphs[length++] = BSKY_CLOCK_GLYPH_TIME_DIGIT + hour / 10;
+    }
+    glyphs[length++] = BSKY_CLOCK_GLYPH_TIME_DIGIT + hour % 10;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_TIME_COLON;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_TIME_DIGIT + wall_time->tm_min / 10;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_TIME_DIGIT + wall_time->tm_min % 10;
+    return length;
+}
+
+static uint8_t bsky_clock_date_glyphs(
+        const struct tm * wall_time,
+        uint8_t glyphs[BSKY_CLOCK_LINE_MAX_GLYPHS]) {
+    // "%a %d"
+    uint8_t length = 0;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_WEEKDAY + wall_time->tm_wday;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_DATE_SPACE;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_DATE_DIGIT + wall_time->tm_mday / 10;
+    glyphs[length++] = BSKY_CLOCK_GLYPH_DATE_DIGIT + wall_time->tm_mday % 10;
+    return length;
+}
+
+// Show new glyphs on a line, centered.
+//
+// Returns: whether anything changed.
+//
+static bool bsky_clock_line_set(
+        struct BSKY_ClockLine * line,
+        const struct BSKY_ClockGlyph * atlas,
+        const uint8_t * glyphs,
+        uint8_t length) {
+    if (length == line->length
+            && 0 == memcmp(glyphs, line->glyphs, length)) {
+        return false;
+    }
+    int16_t width = 0;
+    for (uint8_t i = 0; i < length; ++i) {
+        width += atlas[glyphs[i]].width;
+    }
+    int16_t x = line->box.origin.x + (line->box.size.w - width) / 2;
+    for (uint8_t i = 0; i < length; ++i) {
+        line->glyphs[i] = glyphs[i];
+        line->xs[i] = x;
+        x += atlas[glyphs[i]].width;
+    }
+    line->length = length;
+    return true;
+}
+
+// Fill in what each glyph shows and how wide it is.  Nothing is rendered
+// until the layer is first drawn.
+//
+static void bsky_clock_layer_measure(BSKY_ClockLayerData * data) {
+    for (int32_t i = 0; i < BSKY_CLOCK_GLYPH_MAX; ++i) {
+        char * text = data->glyphs[i].text;
+        if (i < BSKY_CLOCK_GLYPH_TIME_COLON) {
+            snprintf(text, sizeof(data->glyphs[i].text), "%d", (int) i);
+        } else if (i == BSKY_CLOCK_GLYPH_TIME_COLON) {
+            strcpy(text, ":");
+        } else if (i < BSKY_CLOCK_GLYPH_DATE_SPACE) {
+            snprintf(text,
+                    sizeof(data->glyphs[i].text),
+                    "%d",
+                    (int) (i - BSKY_CLOCK_GLYPH_DATE_DIGIT));
+        } else if (i == BSKY_CLOCK_GLYPH_DATE_SPACE) {
+            strcpy(text, " ");
+        } else {
+            const struct tm weekday = {
+                .tm_wday = i - BSKY_CLOCK_GLYPH_WEEKDAY,
+            };
+            if (0 == strftime(
+                        text, sizeof(data->glyphs[i].text), "%a", &weekday)) {
+                strcpy(text, "?");
+            }
+        }
+
+        const struct BSKY_ClockLine * line
+            = &data->lines[bsky_clock_glyph_line(i)];
+        data->glyphs[i].width = graphics_text_layout_get_content_size(
+                text,
+                line->font,
+                line->box,
+                GTextOverflowModeFill,
+                GTextAlignmentLeft).w;
+    }
+
+    // Trailing space doesn't count towards a layout's size, so measure the
+    // space between two digits instead.
+    const struct BSKY_ClockLine * date = &data->lines[BSKY_CLOCK_LINE_DATE];
+    data->glyphs[BSKY_CLOCK_GLYPH_DATE_SPACE].width
+        = graphics_text_layout_get_content_size(
+                "0 0",
+                date->font,
+                date->box,
+                GTextOverflowModeFill,
+                GTextAlignmentLeft).w
+        - 2 * data->glyphs[BSKY_CLOCK_GLYPH_DATE_DIGIT].width;
+}
+
+struct BSKY_ClockLayer {
+
+    // The real Pebble layer, of course.
+    //
+    Layer *layer;
+
+    // A conveniently typed pointer to custom state data, stored in the
+    // layer itself.
+    //
+    BSKY_ClockLayerData *data;
+};
+
+BSKY_ClockLayer * bsky_clock_layer_create(GRect frame) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "bsky_clock_layer_create({%d,%d,%d,%d})",
+            frame.origin.x,
+            frame.origin.y,
+            frame.size.w,
+            frame.size.h);
+    BSKY_ClockLayer *clock_layer = malloc(sizeof(*clock_layer));
+    if (clock_layer) {
+        // Allocate Pebble layer
+        clock_layer->layer = layer_create_with_data(
+                frame,
+                sizeof(BSKY_ClockLayerData));
+        if (!clock_layer->layer) {
+            APP_LOG(APP_LOG_LEVEL_ERROR,
+                    "bsky_clock_layer_create: out of memory at"
+                    " layer_create_with_data");
+            free(clock_layer);
+            clock_layer = NULL;
+        } else {
+            BSKY_ClockLayerData * data = layer_get_data(clock_layer->layer);
+            clock_layer->data = data;
+            memset(data, 0, sizeof(*data));
+            // Where the text layers this replaces used to be.
+            data->lines[BSKY_CLOCK_LINE_TIME] = (struct BSKY_ClockLine) {
+                .font = fonts_get_system_font(
+                        FONT_KEY_BITHAM_34_MEDIUM_NUMBERS),
+                .color = BSKY_PALETTE_SUN_DARK,
+                .box = GRect(0, frame.size.h/2-23, frame.size.w, 40),
+            };
+            data->lines[BSKY_CLOCK_LINE_DATE] = (struct BSKY_ClockLine) {
+                .font = fonts_get_system_font(FONT_KEY_ROBOTO_CONDENSED_21),
+                .color = GColorBlack,
+                .box = GRect(0, frame.size.h/2-38, frame.size.w, 26),
+            };
+            bsky_clock_layer_measure(data);
+            layer_set_update_proc(
+                    clock_layer->layer,
+                    bsky_clock_layer_update);
+        }
+    }
+    return clock_layer;
+}
+
+void bsky_clock_layer_destroy(BSKY_ClockLayer *clock_layer) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "bsky_clock_layer_destroy(%p)",
+            clock_layer);
+    for (int32_t i = 0; i < BSKY_CLOCK_GLYPH_MAX; ++i) {
+        if (clock_layer->data->glyphs[i].bitmap) {
+            gbitmap_destroy(clock_layer->data->glyphs[i].bitmap);
+        }
+    }
+    layer_destroy(clock_layer->layer);
+    clock_layer->layer = NULL;
+    clock_layer->data = NULL;
+    free(clock_layer);
+}
+
+Layer * bsky_clock_layer_get_layer(BSKY_ClockLayer *clock_layer) {
+    return clock_layer->layer;
+}
+
+void bsky_clock_layer_set_time(
+        BSKY_ClockLayer *clock_layer,
+        const struct BSKY_Tick * tick) {
+    BSKY_ClockLayerData * data = clock_layer->data;
+    uint8_t glyphs[BSKY_CLOCK_LINE_MAX_GLYPHS];
+    bool changed = bsky_clock_line_set(
+            &data->lines[BSKY_CLOCK_LINE_TIME],
+            data->glyphs,
+            glyphs,
+            bsky_clock_time_glyphs(&tick->wall_time, glyphs));
+    changed = bsky_clock_line_set(
+            &data->lines[BSKY_CLOCK_LINE_DATE],
+            data->glyphs,
+            glyphs,
+            bsky_clock_date_glyphs(&tick->wall_time, glyphs))
+        || changed;
+    if (changed) {
+        layer_mark_dirty(clock_layer->layer);
+    }
+}
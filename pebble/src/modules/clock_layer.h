@@ -0,0 +1,49 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "tick.h"
+
+// A clock layer, displaying the date and the time over the sky layer's cloud.
+//
+// Each glyph is rendered once, the first time the layer is drawn, and from
+// then on copied from a cache instead of laying out text every minute.  See
+// clock_layer.c.
+//
+typedef struct BSKY_ClockLayer BSKY_ClockLayer;
+
+// Create and return a new clock layer, or NULL.
+//
+// The layer is laid out to cover the whole window, and must be a child of
+// the window's root layer.
+//
+BSKY_ClockLayer * bsky_clock_layer_create(GRect frame);
+
+// Deallocate a non-NULL clock layer.
+//
+void bsky_clock_layer_destroy(BSKY_ClockLayer * clock_layer);
+
+// Get the managed Pebble layer.
+//
+Layer * bsky_clock_layer_get_layer(BSKY_ClockLayer * clock_layer);
+
+// Show the time and date of the given tick.
+//
+// The layer is only marked dirty if a glyph has changed.
+//
+void bsky_clock_layer_set_time(
+        BSKY_ClockLayer * clock_layer,
+        const struct BSKY_Tick * tick);
@@ -16,60 +16,44 @@
 #include <pebble.h>
 
 #include "data.h"
+#include "store.h"
+#include "telemetry.h"
+#include "trace.h"
 
-static const char * s_key_name [BSKY_DATAKEY_MAX] = {
-    [BSKY_DATAKEY_AGENDA_VERSION] = "BSKY_DATAKEY_AGENDA_VERSION",
-    [BSKY_DATAKEY_AGENDA_EPOCH] = "BSKY_DATAKEY_AGENDA_EPOCH",
-    [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = "BSKY_DATAKEY_AGENDA_NEED_SECONDS",
-    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = "BSKY_DATAKEY_AGENDA_CAPACITY_BYTES",
-    [BSKY_DATAKEY_AGENDA] = "BSKY_DATAKEY_AGENDA",
-    [BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME] = "BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME",
-    [BSKY_DATAKEY_FACE_HOURS] = "BSKY_DATAKEY_FACE_HOURS",
-    [BSKY_DATAKEY_FACE_ORIENTATION] = "BSKY_DATAKEY_FACE_ORIENTATION",
-};
-
-static const TupleType s_key_type [BSKY_DATAKEY_MAX] = {
-    [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = TUPLE_INT,
-    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = TUPLE_INT,
-    [BSKY_DATAKEY_AGENDA] = TUPLE_BYTE_ARRAY,
-    [BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME] = TUPLE_INT,
-    [BSKY_DATAKEY_AGENDA_VERSION] = TUPLE_INT,
-    [BSKY_DATAKEY_AGENDA_EPOCH] = TUPLE_INT,
-    [BSKY_DATAKEY_FACE_HOURS] = TUPLE_INT,
-    [BSKY_DATAKEY_FACE_ORIENTATION] = TUPLE_INT,
-};
+// The telemetry record goes out as a single BSKY_DATAKEY_TELEMETRY value.
+//
+_Static_assert(
+        BSKY_TELEMETRY_RECORD_BYTES <= BSKY_DATA_TELEMETRY_MAX_BYTES,
+        "telemetry record larger than data_keys.json allows");
 
-static const size_t s_key_size [BSKY_DATAKEY_MAX] = {
-    [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = sizeof(int32_t),
-    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = sizeof(int32_t),
-    [BSKY_DATAKEY_AGENDA] = 1024,
-    [BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME] = sizeof(int32_t),
-    [BSKY_DATAKEY_AGENDA_VERSION] = sizeof(int32_t),
-    [BSKY_DATAKEY_AGENDA_EPOCH] = sizeof(int32_t),
-    [BSKY_DATAKEY_FACE_HOURS] = sizeof(int32_t),
-    [BSKY_DATAKEY_FACE_ORIENTATION] = sizeof(int32_t),
-};
+// Limits on the size of the agenda buffer.
+//
+// The upper limit keeps the persisted agenda and its persisted snapshot
+// together within Pebble's 4 KB of persistent storage per app.  The lower
+// limit is small, but still better than nothing on a busy heap.
+//
+#define BSKY_DATA_AGENDA_MAX_BYTES 1536
+#define BSKY_DATA_AGENDA_MIN_BYTES 64
 
-static const bool s_key_incoming [BSKY_DATAKEY_MAX] = {
-    [BSKY_DATAKEY_AGENDA] = true,
-    [BSKY_DATAKEY_AGENDA_VERSION] = true,
-    [BSKY_DATAKEY_AGENDA_EPOCH] = true,
-    [BSKY_DATAKEY_FACE_HOURS] = true,
-    [BSKY_DATAKEY_FACE_ORIENTATION] = true,
-};
+// The agenda buffer holds whole records, each a pair of int16_t.
+//
+#define BSKY_DATA_AGENDA_RECORD_BYTES 4
 
-static const bool s_key_outgoing [BSKY_DATAKEY_MAX] = {
-    [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = true,
-    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = true,
-    [BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME] = true,
-    [BSKY_DATAKEY_FACE_HOURS] = true,
-    [BSKY_DATAKEY_FACE_ORIENTATION] = true,
-};
+_Static_assert(
+        BSKY_DATA_AGENDA_MAX_BYTES % BSKY_DATA_AGENDA_RECORD_BYTES == 0
+        && BSKY_DATA_AGENDA_MIN_BYTES % BSKY_DATA_AGENDA_RECORD_BYTES == 0,
+        "agenda buffer limits must be whole records");
 
-static uint8_t s_agenda_buffer [1024] = {0};
+// Allocated by bsky_data_init once the platform's limits are known.
+//
+static uint8_t * s_agenda_buffer = NULL;
+static size_t s_agenda_capacity = 0;
+static uint8_t s_telemetry_buffer [BSKY_DATA_TELEMETRY_MAX_BYTES] = {0};
+static uint8_t s_agenda_patch_buffer [BSKY_DATA_AGENDA_PATCH_MAX_BYTES] = {0};
+static uint8_t s_agenda_trace_buffer [BSKY_DATA_AGENDA_TRACE_MAX_BYTES] = {0};
 
 union BSKY_Value {
-    void * const ptr;
+    void * ptr;
     int32_t int32;
 };
 
@@ -78,10 +62,14 @@ union BSKY_Value {
 //
 static union BSKY_Value s_key_buffer [BSKY_DATAKEY_MAX] = {
     [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = {.int32=24*60*60},
-    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = {.int32=sizeof(s_agenda_buffer)},
-    [BSKY_DATAKEY_AGENDA] = {.ptr=s_agenda_buffer},
+    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = {.int32=0},
+    [BSKY_DATAKEY_AGENDA] = {.ptr=NULL},
     [BSKY_DATAKEY_FACE_HOURS] = {.int32=0},
     [BSKY_DATAKEY_FACE_ORIENTATION] = {.int32=0},
+    [BSKY_DATAKEY_RENDER_QUALITY] = {.int32=BSKY_DATA_RENDER_QUALITY_AUTO},
+    [BSKY_DATAKEY_TELEMETRY] = {.ptr=s_telemetry_buffer},
+    [BSKY_DATAKEY_AGENDA_PATCH] = {.ptr=s_agenda_patch_buffer},
+    [BSKY_DATAKEY_AGENDA_TRACE] = {.ptr=s_agenda_trace_buffer},
 };
 
 static bool s_key_buffer_initialized [BSKY_DATAKEY_MAX] = {0};
@@ -89,18 +77,66 @@ static bool s_key_buffer_initialized [BSKY_DATAKEY_MAX] = {0};
 // buffer_length is the number of bytes currently meaningful in each buffer.
 static size_t s_key_buffer_length [BSKY_DATAKEY_MAX] = {0};
 
-// Calculate the buffer size for an inbox or outbox.
+// The largest value a key can hold: fixed in data_keys.json for every key but
+// the agenda.
 //
-// filter: an array of BSKY_DATAKEY_MAX bool values.
+static size_t bsky_data_key_size(uint32_t key) {
+    return key == BSKY_DATAKEY_AGENDA
+        ? s_agenda_capacity
+        : bsky_data_keys[key].max_bytes;
+}
+
+// Choose the size of the agenda buffer and allocate it.
 //
-static size_t bsky_data_buffer_size(const bool * filter) {
-    size_t buffer_size = 1;
-    for (int key=0; key<BSKY_DATAKEY_MAX; ++key) {
-        if (filter[key] && s_key_size[key]) {
-            buffer_size += 7 + s_key_size[key];
+// The agenda arrives in a single message along with the other incoming keys,
+// so it gets whatever the platform's largest inbox leaves over after
+// BSKY_DATA_INBOX_BYTES, within the
+// BSKY_DATA_AGENDA_*_BYTES limits and a quarter of the free heap: the inbox
+// itself, this buffer and the agenda index all take about as much again.
+//
+// Returns true if and only if the buffer was allocated.
+//
+static bool bsky_data_size_agenda(void) {
+    if (s_agenda_buffer) { return true; }
+
+    const size_t others = BSKY_DATA_INBOX_BYTES;
+    const size_t inbox_max = app_message_inbox_size_maximum();
+    size_t capacity = inbox_max > others ? inbox_max - others : 0;
+    if (capacity > heap_bytes_free() / 4) {
+        capacity = heap_bytes_free() / 4;
+    }
+    if (capacity > BSKY_DATA_AGENDA_MAX_BYTES) {
+        capacity = BSKY_DATA_AGENDA_MAX_BYTES;
+    }
+    while (!s_agenda_buffer) {
+        // Whole records only, including after halving.
+        capacity -= capacity % BSKY_DATA_AGENDA_RECORD_BYTES;
+        if (capacity < BSKY_DATA_AGENDA_MIN_BYTES) {
+            break;
+        }
+        s_agenda_buffer = malloc(capacity);
+        if (!s_agenda_buffer) {
+            capacity /= 2;
         }
     }
-    return buffer_size;
+    if (!s_agenda_buffer) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_data_size_agenda: no room for an agenda buffer");
+        return false;
+    }
+
+    s_agenda_capacity = capacity;
+    s_key_buffer[BSKY_DATAKEY_AGENDA].ptr = s_agenda_buffer;
+    s_key_buffer[BSKY_DATAKEY_AGENDA_CAPACITY_BYTES].int32 = capacity;
+    s_key_buffer_initialized[BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = true;
+    s_key_buffer[BSKY_DATAKEY_AGENDA_FORMAT].int32
+        = BSKY_DATA_AGENDA_FORMAT_REPEATS;
+    s_key_buffer_initialized[BSKY_DATAKEY_AGENDA_FORMAT] = true;
+    APP_LOG(APP_LOG_LEVEL_INFO,
+            "bsky_data_size_agenda: %u bytes (inbox maximum %lu)",
+            capacity,
+            inbox_max);
+    return true;
 }
 
 // Notify all subscribers that are interested in keys associated with true
@@ -111,82 +147,170 @@ static size_t bsky_data_buffer_size(const bool * filter) {
 //
 static void bsky_data_notify (const bool * keys);
 
+// How long to wait after a message arrives before persisting its values and
+// notifying subscribers.  Messages that arrive within this window share a
+// single round of notifications, so a burst causes one reload and one redraw.
+//
+#define BSKY_DATA_NOTIFY_DELAY_MS 50
+
+// Keys received since subscribers were last notified.
+//
+static bool s_pending_keys [BSKY_DATAKEY_MAX];
+
+// Scheduled call to bsky_data_dispatch_pending, or NULL if nothing is pending.
+//
+static AppTimer * s_dispatch_timer;
+
+// Persist pending values and notify subscribers about them.
+//
+// Matches AppTimerCallback.  This is where all the potentially slow work
+// triggered by incoming messages happens, outside of the AppMessage inbox
+// callback so that the inbox can ACK promptly.
+//
+static void bsky_data_dispatch_pending(void * context) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_dispatch_pending");
+    s_dispatch_timer = NULL;
+
+    bool keys [BSKY_DATAKEY_MAX];
+    memcpy(keys, s_pending_keys, sizeof(keys));
+    memset(s_pending_keys, 0, sizeof(s_pending_keys));
+
+    // TODO: persist values through the Pebble Storage API only if they've
+    // been flagged for persistent storage.  Not all incoming data should be so
+    // stored.
+    for (uint32_t key=0; key<BSKY_DATAKEY_MAX; ++key) {
+        if (!keys[key]
+                || bsky_data_keys[key].flags & BSKY_DATAKEY_FLAG_TRANSIENT) {
+            continue;
+        }
+        switch (bsky_data_keys[key].type) {
+            case TUPLE_BYTE_ARRAY:
+            case TUPLE_CSTRING:
+                // Values larger than PERSIST_DATA_MAX_LENGTH can't be stored
+                // under a single persist key, so arrays go to the paged store.
+                // Drop any value left over from before the paged store.
+                bsky_store_write(
+                        key,
+                        s_key_buffer[key].ptr,
+                        s_key_buffer_length[key]);
+                if (persist_exists(key)) {
+                    persist_delete(key);
+                }
+                break;
+            case TUPLE_UINT:
+            case TUPLE_INT:
+                persist_write_int(key, s_key_buffer[key].int32);
+                break;
+        }
+    }
+    if (keys[BSKY_DATAKEY_AGENDA]) {
+        bsky_trace_mark(BSKY_TRACE_PERSISTED, 0);
+    }
+
+    bsky_data_notify (keys);
+}
+
+// Arrange for a key's value to be persisted and its subscribers notified.
+//
+static void bsky_data_mark_pending(uint32_t key) {
+    s_pending_keys[key] = true;
+    if (!s_dispatch_timer) {
+        s_dispatch_timer = app_timer_register(
+                BSKY_DATA_NOTIFY_DELAY_MS,
+                bsky_data_dispatch_pending,
+                NULL);
+    }
+}
+
 // Callback for the Pebble AppMessage API; receives messages from the remote
 // device.
 //
+// Only copies values into static buffers; persistence and notification are
+// deferred to bsky_data_dispatch_pending.
+// An agenda or patch also starts a latency trace, see trace.h.
+//
 static void bsky_data_in_received(DictionaryIterator *iterator, void *context) {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_in_received");
-    bool keys [BSKY_DATAKEY_MAX];
     Tuple * tuple = dict_read_first(iterator);
     while (tuple) {
         const uint32_t key = tuple->key;
-        if (key >= BSKY_DATAKEY_MAX) {
+        const struct BSKY_DataKeyInfo * const info
+            = key < BSKY_DATAKEY_MAX ? &bsky_data_keys[key] : NULL;
+        if (!info) {
             APP_LOG(APP_LOG_LEVEL_WARNING,
                     "bsky_data_in_received: ignoring unrecognized key %lu",
                     key);
-        } else if (!s_key_incoming[key]) {
+        } else if (!(info->flags & BSKY_DATAKEY_FLAG_INCOMING)) {
             APP_LOG(APP_LOG_LEVEL_WARNING,
                     "bsky_data_in_received:"
                     " ignoring key %s unexpected in inbox",
-                    s_key_name[key]);
-        } else if (tuple->type != s_key_type[key]) {
+                    info->name);
+        } else if (tuple->type != info->type) {
             APP_LOG(APP_LOG_LEVEL_WARNING,
                     "bsky_data_in_received:"
                     " ignoring bad value for key %s,"
                     " expected type %d, got %d",
-                    s_key_name[key],
-                    s_key_type[key],
+                    info->name,
+                    info->type,
                     tuple->type);
-        } else if (tuple->length > s_key_size[key]) {
+        } else if (tuple->length > bsky_data_key_size(key)) {
             APP_LOG(APP_LOG_LEVEL_WARNING,
                     "bsky_data_in_received:"
                     " ignoring oversized value for key %s,"
                     " expected max %u, got %d",
-                    s_key_name[key],
-                    s_key_size[key],
+                    info->name,
+                    bsky_data_key_size(key),
                     tuple->length);
         } else {
+            if (key == BSKY_DATAKEY_AGENDA || key == BSKY_DATAKEY_AGENDA_PATCH) {
+                bsky_trace_begin();
+            }
             // Copy incoming data to static buffers
-            //
-            // TODO: persist values through the Pebble Storage API only if
-            // they've been flagged for persistent storage.  Not all incoming
-            // data should be so stored.
             switch (tuple->type) {
                 case TUPLE_BYTE_ARRAY:
                 case TUPLE_CSTRING:
-                    persist_write_data (key, tuple->value->data, tuple->length);
                     memcpy (s_key_buffer[key].ptr, tuple->value->data, tuple->length);
                     s_key_buffer_length[key] = tuple->length;
                     s_key_buffer_initialized[key] = true;
                     APP_LOG(APP_LOG_LEVEL_INFO,
                             "bsky_data_in_received: %s (%d bytes)",
-                            s_key_name[key],
+                            info->name,
                             tuple->length);
                     break;
                 case TUPLE_UINT:
                 case TUPLE_INT:
-                    persist_write_int (key, tuple->value->int32);
                     s_key_buffer[key].int32 = tuple->value->int32;
                     s_key_buffer_initialized[key] = true;
                     APP_LOG(APP_LOG_LEVEL_INFO,
                             "bsky_data_in_received: %s = %ld",
-                            s_key_name[key],
+                            info->name,
                             tuple->value->int32);
                     break;
             }
-            keys[key] = true;
+            bsky_data_mark_pending(key);
         }
         tuple = dict_read_next(iterator);
     }
-    bsky_data_notify (keys);
 }
 
 // Callback for the Pebble AppMessage API.
 //
+// A message too large for the inbox means the phone has the wrong idea of the
+// agenda capacity, so tell it, but no more than once a minute.
+//
 static void bsky_data_in_dropped(AppMessageResult reason, void *context) {
     APP_LOG(APP_LOG_LEVEL_WARNING,
             "bsky_data_in_dropped: %d",
             reason);
+    bsky_telemetry_count(BSKY_TELEMETRY_INBOX_DROPPED);
+
+    static time_t s_last_advertised = 0;
+    const time_t now = time(NULL);
+    if (reason == APP_MSG_BUFFER_OVERFLOW
+            && now - s_last_advertised >= SECONDS_PER_MINUTE) {
+        s_last_advertised = now;
+        bsky_data_send_outgoing();
+    }
 }
 
 // Callback for the Pebble AppMessage API.
@@ -194,6 +318,7 @@ static void bsky_data_in_dropped(AppMessageResult reason, void *context) {
 static void bsky_data_out_sent(DictionaryIterator *iterator, void *context) {
     APP_LOG(APP_LOG_LEVEL_INFO,
             "bsky_data_out_sent: message to phone was acknowledged");
+    bsky_telemetry_sent();
     // TODO: remember that values flagged for sending have been sent
 }
 
@@ -201,6 +326,7 @@ static void bsky_data_out_sent(DictionaryIterator *iterator, void *context) {
 //
 static void bsky_data_out_failed(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
     APP_LOG(APP_LOG_LEVEL_WARNING, "bsky_data_out_failed: %d", reason);
+    bsky_telemetry_count(BSKY_TELEMETRY_OUTBOX_FAILED);
     // TODO: remember that values flagged for sending have not been sent
 }
 
@@ -214,9 +340,13 @@ bool bsky_data_init(void) {
     app_message_register_outbox_sent(bsky_data_out_sent);
     app_message_register_outbox_failed(bsky_data_out_failed);
 
+    if (!bsky_data_size_agenda()) {
+        return false;
+    }
+
     AppMessageResult result = app_message_open(
-            bsky_data_buffer_size(s_key_incoming),
-            bsky_data_buffer_size(s_key_outgoing));
+            BSKY_DATA_INBOX_BYTES + s_agenda_capacity,
+            BSKY_DATA_OUTBOX_BYTES);
     if (result != APP_MSG_OK) {
         APP_LOG(APP_LOG_LEVEL_ERROR, "app_message_open: %u", result);
         return false;
@@ -228,17 +358,30 @@ bool bsky_data_init(void) {
 }
 
 void bsky_data_deinit(void) {
+    // Don't lose values that arrived just before exit.
+    if (s_dispatch_timer) {
+        app_timer_cancel(s_dispatch_timer);
+        bsky_data_dispatch_pending(NULL);
+    }
     // TODO: remove all subscribers
+    if (s_agenda_buffer) {
+        free(s_agenda_buffer);
+        s_agenda_buffer = NULL;
+        s_key_buffer[BSKY_DATAKEY_AGENDA].ptr = NULL;
+        s_agenda_capacity = 0;
+    }
 }
 
-int32_t bsky_data_int(uint32_t key) {
-    const TupleType type = s_key_type[key];
+size_t bsky_data_capacity(uint32_t key) {
+    return key<BSKY_DATAKEY_MAX ? bsky_data_key_size(key) : 0;
+}
 
+int32_t bsky_data_int(uint32_t key) {
     // Filter out bad requests, this should never happen on non-developer
     // devices.
     bool ok = key<BSKY_DATAKEY_MAX
-        && type==TUPLE_INT
-        && s_key_size[key]==sizeof(int32_t);
+        && bsky_data_keys[key].type==TUPLE_INT
+        && bsky_data_keys[key].max_bytes==sizeof(int32_t);
     if (!ok) {
         APP_LOG(APP_LOG_LEVEL_ERROR,
                 "bsky_data_int: bad request for key %lu",
@@ -246,7 +389,7 @@ int32_t bsky_data_int(uint32_t key) {
         return 0;
     }
 
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_int: %s", s_key_name[key]);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_int: %s", bsky_data_keys[key].name);
     int32_t * const buffer = &s_key_buffer[key].int32;
 
     // If appropriate, attempt to fill the buffer from persistent storage.
@@ -261,24 +404,24 @@ int32_t bsky_data_int(uint32_t key) {
     if (!s_key_buffer_initialized[key]) {
         APP_LOG(APP_LOG_LEVEL_DEBUG,
                 "bsky_data_int: %s has no value",
-                s_key_name[key]);
+                bsky_data_keys[key].name);
         return 0;
     }
 
     APP_LOG(APP_LOG_LEVEL_DEBUG,
             "bsky_data_int: %s == %ld",
-            s_key_name[key],
+            bsky_data_keys[key].name,
             s_key_buffer[key].int32);
     return *buffer;
 }
 
 const void * bsky_data_ptr(uint32_t key, size_t * length_bytes) {
-    const TupleType type = s_key_type[key];
-
     // Filter out bad requests, this should never happen on non-developer
     // devices.
-    bool ok = key<BSKY_DATAKEY_MAX
-        && (type == TUPLE_BYTE_ARRAY || type == TUPLE_CSTRING)
+    const TupleType type = key<BSKY_DATAKEY_MAX
+        ? bsky_data_keys[key].type
+        : TUPLE_INT;
+    bool ok = (type == TUPLE_BYTE_ARRAY || type == TUPLE_CSTRING)
         && s_key_buffer[key].ptr;
     if (!ok) {
         APP_LOG(APP_LOG_LEVEL_ERROR,
@@ -288,48 +431,95 @@ const void * bsky_data_ptr(uint32_t key, size_t * length_bytes) {
         return NULL;
     }
 
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_ptr: %s", s_key_name[key]);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_data_ptr: %s", bsky_data_keys[key].name);
     void * const buffer = s_key_buffer[key].ptr;
 
     // If appropriate, attempt to fill the buffer from persistent storage.
+    // Pages are only read here, the first time the value is asked for.
     //
-    if (!s_key_buffer_initialized[key] && persist_exists(key)) {
+    if (!s_key_buffer_initialized[key]) {
         APP_LOG(APP_LOG_LEVEL_DEBUG,
                 "bsky_data_ptr: attempting load from local storage");
-        const size_t capacity = s_key_size[key];
-        const size_t available = persist_get_size(key);
-        if (available > capacity) {
-            APP_LOG(APP_LOG_LEVEL_WARNING,
-                    "bsky_data_ptr: local storage value is too large");
-        } else {
-            persist_read_data(key, buffer, available);
+        const size_t capacity = bsky_data_key_size(key);
+        size_t available = 0;
+        if (bsky_store_read(key, buffer, capacity, &available)) {
             s_key_buffer_initialized[key] = true;
             s_key_buffer_length[key] = available;
+        } else if (persist_exists(key)) {
+            // A value persisted before the paged store existed.
+            available = persist_get_size(key);
+            if (available > capacity) {
+                APP_LOG(APP_LOG_LEVEL_WARNING,
+                        "bsky_data_ptr: local storage value is too large");
+            } else {
+                persist_read_data(key, buffer, available);
+                s_key_buffer_initialized[key] = true;
+                s_key_buffer_length[key] = available;
+            }
         }
     }
 
     if (!s_key_buffer_initialized[key]) {
         APP_LOG(APP_LOG_LEVEL_DEBUG,
                 "bsky_data_ptr: %s has no value",
-                s_key_name[key]);
+                bsky_data_keys[key].name);
         *length_bytes = 0;
         return NULL;
     }
 
     APP_LOG(APP_LOG_LEVEL_DEBUG,
             "bsky_data_ptr: %s has value %u bytes long",
-            s_key_name[key],
+            bsky_data_keys[key].name,
             s_key_buffer_length[key]);
     *length_bytes = s_key_buffer_length[key];
     return buffer;
 }
 
+void * bsky_data_edit(uint32_t key, size_t * length_bytes) {
+    void * buffer = (void *) bsky_data_ptr(key, length_bytes);
+    if (!buffer && key<BSKY_DATAKEY_MAX && s_key_buffer[key].ptr
+            && bsky_data_keys[key].type == TUPLE_BYTE_ARRAY) {
+        buffer = s_key_buffer[key].ptr;
+        *length_bytes = 0;
+    }
+    return buffer;
+}
+
+void bsky_data_commit(uint32_t key, size_t length_bytes) {
+    if (key>=BSKY_DATAKEY_MAX
+            || !s_key_buffer[key].ptr
+            || length_bytes > bsky_data_key_size(key)) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_data_commit: bad request for key %lu (%u bytes)",
+                key,
+                length_bytes);
+        return;
+    }
+    s_key_buffer_length[key] = length_bytes;
+    s_key_buffer_initialized[key] = true;
+    bsky_data_mark_pending(key);
+}
+
+void bsky_data_commit_int(uint32_t key, int32_t value) {
+    if (key>=BSKY_DATAKEY_MAX || bsky_data_keys[key].type != TUPLE_INT) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_data_commit_int: bad request for key %lu",
+                key);
+        return;
+    }
+    s_key_buffer[key].int32 = value;
+    s_key_buffer_initialized[key] = true;
+    bsky_data_mark_pending(key);
+}
+
 void bsky_data_set_outgoing_int(uint32_t key, int32_t data) {
-    const TupleType type = s_key_type[key];
+    const TupleType type = key<BSKY_DATAKEY_MAX
+        ? bsky_data_keys[key].type
+        : TUPLE_BYTE_ARRAY;
     if (type != TUPLE_INT) {
         APP_LOG(APP_LOG_LEVEL_ERROR,
-                "%s type is %d, got %d",
-                s_key_name[key],
+                "bsky_data_set_outgoing_int: key %lu type is %d, got %d",
+                key,
                 type,
                 TUPLE_INT);
     } else {
@@ -338,6 +528,28 @@ void bsky_data_set_outgoing_int(uint32_t key, int32_t data) {
     }
 }
 
+void bsky_data_set_outgoing_bytes(
+        uint32_t key,
+        const void * data,
+        size_t length_bytes) {
+    const TupleType type = key<BSKY_DATAKEY_MAX
+        ? bsky_data_keys[key].type
+        : TUPLE_INT;
+    if (type != TUPLE_BYTE_ARRAY
+            || !(bsky_data_keys[key].flags & BSKY_DATAKEY_FLAG_OUTGOING)
+            || length_bytes > bsky_data_key_size(key)) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_data_set_outgoing_bytes: bad request for key %lu"
+                " (%u bytes)",
+                key,
+                length_bytes);
+    } else {
+        memcpy(s_key_buffer[key].ptr, data, length_bytes);
+        s_key_buffer_length[key] = length_bytes;
+        s_key_buffer_initialized[key] = true;
+    }
+}
+
 bool bsky_data_send_outgoing() {
     APP_LOG(APP_LOG_LEVEL_INFO, "bsky_data_send_outgoing()");
     if (!bsky_data_init()) {
@@ -354,14 +566,19 @@ bool bsky_data_send_outgoing() {
                 result);
         return false;
     }
+    // Only once the outbox is free, so that the record attached is the one
+    // the next sent callback is about.
+    bsky_telemetry_attach();
     for (uint32_t key=0; key<BSKY_DATAKEY_MAX; ++key) {
-        if (s_key_outgoing[key] && s_key_buffer_initialized[key]) {
+        const struct BSKY_DataKeyInfo * const info = &bsky_data_keys[key];
+        if ((info->flags & BSKY_DATAKEY_FLAG_OUTGOING)
+                && s_key_buffer_initialized[key]) {
             DictionaryResult dict_result = DICT_OK;
-            switch (s_key_type[key]) {
+            switch (info->type) {
                 case TUPLE_INT:
                     APP_LOG(APP_LOG_LEVEL_DEBUG,
                             "writing %s to outbox dict",
-                            s_key_name[key]);
+                            info->name);
                     dict_result = dict_write_int(
                             iterator,
                             key,
@@ -369,16 +586,26 @@ bool bsky_data_send_outgoing() {
                             sizeof(int32_t),
                             true);
                     break;
+                case TUPLE_BYTE_ARRAY:
+                    APP_LOG(APP_LOG_LEVEL_DEBUG,
+                            "writing %s to outbox dict",
+                            info->name);
+                    dict_result = dict_write_data(
+                            iterator,
+                            key,
+                            s_key_buffer[key].ptr,
+                            s_key_buffer_length[key]);
+                    break;
                 default:
                     APP_LOG(APP_LOG_LEVEL_WARNING,
                             "skipping %s",
-                            s_key_name[key]);
+                            info->name);
                     break;
             }
             if (dict_result != DICT_OK) {
                 APP_LOG(APP_LOG_LEVEL_WARNING,
                         "dictionary error writing %s: %d",
-                        s_key_name[key],
+                        info->name,
                         dict_result);
             }
         }
@@ -390,6 +617,15 @@ bool bsky_data_send_outgoing() {
                 result);
         return false;
     }
+    // Byte arrays are sent only once, see bsky_data_set_outgoing_bytes.
+    for (uint32_t key=0; key<BSKY_DATAKEY_MAX; ++key) {
+        const struct BSKY_DataKeyInfo * const info = &bsky_data_keys[key];
+        if ((info->flags & BSKY_DATAKEY_FLAG_OUTGOING)
+                && info->type == TUPLE_BYTE_ARRAY) {
+            s_key_buffer_initialized[key] = false;
+            s_key_buffer_length[key] = 0;
+        }
+    }
     APP_LOG(APP_LOG_LEVEL_INFO,
             "bsky_data_send_outgoing: sending message to phone...");
     return true;
@@ -423,7 +659,8 @@ bool bsky_data_subscribe (
         BSKY_DataReceiver receiver,
         void * context,
         uint32_t key) {
-    if (key>BSKY_DATAKEY_MAX || !s_key_incoming[key]) {
+    if (key>=BSKY_DATAKEY_MAX
+            || !(bsky_data_keys[key].flags & BSKY_DATAKEY_FLAG_INCOMING)) {
         return true;
     }
     for (size_t i=0; i<sizeof(s_subscribers)/sizeof(s_subscribers[0]); ++i) {
@@ -15,25 +15,47 @@
  */
 #pragma once
 
-// All known data keys, synchronized with ../../appinfo.js#appKeys.
-//
-enum BSKY_DataKey {
-    BSKY_DATAKEY_AGENDA_NEED_SECONDS = 1,
-    BSKY_DATAKEY_AGENDA_CAPACITY_BYTES = 2,
-    BSKY_DATAKEY_AGENDA = 3,
-    BSKY_DATAKEY_AGENDA_VERSION = 4,
-    BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME = 5,
-    BSKY_DATAKEY_AGENDA_EPOCH = 6,
-    BSKY_DATAKEY_FACE_HOURS = 7,
-    BSKY_DATAKEY_FACE_ORIENTATION = 8,
-    BSKY_DATAKEY_MAX = 9, // largest key + 1
-};
+// The data keys, their descriptors and the largest BSKY_DATAKEY_AGENDA_PATCH
+// value accepted are generated from ../../data_keys.json.  See agenda.c for
+// the patch format.
+//
+#include "data_keys.h"
 
 enum BSKY_Data_FaceOrientation {
     BSKY_DATA_FACE_ORIENTATION_MIDNIGHT_TOP = 0,
     BSKY_DATA_FACE_ORIENTATION_NOON_TOP = 1,
 };
 
+// Values for BSKY_DATAKEY_FACE_COUNTDOWN: whether to show the time until the
+// next event, or until the current one is over.
+//
+enum BSKY_Data_FaceCountdown {
+    BSKY_DATA_FACE_COUNTDOWN_SHOWN = 0,
+    BSKY_DATA_FACE_COUNTDOWN_HIDDEN = 1,
+};
+
+// Values for BSKY_DATAKEY_AGENDA_FORMAT: the newest agenda record format this
+// watch understands, sent along with BSKY_DATAKEY_AGENDA_CAPACITY_BYTES.  The
+// phone sends older watches, which send no format at all, only PLAIN records.
+//
+enum BSKY_Data_AgendaFormat {
+    // One record per event instance.
+    BSKY_DATA_AGENDA_FORMAT_PLAIN = 0,
+    // Also repeat records, see bsky_agenda_is_repeat.
+    BSKY_DATA_AGENDA_FORMAT_REPEATS = 1,
+};
+
+// Values for BSKY_DATAKEY_RENDER_QUALITY.  Any value other than AUTO forces
+// that tier regardless of battery state, which is mostly useful for
+// benchmarking.
+//
+enum BSKY_Data_RenderQuality {
+    BSKY_DATA_RENDER_QUALITY_AUTO = 0,
+    BSKY_DATA_RENDER_QUALITY_HIGH = 1,
+    BSKY_DATA_RENDER_QUALITY_MEDIUM = 2,
+    BSKY_DATA_RENDER_QUALITY_LOW = 3,
+};
+
 // Initialize the data module.
 //
 // This function is either idempotent or buggy: treat it as idempotent
@@ -52,6 +74,13 @@ bool bsky_data_init(void);
 //
 void bsky_data_deinit(void);
 
+// The largest value a key can hold, in bytes.
+//
+// For BSKY_DATAKEY_AGENDA this is decided at runtime by bsky_data_init from
+// the platform's maximum inbox size and the free heap, and is zero until then.
+//
+size_t bsky_data_capacity(uint32_t key);
+
 // Retrieve a copy of the int32 value of a key.
 //
 // Returns: the value of the key if that value is an int, otherwise zero.
@@ -68,6 +97,27 @@ int32_t bsky_data_int(uint32_t key);
 //
 const void * bsky_data_ptr(uint32_t key, size_t * length_bytes);
 
+// Get a byte array value to modify in place, for example to apply a patch.
+//
+// The buffer holds up to bsky_data_capacity(key) bytes.  Call
+// bsky_data_commit once done with it.
+//
+// Returns: as bsky_data_ptr, except that the value may be written, and that
+// NULL is returned only if the value has no buffer at all: a value that hasn't
+// arrived yet is treated as empty.
+//
+void * bsky_data_edit(uint32_t key, size_t * length_bytes);
+
+// Finish modifying a byte array value returned by bsky_data_edit.  The value
+// is persisted and subscribers notified just as though it had arrived from
+// the phone.
+//
+void bsky_data_commit(uint32_t key, size_t length_bytes);
+
+// Change an int value as though it had arrived from the phone.
+//
+void bsky_data_commit_int(uint32_t key, int32_t value);
+
 // Set an int value to be sent the next time bsky_data_send_outgoing is called.
 //
 // TODO: refactor this API to just "set_int" or similar;
@@ -76,6 +126,17 @@ const void * bsky_data_ptr(uint32_t key, size_t * length_bytes);
 //
 void bsky_data_set_outgoing_int(uint32_t key, int32_t data);
 
+// Set a byte array value to be sent the next time bsky_data_send_outgoing is
+// called.  The bytes are copied.
+//
+// Unlike int values, byte array values are only sent once: after a successful
+// send they are forgotten until set again.
+//
+void bsky_data_set_outgoing_bytes(
+        uint32_t key,
+        const void * data,
+        size_t length_bytes);
+
 bool bsky_data_send_outgoing();
 
 // Function type for data update subscriber callback functions.
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Generated by tools/data_keys.py from data_keys.json, do not edit.
+
+#include "data_keys.h"
+
+const struct BSKY_DataKeyInfo bsky_data_keys [BSKY_DATAKEY_MAX] = {
+    [BSKY_DATAKEY_AGENDA_NEED_SECONDS] = {
+        .name = "BSKY_DATAKEY_AGENDA_NEED_SECONDS",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_AGENDA_CAPACITY_BYTES] = {
+        .name = "BSKY_DATAKEY_AGENDA_CAPACITY_BYTES",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_AGENDA] = {
+        .name = "BSKY_DATAKEY_AGENDA",
+        .max_bytes = 0,
+        .type = TUPLE_BYTE_ARRAY,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING,
+    },
+    [BSKY_DATAKEY_AGENDA_VERSION] = {
+        .name = "BSKY_DATAKEY_AGENDA_VERSION",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING | BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME] = {
+        .name = "BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_AGENDA_EPOCH] = {
+        .name = "BSKY_DATAKEY_AGENDA_EPOCH",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING,
+    },
+    [BSKY_DATAKEY_FACE_HOURS] = {
+        .name = "BSKY_DATAKEY_FACE_HOURS",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING | BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_FACE_ORIENTATION] = {
+        .name = "BSKY_DATAKEY_FACE_ORIENTATION",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING | BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_RENDER_QUALITY] = {
+        .name = "BSKY_DATAKEY_RENDER_QUALITY",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING,
+    },
+    [BSKY_DATAKEY_TELEMETRY] = {
+        .name = "BSKY_DATAKEY_TELEMETRY",
+        .max_bytes = 18,
+        .type = TUPLE_BYTE_ARRAY,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_AGENDA_PATCH] = {
+        .name = "BSKY_DATAKEY_AGENDA_PATCH",
+        .max_bytes = 256,
+        .type = TUPLE_BYTE_ARRAY,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING | BSKY_DATAKEY_FLAG_TRANSIENT,
+    },
+    [BSKY_DATAKEY_FACE_COUNTDOWN] = {
+        .name = "BSKY_DATAKEY_FACE_COUNTDOWN",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_INCOMING,
+    },
+    [BSKY_DATAKEY_AGENDA_TRACE] = {
+        .name = "BSKY_DATAKEY_AGENDA_TRACE",
+        .max_bytes = 12,
+        .type = TUPLE_BYTE_ARRAY,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+    [BSKY_DATAKEY_AGENDA_FORMAT] = {
+        .name = "BSKY_DATAKEY_AGENDA_FORMAT",
+        .max_bytes = 4,
+        .type = TUPLE_INT,
+        .flags = BSKY_DATAKEY_FLAG_OUTGOING,
+    },
+};
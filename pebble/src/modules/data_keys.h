@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Generated by tools/data_keys.py from data_keys.json, do not edit.
+
+// The worker gets the same types from <pebble_worker.h>.
+#ifndef BSKY_WORKER
+#include <pebble.h>
+#endif
+
+// All known data keys, as in appinfo.json#appKeys.
+//
+enum BSKY_DataKey {
+    BSKY_DATAKEY_AGENDA_NEED_SECONDS = 1,
+    BSKY_DATAKEY_AGENDA_CAPACITY_BYTES = 2,
+    BSKY_DATAKEY_AGENDA = 3,
+    BSKY_DATAKEY_AGENDA_VERSION = 4,
+    BSKY_DATAKEY_PEBBLE_NOW_UNIX_TIME = 5,
+    BSKY_DATAKEY_AGENDA_EPOCH = 6,
+    BSKY_DATAKEY_FACE_HOURS = 7,
+    BSKY_DATAKEY_FACE_ORIENTATION = 8,
+    BSKY_DATAKEY_RENDER_QUALITY = 9,
+    BSKY_DATAKEY_TELEMETRY = 10,
+    BSKY_DATAKEY_AGENDA_PATCH = 11,
+    BSKY_DATAKEY_FACE_COUNTDOWN = 12,
+    BSKY_DATAKEY_AGENDA_TRACE = 13,
+    BSKY_DATAKEY_AGENDA_FORMAT = 14,
+    BSKY_DATAKEY_MAX = 15, // largest key + 1
+};
+
+// Largest value of each byte array key with a fixed size.
+//
+#define BSKY_DATA_TELEMETRY_MAX_BYTES 18
+#define BSKY_DATA_AGENDA_PATCH_MAX_BYTES 256
+#define BSKY_DATA_AGENDA_TRACE_MAX_BYTES 12
+
+// Inbox and outbox sizes for every key at its largest, except that
+// values sized at runtime still need adding to the inbox.
+//
+#define BSKY_DATA_INBOX_BYTES 74
+#define BSKY_DATA_OUTBOX_BYTES 122
+
+enum BSKY_DataKeyFlag {
+    BSKY_DATAKEY_FLAG_INCOMING = 1 << 0,
+    BSKY_DATAKEY_FLAG_OUTGOING = 1 << 1,
+    // Used once on arrival and never persisted.
+    BSKY_DATAKEY_FLAG_TRANSIENT = 1 << 2,
+};
+
+// What is known about a key before the app runs.  Eight bytes, so
+// that everything about a key is one load from bsky_data_keys.
+//
+struct BSKY_DataKeyInfo {
+    const char * name;
+    // Zero if decided at runtime.
+    uint16_t max_bytes;
+    // TupleType
+    uint8_t type;
+    // BSKY_DataKeyFlag values
+    uint8_t flags;
+};
+
+// Indexed by key.  Unused keys have a NULL name and are zero otherwise.
+//
+extern const struct BSKY_DataKeyInfo bsky_data_keys [BSKY_DATAKEY_MAX];
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "memory.h"
+
+static size_t s_peak_used = 0;
+static size_t s_min_free = SIZE_MAX;
+
+void bsky_memory_checkpoint(const char * where) {
+    const size_t used_bytes = heap_bytes_used();
+    const size_t free_bytes = heap_bytes_free();
+    if (used_bytes > s_peak_used) {
+        s_peak_used = used_bytes;
+    }
+    if (free_bytes < s_min_free) {
+        s_min_free = free_bytes;
+    }
+    APP_LOG(APP_LOG_LEVEL_INFO,
+            "bsky_memory_checkpoint: %s: heap used=%u (peak %u),"
+            " free=%u (min %u)",
+            where,
+            used_bytes,
+            s_peak_used,
+            free_bytes,
+            s_min_free);
+}
+
+size_t bsky_memory_peak_used(void) {
+    return s_peak_used;
+}
+
+size_t bsky_memory_min_free(void) {
+    return s_min_free;
+}
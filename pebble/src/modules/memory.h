@@ -0,0 +1,38 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Heap accounting.
+//
+// Static buffers and heap allocations throughout the app are sized up front,
+// so the numbers recorded here are what tell us whether those sizes are
+// reasonable on a real device.  Static (.bss and .data) usage is checked at
+// build time instead, see ../../tools/memory_budget.py.
+
+// Record heap usage at a named point in the app's life, updating the
+// high-water marks.
+//
+// where: a short static string to identify the checkpoint in logs.
+//
+void bsky_memory_checkpoint(const char * where);
+
+// The most heap_bytes_used ever seen at a checkpoint.
+//
+size_t bsky_memory_peak_used(void);
+
+// The least heap_bytes_free ever seen at a checkpoint.
+//
+size_t bsky_memory_min_free(void);
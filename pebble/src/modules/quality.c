@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "data.h"
+#include "quality.h"
+
+// Battery thresholds, in percent, below which each tier is abandoned.
+//
+#define BSKY_QUALITY_HIGH_MIN_PERCENT 40
+#define BSKY_QUALITY_MEDIUM_MIN_PERCENT 20
+
+// The tier chosen from the most recently reported battery state.
+//
+static BSKY_RenderQuality s_battery_quality = BSKY_DATA_RENDER_QUALITY_HIGH;
+
+static BSKY_RenderQuality bsky_quality_from_battery(BatteryChargeState state) {
+    if (state.is_charging || state.is_plugged
+            || state.charge_percent >= BSKY_QUALITY_HIGH_MIN_PERCENT) {
+        return BSKY_DATA_RENDER_QUALITY_HIGH;
+    }
+    if (state.charge_percent >= BSKY_QUALITY_MEDIUM_MIN_PERCENT) {
+        return BSKY_DATA_RENDER_QUALITY_MEDIUM;
+    }
+    return BSKY_DATA_RENDER_QUALITY_LOW;
+}
+
+// Matches BatteryStateHandler.
+//
+static void bsky_quality_battery_handler(BatteryChargeState state) {
+    const BSKY_RenderQuality quality = bsky_quality_from_battery(state);
+    if (quality != s_battery_quality) {
+        APP_LOG(APP_LOG_LEVEL_INFO,
+                "bsky_quality_battery_handler: %d%% charge, tier %d -> %d",
+                state.charge_percent,
+                s_battery_quality,
+                quality);
+        s_battery_quality = quality;
+    }
+}
+
+void bsky_quality_init(void) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_quality_init()");
+    s_battery_quality = bsky_quality_from_battery(battery_state_service_peek());
+    battery_state_service_subscribe(bsky_quality_battery_handler);
+}
+
+void bsky_quality_deinit(void) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_quality_deinit()");
+    battery_state_service_unsubscribe();
+}
+
+BSKY_RenderQuality bsky_quality_get(void) {
+    const int32_t forced = bsky_data_int(BSKY_DATAKEY_RENDER_QUALITY);
+    if (forced > BSKY_DATA_RENDER_QUALITY_AUTO
+            && forced <= BSKY_DATA_RENDER_QUALITY_LOW) {
+        return forced;
+    }
+    return s_battery_quality;
+}
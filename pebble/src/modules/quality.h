@@ -0,0 +1,49 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "data.h"
+
+// Render quality tiers, from most to least battery-hungry.
+//
+// HIGH: everything, antialiased.
+//
+// MEDIUM: no antialiasing, no shine highlights on events, a single stroke for
+// the Sun's beam.
+//
+// LOW: as MEDIUM, but the Sun is a plain disc.
+//
+// Every tier redraws once a minute: the time changes every minute, and any
+// dirty layer redraws the whole window, so drawing the sky less often would
+// save nothing but leave the Sun behind.  The tiers only make each redraw
+// cheaper.
+//
+// The tier is chosen from the battery state unless BSKY_DATAKEY_RENDER_QUALITY
+// forces one.
+//
+typedef enum BSKY_Data_RenderQuality BSKY_RenderQuality;
+
+// Start watching the battery.
+//
+void bsky_quality_init(void);
+
+// Stop watching the battery.
+//
+void bsky_quality_deinit(void);
+
+// Get the tier that rendering code should honour right now.  Never AUTO.
+//
+BSKY_RenderQuality bsky_quality_get(void);
@@ -18,19 +18,19 @@
 #include "data.h"
 #include "agenda.h"
 #include "palette.h"
+#include "quality.h"
 #include "sky_layer.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "tick.h"
 
 // Custom state per sky layer.
 //
 typedef struct {
 
-    // The "absolute" moment to be displayed.
+    // The moment to be displayed.
     //
-    time_t unix_time;
-
-    // The timezone-local moment to be displayed.
-    //
-    struct tm wall_time;
+    struct BSKY_Tick tick;
 
 } BSKY_SkyLayerData;
 
@@ -50,29 +50,184 @@ static GRect bsky_rect_trim (const GRect rect, const int8_t trim) {
     return result;
 }
 
-// Matches BSKY_DataReceiver
+// Matches BSKY_DataReceiver and BSKY_AgendaReceiver
 //
 static void bsky_sky_layer_agenda_update(void * context) {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_sky_layer_agenda_update");
     layer_mark_dirty((Layer*)context);
 }
 
-// Get an easily human-readable representation of a time_t.
+// Instances converted to angles at a time, on the stack.
+//
+#define BSKY_SKY_LAYER_BATCH 32
+
+// With more instances than this in view, draw the agenda's bins instead, so
+// that a crowded agenda costs no more to draw than the face has room to show.
+// See bsky_agenda_bins.
+//
+#define BSKY_SKY_LAYER_DETAIL_MAX_INSTANCES 24
+
+// Round towards negative infinity, unlike C division.
+//
+static int32_t bsky_floor_div(int32_t numerator, int32_t denominator) {
+    const int32_t quotient = numerator / denominator;
+    return quotient * denominator > numerator ? quotient - 1 : quotient;
+}
+
+// Everything needed to draw events as buildings in the skyline, worked out
+// once per render.
 //
-// TODO: refactor this to avoid potentially sharing and corrupting the static
-// string buffer; maybe write a log message with a given prefix followed by the
-// time.
+struct BSKY_Skyline {
+    GRect bounds;
+    uint16_t inset_min_px;
+    uint16_t inset_max_px;
+    uint16_t duration_min_seconds;
+    uint16_t duration_max_seconds;
+    int32_t sun_angle;
+    BSKY_RenderQuality quality;
+};
+
+// How tall to draw a building for an event lasting duration_seconds.
+//
+static uint16_t bsky_skyline_height_px(
+        const struct BSKY_Skyline * skyline,
+        uint32_t duration_seconds) {
+    const uint16_t duration_scale
+        = duration_seconds < skyline->duration_min_seconds
+        ? 0
+        : duration_seconds < skyline->duration_max_seconds
+        ? duration_seconds - skyline->duration_min_seconds
+        : (skyline->duration_max_seconds-skyline->duration_min_seconds);
+    return duration_scale
+        * (skyline->inset_max_px-skyline->inset_min_px)
+        / (skyline->duration_max_seconds-skyline->duration_min_seconds);
+}
+
+// Draw one instance of an event that is known to be at least partly visible.
 //
-static const char * bsky_debug_fmt_time (time_t t) {
-    const struct tm *local_now = localtime(&t);
-    static char s_time_buffer[20];
-    if (0 == strftime(s_time_buffer,
-                sizeof(s_time_buffer),
-                "%F %T",
-                local_now)) {
-        return "(error while formatting time)";
+// angles: start and end on the face, from bsky_agenda_angles.
+//
+static void bsky_sky_layer_draw_event(
+        GContext *ctx,
+        const struct BSKY_Skyline * skyline,
+        const int32_t angles [2],
+        uint32_t duration_seconds) {
+    // The Sun's light reflects off the near side of buildings.  As a
+    // building approaches, its nearest side brightens and eventually
+    // becomes parallel to the Sun, occluded by the rest of the building.
+    // Here, the proportion of the building that shines begins at 100% at
+    // 180 degrees from the Sun, then diminishes linearly.  Without floats,
+    // we will represent this portion as a span of the building's angle.
+    const int32_t angle_till_start
+        = angles[0]-skyline->sun_angle;
+    int32_t shine_angle;
+    if (angle_till_start<0) {
+        shine_angle = 0;
+    } else {
+        shine_angle
+            = (angles[1]-angles[0])
+            * angle_till_start
+            / (TRIG_MAX_ANGLE/2);
+    }
+
+    const uint16_t event_height_px
+        = bsky_skyline_height_px(skyline, duration_seconds);
+    graphics_context_set_fill_color(ctx, GColorBlack);
+    graphics_fill_radial(
+            ctx,
+            skyline->bounds,
+            GOvalScaleModeFitCircle,
+            skyline->inset_max_px - event_height_px,
+            angles[0],
+            angles[1]);
+
+    const int32_t outline_angle = TRIG_MAX_ANGLE*4/(360*3);
+    if (shine_angle>0 && skyline->quality == BSKY_DATA_RENDER_QUALITY_HIGH) {
+        GColor shine_color;
+        const uint16_t tall_px
+            = (skyline->inset_max_px+skyline->inset_min_px)*2/5;
+        if (event_height_px > tall_px) {
+            // Tall towers tend to be made of more grey/blue material so
+            // highlight them that way.
+            shine_color = GColorLiberty;
+        } else {
+            // Otherwise let's say it's made of traditional red-orange
+            // brick, and the highlight can be wider.
+            shine_color = GColorRoseVale;
+        }
+        const int32_t shine_start_angle = angles[0]+outline_angle;
+        int32_t shine_end_angle = shine_start_angle+shine_angle;
+        if (shine_end_angle > (angles[1]-outline_angle)) {
+            shine_end_angle = angles[1]-outline_angle;
+        }
+        graphics_context_set_fill_color(ctx, shine_color);
+        graphics_fill_radial(
+                ctx,
+                skyline->bounds,
+                GOvalScaleModeFitCircle,
+                skyline->inset_max_px - event_height_px - 1,
+                shine_start_angle,
+                shine_end_angle);
     }
-    return s_time_buffer;
+}
+
+// Draw the visible bins, each as tall as the longest instance in it, and each
+// run of bins of the same height as a single building.  There is no shine:
+// at this density it would be lost anyway.
+//
+// Returns: false if there are no bins to draw, in which case nothing was
+// drawn.
+//
+static bool bsky_sky_layer_draw_bins(
+        GContext *ctx,
+        const struct BSKY_Skyline * skyline,
+        const struct BSKY_AgendaAngleMap * map) {
+    const struct BSKY_AgendaBins * bins
+        = bsky_agenda_bins(map->first_minute, map->last_minute);
+    if (!bins) {
+        return false;
+    }
+    graphics_context_set_fill_color(ctx, GColorBlack);
+    const int32_t first_bin
+        = (map->first_minute - bins->first_minute) / BSKY_AGENDA_BIN_MINUTES;
+    const int32_t last_bin
+        = (map->last_minute - bins->first_minute) / BSKY_AGENDA_BIN_MINUTES;
+
+    // Heights are only worked out again where the peak duration changes.
+    int32_t run_first_bin = first_bin;
+    int32_t run_height_px = -1;
+    uint16_t peak_duration = 0;
+    int32_t height_px = -1;
+    for (int32_t bin=first_bin; bin<=last_bin+1; ++bin) {
+        if (bin > last_bin || !bins->counts[bin]) {
+            height_px = -1;
+        } else if (bins->peak_durations[bin] != peak_duration || height_px < 0) {
+            peak_duration = bins->peak_durations[bin];
+            height_px = bsky_skyline_height_px(
+                    skyline,
+                    peak_duration * SECONDS_PER_MINUTE);
+        }
+        if (height_px == run_height_px) {
+            continue;
+        }
+        if (run_height_px >= 0) {
+            graphics_fill_radial(
+                    ctx,
+                    skyline->bounds,
+                    GOvalScaleModeFitCircle,
+                    skyline->inset_max_px - run_height_px,
+                    bsky_agenda_angle(
+                        map,
+                        bins->first_minute
+                        + run_first_bin * BSKY_AGENDA_BIN_MINUTES),
+                    bsky_agenda_angle(
+                        map,
+                        bins->first_minute + bin * BSKY_AGENDA_BIN_MINUTES));
+        }
+        run_first_bin = bin;
+        run_height_px = height_px;
+    }
+    return true;
 }
 
 // Pebble Layer callback to do the rendering work.
@@ -85,12 +240,17 @@ static void bsky_sky_layer_update (Layer *layer, GContext *ctx) {
             layer,
             ctx);
 
+    time_t start_s;
+    uint16_t start_ms;
+    time_ms(&start_s, &start_ms);
+
     const GColor color_sun_fill = BSKY_PALETTE_SUN_LIGHT;
     const GColor color_sun_stroke = BSKY_PALETTE_SUN_DARK;
     const GColor color_sky_stroke = BSKY_PALETTE_SKY_STROKE;
 
     const BSKY_SkyLayerData * const data = layer_get_data(layer);
     const GRect bounds = layer_get_bounds(layer);
+    const BSKY_RenderQuality quality = bsky_quality_get();
 
     const GRect sky_bounds = bounds;
     const int16_t sky_diameter_px =
@@ -120,7 +280,9 @@ static void bsky_sky_layer_update (Layer *layer, GContext *ctx) {
     const GRect sky_inset_bounds
         = bsky_rect_trim(sky_bounds, sky_diameter_px / 4);
     graphics_context_set_stroke_color(ctx, color_sky_stroke);
-    graphics_context_set_antialiased(ctx, true);
+    graphics_context_set_antialiased(
+            ctx,
+            quality == BSKY_DATA_RENDER_QUALITY_HIGH);
     for (int32_t hour = 0; hour < circum_hours; ++hour) {
         const int32_t hour_angle =
             (midnight_angle + hour * TRIG_MAX_ANGLE / circum_hours)
@@ -150,8 +312,7 @@ static void bsky_sky_layer_update (Layer *layer, GContext *ctx) {
 
     // Update the Sun
     const int32_t sun_angle = midnight_angle
-        + TRIG_MAX_ANGLE * data->wall_time.tm_hour / circum_hours
-        + TRIG_MAX_ANGLE * data->wall_time.tm_min / (circum_hours * 60);
+        + TRIG_MAX_ANGLE * data->tick.minute_of_day / (circum_hours * 60);
     const int32_t sun_diameter_px = sky_diameter_px / 7;
     const GRect sun_orbit_bounds
         = bsky_rect_trim(
@@ -168,135 +329,78 @@ static void bsky_sky_layer_update (Layer *layer, GContext *ctx) {
     graphics_context_set_stroke_color(ctx, color_sun_stroke);
     graphics_context_set_stroke_width(ctx, 2);
     graphics_context_set_fill_color(ctx, color_sun_fill);
-    graphics_draw_line(ctx, sun_center, sun_beam);
+    if (quality != BSKY_DATA_RENDER_QUALITY_LOW) {
+        graphics_draw_line(ctx, sun_center, sun_beam);
+    }
     graphics_fill_circle(ctx, sun_center, sun_diameter_px/2);
-    graphics_draw_circle(ctx, sun_center, sun_diameter_px/2);
-    graphics_context_set_stroke_width(ctx, 1);
-    graphics_context_set_stroke_color(ctx, color_sun_fill);
-    graphics_draw_line(ctx, sun_center, sun_beam);
+    if (quality == BSKY_DATA_RENDER_QUALITY_HIGH) {
+        graphics_draw_circle(ctx, sun_center, sun_diameter_px/2);
+        graphics_context_set_stroke_width(ctx, 1);
+        graphics_context_set_stroke_color(ctx, color_sun_fill);
+        graphics_draw_line(ctx, sun_center, sun_beam);
+    }
 
     // Draw the Skyline as solid blocks
-    const GRect skyline_bounds = sky_bounds;
-    const uint16_t inset_min_px = sky_diameter_px/20;
-    const uint16_t inset_max_px = sky_diameter_px/2-(sky_diameter_px*4/14);
-    const uint16_t duration_min_seconds = 20*SECONDS_PER_MINUTE;
-    const uint16_t duration_max_seconds = 6*SECONDS_PER_HOUR;
-    const struct BSKY_Agenda * agenda = bsky_agenda_read();
-    const struct BSKY_AgendaEvent * events = agenda->events;
-    time_t max_start_time = data->unix_time+circum_hours*SECONDS_PER_HOUR;
-    time_t min_end_time = data->unix_time;
-    const time_t midnight_time = time_start_of_today();
-    for (int32_t index=0; index<agenda->events_length; ++index) {
-        const int32_t ievent
-            = agenda->events_by_height
-            ? agenda->events_by_height[index]
-            : index;
-        if (events[ievent].rel_start>=events[ievent].rel_end) {
-            // Skip zero-length and negative-length events
-            continue;
-        }
-        const time_t times [2] = {
-            agenda->epoch + events[ievent].rel_start*60,
-            agenda->epoch + events[ievent].rel_end*60,
-        };
-        if (times[0] > max_start_time) {
-            // This event starts too far in the future to be displayed now.
-            continue;
-        }
-        if (times[1] <= min_end_time) {
-            // This event is already over.
-            continue;
-        }
-
-        int32_t angles [2];
-        for (int t=0; t<2; ++t) {
-            const time_t cropped
-                = times[t] < min_end_time ? min_end_time
-                : times[t] > max_start_time ? max_start_time
-                : times[t];
-            const int32_t seconds_since_midnight = cropped-midnight_time;
-            const int32_t minutes_since_midnight
-                = (seconds_since_midnight/SECONDS_PER_MINUTE)
-                % MINUTES_PER_HOUR;
-            const int32_t hours_since_midnight
-                = seconds_since_midnight/SECONDS_PER_HOUR;
-            angles[t]
-                = midnight_angle
-                + TRIG_MAX_ANGLE * hours_since_midnight / circum_hours
-                + (TRIG_MAX_ANGLE * minutes_since_midnight
-                   / (circum_hours * 60));
-        }
-
-        APP_LOG(APP_LOG_LEVEL_DEBUG,
-                "event start=%s", bsky_debug_fmt_time(times[0]));
-        APP_LOG(APP_LOG_LEVEL_DEBUG,
-                "event end=%s", bsky_debug_fmt_time(times[1]));
-
-        // The Sun's light reflects off the near side of buildings.  As a
-        // building approaches, its nearest side brightens and eventually
-        // becomes parallel to the Sun, occluded by the rest of the building.
-        // Here, the proportion of the building that shines begins at 100% at
-        // 180 degrees from the Sun, then diminishes linearly.  Without floats,
-        // we will represent this portion as a span of the building's angle.
-        const int32_t angle_till_start
-            = angles[0]-sun_angle;
-        int32_t shine_angle;
-        if (angle_till_start<0) {
-            shine_angle = 0;
-        } else {
-            shine_angle
-                = (angles[1]-angles[0])
-                * angle_till_start
-                / (TRIG_MAX_ANGLE/2);
-        }
-
-        const uint32_t duration_seconds = times[1]-times[0];
-        const uint16_t duration_scale
-            = duration_seconds < duration_min_seconds
-            ? 0
-            : duration_seconds < duration_max_seconds
-            ? duration_seconds - duration_min_seconds
-            : (duration_max_seconds-duration_min_seconds);
-        const uint16_t event_height_px
-            = duration_scale
-            * (inset_max_px-inset_min_px)
-            / (duration_max_seconds-duration_min_seconds);
-        graphics_context_set_fill_color(ctx, GColorBlack);
-        graphics_fill_radial(
-                ctx,
-                skyline_bounds,
-                GOvalScaleModeFitCircle,
-                inset_max_px - event_height_px,
-                angles[0],
-                angles[1]);
-
-        const int32_t outline_angle = TRIG_MAX_ANGLE*4/(360*3);
-        if (shine_angle>0) {
-            GColor shine_color;
-            if (event_height_px > (inset_max_px+inset_min_px)*2/5) {
-                // Tall towers tend to be made of more grey/blue material so
-                // highlight them that way.
-                shine_color = GColorLiberty;
-            } else {
-                // Otherwise let's say it's made of traditional red-orange
-                // brick, and the highlight can be wider.
-                shine_color = GColorRoseVale;
-            }
-            const int32_t shine_start_angle = angles[0]+outline_angle;
-            int32_t shine_end_angle = shine_start_angle+shine_angle;
-            if (shine_end_angle > (angles[1]-outline_angle)) {
-                shine_end_angle = angles[1]-outline_angle;
+    const struct BSKY_Skyline skyline = {
+        .bounds = sky_bounds,
+        .inset_min_px = sky_diameter_px/20,
+        .inset_max_px = sky_diameter_px/2-(sky_diameter_px*4/14),
+        .duration_min_seconds = 20*SECONDS_PER_MINUTE,
+        .duration_max_seconds = 6*SECONDS_PER_HOUR,
+        .sun_angle = sun_angle,
+        .quality = quality,
+    };
+    const struct BSKY_Agenda * agenda = bsky_agenda_read(data->tick.unix_time);
+    const int32_t circum_minutes = circum_hours * MINUTES_PER_HOUR;
+    const struct BSKY_AgendaAngleMap map = {
+        .first_minute = bsky_floor_div(
+                data->tick.unix_time - agenda->epoch,
+                SECONDS_PER_MINUTE),
+        .last_minute = bsky_floor_div(
+                data->tick.unix_time + circum_seconds - agenda->epoch,
+                SECONDS_PER_MINUTE),
+        .origin_minute = bsky_floor_div(
+                data->tick.start_of_day - agenda->epoch,
+                SECONDS_PER_MINUTE),
+        .origin_angle = midnight_angle,
+        .angle_per_minute_q
+            = (TRIG_MAX_ANGLE << BSKY_AGENDA_ANGLE_Q) / circum_minutes,
+    };
+    int32_t begin;
+    int32_t end;
+    bsky_agenda_find(agenda, map.first_minute, map.last_minute, &begin, &end);
+    if (end - begin > BSKY_SKY_LAYER_DETAIL_MAX_INSTANCES
+            && bsky_sky_layer_draw_bins(ctx, &skyline, &map)) {
+        begin = end;
+    }
+    int32_t angles [2][BSKY_SKY_LAYER_BATCH];
+    for (int32_t ibatch=begin; ibatch<end; ibatch+=BSKY_SKY_LAYER_BATCH) {
+        const int32_t length = end - ibatch < BSKY_SKY_LAYER_BATCH
+            ? end - ibatch
+            : BSKY_SKY_LAYER_BATCH;
+        const int16_t * starts = &agenda->starts[ibatch];
+        const uint16_t * durations = &agenda->durations[ibatch];
+        bsky_agenda_angles(
+                starts, durations, length, &map, angles[0], angles[1]);
+        for (int32_t i=0; i<length; ++i) {
+            if (starts[i] + durations[i] <= map.first_minute) {
+                // Over already; bsky_agenda_find only bounds the range.
+                continue;
             }
-            graphics_context_set_fill_color(ctx, shine_color);
-            graphics_fill_radial(
+            const int32_t event_angles [2] = { angles[0][i], angles[1][i] };
+            bsky_sky_layer_draw_event(
                     ctx,
-                    skyline_bounds,
-                    GOvalScaleModeFitCircle,
-                    inset_max_px - event_height_px - 1,
-                    shine_start_angle,
-                    shine_end_angle);
+                    &skyline,
+                    event_angles,
+                    durations[i] * SECONDS_PER_MINUTE);
         }
     }
+
+    time_t end_s;
+    uint16_t end_ms;
+    time_ms(&end_s, &end_ms);
+    bsky_telemetry_render((end_s - start_s) * 1000 + end_ms - start_ms);
+    bsky_trace_mark(BSKY_TRACE_DRAWN, agenda->version);
 }
 
 struct BSKY_SkyLayer {
@@ -335,10 +439,13 @@ BSKY_SkyLayer * bsky_sky_layer_create(GRect frame) {
             layer_set_update_proc(
                     sky_layer->layer,
                     bsky_sky_layer_update);
+            bsky_agenda_subscribe(
+                    bsky_sky_layer_agenda_update,
+                    sky_layer->layer);
             if (!bsky_data_subscribe(
                     bsky_sky_layer_agenda_update,
                     sky_layer->layer,
-                    BSKY_DATAKEY_AGENDA)) {
+                    BSKY_DATAKEY_RENDER_QUALITY)) {
                 // This should never happen on non-developer devices: the
                 // number of subscribers supported by the Data module should be
                 // hard-coded to a sufficient limit.
@@ -349,7 +456,7 @@ BSKY_SkyLayer * bsky_sky_layer_create(GRect frame) {
                 //
                 APP_LOG(APP_LOG_LEVEL_ERROR,
                         "bsky_sky_layer_create:"
-                        " failed to subscribe to agenda updates");
+                        " failed to subscribe to data updates");
             }
         }
     }
@@ -360,6 +467,9 @@ void bsky_sky_layer_destroy(BSKY_SkyLayer *sky_layer) {
     APP_LOG(APP_LOG_LEVEL_DEBUG,
             "bsky_sky_layer_destroy(%p)",
             sky_layer);
+    bsky_agenda_unsubscribe(
+            bsky_sky_layer_agenda_update,
+            sky_layer->layer);
     bsky_data_unsubscribe(
             bsky_sky_layer_agenda_update,
             sky_layer->layer);
@@ -375,12 +485,10 @@ Layer * bsky_sky_layer_get_layer(BSKY_SkyLayer *sky_layer) {
 
 void bsky_sky_layer_set_time(
         BSKY_SkyLayer *sky_layer,
-        time_t time) {
+        const struct BSKY_Tick * tick) {
     APP_LOG(APP_LOG_LEVEL_DEBUG,
             "bsky_sky_layer_set_time(%p, ...)",
             sky_layer);
-    sky_layer->data->unix_time = time;
-    struct tm * wall_time = localtime(&time);
-    sky_layer->data->wall_time = *wall_time;
+    sky_layer->data->tick = *tick;
     layer_mark_dirty(sky_layer->layer);
 }
@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include "tick.h"
+
 // A sky layer, displaying the yellow sun against 24 hours of blue sky.
 //
 typedef struct BSKY_SkyLayer BSKY_SkyLayer;
@@ -33,6 +35,8 @@ Layer * bsky_sky_layer_get_layer(BSKY_SkyLayer * sky_layer);
 
 // Set the position of the sun.
 //
+// The tick is copied, so the caller need not keep it alive.
+//
 void bsky_sky_layer_set_time(
         BSKY_SkyLayer * sky_layer,
-        time_t time);
+        const struct BSKY_Tick * tick);
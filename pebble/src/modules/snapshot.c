@@ -0,0 +1,189 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BSKY_WORKER
+#include <pebble.h>
+#endif
+
+#include "snapshot.h"
+
+// Using the built-in qsort function to sort an array of indices by the values
+// they index in another array requires making that other array available to
+// the "compare" function passed to qsort.
+//
+// See cmp_snapshot_events_by_height.
+//
+static const struct BSKY_AgendaEvent * cmp_snapshot_events_by_height_events;
+
+// Compare two indices in a list of indices based on the durations of the
+// events they index in the cmp_snapshot_events_by_height_events array.
+//
+// Ties are broken by index so that the order doesn't depend on qsort.
+//
+static int cmp_snapshot_events_by_height(const void * a, const void * b) {
+    int16_t index [2] = { *((const int16_t*)a), *((const int16_t*)b) };
+    int32_t duration[2];
+    for (int i=0; i<2; ++i) {
+        int32_t start = cmp_snapshot_events_by_height_events[index[i]].rel_start;
+        int32_t end = cmp_snapshot_events_by_height_events[index[i]].rel_end;
+        duration[i] = end-start;
+    }
+    if (duration[0] != duration[1]) {
+        return duration[0]-duration[1];
+    }
+    return index[0]-index[1];
+}
+
+// Copy events into compact, dropping those that are over by end_minutes and
+// advancing repeating events past their instances that are.
+//
+// Returns: the number of records written to compact, at most events_length.
+//
+static int32_t bsky_snapshot_compact(
+        const struct BSKY_AgendaEvent * events,
+        int32_t events_length,
+        int32_t now_minutes,
+        struct BSKY_AgendaEvent * compact) {
+    int32_t compact_length = 0;
+    for (int32_t ievent=0; ievent<events_length; ++ievent) {
+        if (bsky_agenda_is_repeat(&events[ievent])) {
+            continue;
+        }
+        int32_t stride;
+        int32_t instances = bsky_agenda_event_instances(
+                events, events_length, ievent, &stride);
+        int32_t rel_start = events[ievent].rel_start;
+        int32_t rel_end = events[ievent].rel_end;
+
+        // Skip straight to the first instance that isn't over.
+        if (rel_end <= now_minutes && stride > 0) {
+            int32_t over = (now_minutes - rel_end) / stride + 1;
+            if (over > instances) {
+                over = instances;
+            }
+            instances -= over;
+            rel_start += over * stride;
+            rel_end += over * stride;
+        } else if (rel_end <= now_minutes) {
+            instances = 0;
+        }
+        if (instances <= 0 || rel_end > INT16_MAX) {
+            continue;
+        }
+
+        compact[compact_length++] = (struct BSKY_AgendaEvent) {
+            .rel_start = rel_start,
+            .rel_end = rel_end,
+        };
+        if (instances > 1) {
+            compact[compact_length++] = (struct BSKY_AgendaEvent) {
+                .rel_start = BSKY_AGENDA_REPEAT_MARK + instances - 2,
+                .rel_end = stride,
+            };
+        }
+    }
+    return compact_length;
+}
+
+// Write compacted records into a snapshot in order of height, each repeating
+// event followed by its repeat record.
+//
+// order: indices of the events in compact, sorted by height.
+//
+static void bsky_snapshot_fill(
+        struct BSKY_SnapshotHeader * snapshot,
+        const struct BSKY_AgendaEvent * compact,
+        int32_t compact_length,
+        const int16_t * order,
+        int32_t order_length) {
+    snapshot->events_length = compact_length;
+    struct BSKY_AgendaEvent * out = (struct BSKY_AgendaEvent *) (snapshot + 1);
+    for (int32_t i=0; i<order_length; ++i) {
+        const int32_t ievent = order[i];
+        *out++ = compact[ievent];
+        if (ievent+1 < compact_length
+                && bsky_agenda_is_repeat(&compact[ievent+1])) {
+            *out++ = compact[ievent+1];
+        }
+    }
+}
+
+struct BSKY_SnapshotHeader * bsky_snapshot_build(
+        const struct BSKY_AgendaEvent * events,
+        int32_t events_length,
+        int32_t version,
+        int32_t raw_epoch,
+        time_t now,
+        size_t * length_bytes) {
+    *length_bytes = 0;
+
+    // TODO: fix this in the remote code by always rounding epoch down to the
+    // minute.
+    int32_t epoch = raw_epoch;
+    if (epoch % 60) {
+        epoch += 60 - epoch % 60;
+    }
+    // Nothing can be over yet if now is before the epoch.
+    int32_t now_minutes = now > epoch ? (now - epoch) / 60 : INT16_MIN;
+    if (now_minutes > INT16_MAX) {
+        now_minutes = INT16_MAX;
+    }
+
+    struct BSKY_AgendaEvent * compact
+        = malloc(events_length * sizeof(compact[0]) + 1);
+    int16_t * order = malloc(events_length * sizeof(order[0]) + 1);
+    if (!compact || !order) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_snapshot_build: malloc failed for %ld events",
+                events_length);
+        free(order);
+        free(compact);
+        return NULL;
+    }
+
+    const int32_t compact_length
+        = bsky_snapshot_compact(events, events_length, now_minutes, compact);
+    int32_t order_length = 0;
+    for (int32_t i=0; i<compact_length; ++i) {
+        if (!bsky_agenda_is_repeat(&compact[i])) {
+            order[order_length++] = i;
+        }
+    }
+    cmp_snapshot_events_by_height_events = compact;
+    qsort(order, order_length, sizeof(order[0]), cmp_snapshot_events_by_height);
+    cmp_snapshot_events_by_height_events = NULL;
+
+    const size_t length = sizeof(struct BSKY_SnapshotHeader)
+        + compact_length * sizeof(compact[0]);
+    struct BSKY_SnapshotHeader * snapshot = malloc(length);
+    if (!snapshot) {
+        APP_LOG(APP_LOG_LEVEL_ERROR,
+                "bsky_snapshot_build: malloc failed for %u bytes",
+                length);
+    } else {
+        bsky_snapshot_fill(snapshot, compact, compact_length, order, order_length);
+        snapshot->version = version;
+        snapshot->raw_epoch = raw_epoch;
+        snapshot->epoch = epoch;
+        *length_bytes = length;
+        APP_LOG(APP_LOG_LEVEL_DEBUG,
+                "bsky_snapshot_build: kept %ld of %ld records",
+                compact_length,
+                events_length);
+    }
+    free(order);
+    free(compact);
+    return snapshot;
+}
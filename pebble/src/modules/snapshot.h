@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "agenda.h"
+
+// A snapshot is an agenda that has been prepared for drawing: its epoch is
+// normalized to a whole minute, events that are entirely over are dropped,
+// repeating events are advanced to their first instance that isn't over, and
+// events are ordered by height.  The app expands a snapshot into instances
+// sorted by start when installing it; see struct BSKY_Agenda.
+//
+// Snapshots are built by the background worker when the user has chosen it
+// as their background app and it is running, and by the app itself when it
+// isn't, then persisted so that a cold start can use them as they are.  Either
+// way the app still receives, persists and holds the whole agenda.  This file is compiled into both; see
+// ../../worker_src/bluesky_worker.c.
+//
+// A snapshot is a header followed by events_length agenda records.
+//
+struct BSKY_SnapshotHeader {
+
+    // BSKY_DATAKEY_AGENDA_VERSION of the agenda this was built from.
+    //
+    int32_t version;
+
+    // BSKY_DATAKEY_AGENDA_EPOCH of the agenda this was built from.
+    //
+    int32_t raw_epoch;
+
+    // The epoch for the records in this snapshot.
+    //
+    int32_t epoch;
+
+    int32_t events_length;
+};
+
+// Store key for the persisted snapshot, chosen well clear of the data keys.
+//
+#define BSKY_SNAPSHOT_STORE_KEY 0x80
+
+// AppWorkerMessage types.  Both carry an agenda version split across data0
+// (low 16 bits) and data1 (high 16 bits).
+//
+enum BSKY_SnapshotMessage {
+
+    // App to worker: the agenda with this version has been persisted, please
+    // build a snapshot from it.  Only sent to a worker that is already
+    // running, since the app never launches one.
+    //
+    BSKY_SNAPSHOT_MSG_BUILD = 1,
+
+    // Worker to app: the snapshot for this version has been persisted.
+    //
+    BSKY_SNAPSHOT_MSG_READY = 2,
+};
+
+// Build a snapshot.
+//
+// events, events_length: the agenda as received.
+// version, raw_epoch: as received along with the agenda.
+// now: events that are over by this time are dropped.
+// length_bytes: the address where the size of the snapshot will be written.
+//
+// Returns: a snapshot allocated with malloc, or NULL.
+//
+struct BSKY_SnapshotHeader * bsky_snapshot_build(
+        const struct BSKY_AgendaEvent * events,
+        int32_t events_length,
+        int32_t version,
+        int32_t raw_epoch,
+        time_t now,
+        size_t * length_bytes);
+
+// The records following a snapshot's header.
+//
+static inline const struct BSKY_AgendaEvent * bsky_snapshot_events(
+        const struct BSKY_SnapshotHeader * snapshot) {
+    return (const struct BSKY_AgendaEvent *) (snapshot + 1);
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BSKY_WORKER
+#include <pebble.h>
+#endif
+
+#include "store.h"
+
+#define BSKY_STORE_VERSION 1
+
+// Persist key for the header (slot 0) or a page (slot 1 and up) of a value.
+//
+#define BSKY_STORE_PERSIST_KEY(key, slot) \
+    (0x10000 + ((uint32_t)(key) << 8) + (slot))
+
+struct BSKY_StoreHeader {
+    uint8_t version;
+    uint8_t page_count;
+    uint16_t length_bytes;
+    uint32_t checksum;
+    uint32_t page_checksums [BSKY_STORE_MAX_PAGES];
+};
+
+// Bytes of a header that are actually stored for a given number of pages.
+//
+#define BSKY_STORE_HEADER_BYTES(page_count) \
+    (offsetof(struct BSKY_StoreHeader, page_checksums) \
+     + (page_count) * sizeof(uint32_t))
+
+// 32-bit FNV-1a.
+//
+static uint32_t bsky_store_checksum(const void * data, size_t length_bytes) {
+    const uint8_t * bytes = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<length_bytes; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Read and sanity check the header of a value.
+//
+// Returns true if and only if a usable header was read.
+//
+static bool bsky_store_read_header(
+        uint32_t key,
+        struct BSKY_StoreHeader * header) {
+    const uint32_t header_key = BSKY_STORE_PERSIST_KEY(key, 0);
+    memset(header, 0, sizeof(*header));
+    if (!persist_exists(header_key)) {
+        return false;
+    }
+    const int size = persist_get_size(header_key);
+    if (size < (int)BSKY_STORE_HEADER_BYTES(0)
+            || size > (int)sizeof(*header)) {
+        return false;
+    }
+    persist_read_data(header_key, header, size);
+    return header->version == BSKY_STORE_VERSION
+        && header->page_count <= BSKY_STORE_MAX_PAGES
+        && size == (int)BSKY_STORE_HEADER_BYTES(header->page_count)
+        && header->length_bytes <= header->page_count * BSKY_STORE_PAGE_BYTES;
+}
+
+bool bsky_store_write(uint32_t key, const void * data, size_t length_bytes) {
+    if (length_bytes > BSKY_STORE_MAX_BYTES) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_store_write: %lu is too large (%u bytes)",
+                key,
+                length_bytes);
+        return false;
+    }
+
+    struct BSKY_StoreHeader old_header;
+    if (!bsky_store_read_header(key, &old_header)) {
+        old_header.page_count = 0;
+    }
+
+    struct BSKY_StoreHeader header = {
+        .version = BSKY_STORE_VERSION,
+        .page_count
+            = (length_bytes + BSKY_STORE_PAGE_BYTES - 1)
+            / BSKY_STORE_PAGE_BYTES,
+        .length_bytes = length_bytes,
+        .checksum = bsky_store_checksum(data, length_bytes),
+    };
+
+    const uint8_t * bytes = data;
+    int pages_written = 0;
+    for (int page=0; page<header.page_count; ++page) {
+        const size_t offset = page * BSKY_STORE_PAGE_BYTES;
+        const size_t page_bytes
+            = length_bytes - offset < BSKY_STORE_PAGE_BYTES
+            ? length_bytes - offset
+            : BSKY_STORE_PAGE_BYTES;
+        const uint32_t page_key = BSKY_STORE_PERSIST_KEY(key, 1 + page);
+        header.page_checksums[page]
+            = bsky_store_checksum(bytes + offset, page_bytes);
+        const bool unchanged
+            = page < old_header.page_count
+            && old_header.page_checksums[page] == header.page_checksums[page]
+            && persist_get_size(page_key) == (int)page_bytes;
+        if (unchanged) {
+            continue;
+        }
+        const int written
+            = persist_write_data(page_key, bytes + offset, page_bytes);
+        if (written != (int)page_bytes) {
+            APP_LOG(APP_LOG_LEVEL_ERROR,
+                    "bsky_store_write: %lu page %d: wrote %d of %u bytes",
+                    key,
+                    page,
+                    written,
+                    page_bytes);
+            return false;
+        }
+        ++pages_written;
+    }
+
+    for (int page=header.page_count; page<old_header.page_count; ++page) {
+        persist_delete(BSKY_STORE_PERSIST_KEY(key, 1 + page));
+    }
+
+    persist_write_data(
+            BSKY_STORE_PERSIST_KEY(key, 0),
+            &header,
+            BSKY_STORE_HEADER_BYTES(header.page_count));
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "bsky_store_write: %lu: %u bytes, rewrote %d of %d pages",
+            key,
+            length_bytes,
+            pages_written,
+            header.page_count);
+    return true;
+}
+
+bool bsky_store_read(
+        uint32_t key,
+        void * buffer,
+        size_t capacity_bytes,
+        size_t * length_bytes) {
+    *length_bytes = 0;
+    struct BSKY_StoreHeader header;
+    if (!bsky_store_read_header(key, &header)) {
+        return false;
+    }
+    if (header.length_bytes > capacity_bytes) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_store_read: %lu is too large (%u bytes)",
+                key,
+                header.length_bytes);
+        return false;
+    }
+
+    uint8_t * bytes = buffer;
+    for (int page=0; page<header.page_count; ++page) {
+        const size_t offset = page * BSKY_STORE_PAGE_BYTES;
+        const size_t page_bytes
+            = header.length_bytes - offset < BSKY_STORE_PAGE_BYTES
+            ? header.length_bytes - offset
+            : BSKY_STORE_PAGE_BYTES;
+        const int read = persist_read_data(
+                BSKY_STORE_PERSIST_KEY(key, 1 + page),
+                bytes + offset,
+                page_bytes);
+        if (read != (int)page_bytes) {
+            APP_LOG(APP_LOG_LEVEL_WARNING,
+                    "bsky_store_read: %lu page %d is missing",
+                    key,
+                    page);
+            return false;
+        }
+    }
+
+    if (bsky_store_checksum(buffer, header.length_bytes) != header.checksum) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_store_read: %lu failed its checksum",
+                key);
+        return false;
+    }
+    *length_bytes = header.length_bytes;
+    return true;
+}
+
+size_t bsky_store_length(uint32_t key) {
+    struct BSKY_StoreHeader header;
+    return bsky_store_read_header(key, &header) ? header.length_bytes : 0;
+}
+
+void bsky_store_delete(uint32_t key) {
+    struct BSKY_StoreHeader header;
+    const int page_count
+        = bsky_store_read_header(key, &header)
+        ? header.page_count
+        : BSKY_STORE_MAX_PAGES;
+    persist_delete(BSKY_STORE_PERSIST_KEY(key, 0));
+    for (int page=0; page<page_count; ++page) {
+        persist_delete(BSKY_STORE_PERSIST_KEY(key, 1 + page));
+    }
+}
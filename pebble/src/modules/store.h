@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Paged persistent storage for values larger than a single persisted value.
+//
+// Pebble caps each persisted value at PERSIST_DATA_MAX_LENGTH bytes, so a
+// stored value is split into pages of that size, each under its own persist
+// key, plus a small header recording the format version, page count, length
+// and checksums.  Writing a value only rewrites the pages whose contents
+// changed, then the header.  Since the header is written last, a partial write
+// is detected by the checksum on the next read and treated as no value at all.
+//
+// Store keys share a number space with data keys but not persist keys: the
+// persist keys used for a store key never collide with data keys, so both can
+// be used for the same key number.
+
+#define BSKY_STORE_PAGE_BYTES PERSIST_DATA_MAX_LENGTH
+
+// Pebble allows 4 KB of persistent storage per app in total, so there is no
+// point allowing values larger than that.
+//
+#define BSKY_STORE_MAX_PAGES 16
+#define BSKY_STORE_MAX_BYTES (BSKY_STORE_PAGE_BYTES * BSKY_STORE_MAX_PAGES)
+
+// Persist a value, rewriting only the pages that changed.
+//
+// Returns true if and only if the whole value was written.
+//
+bool bsky_store_write(uint32_t key, const void * data, size_t length_bytes);
+
+// Read a value back.
+//
+// buffer: where to put the value, at least capacity_bytes long.
+// length_bytes: the address where the length of the value will be written.
+//
+// Returns true if and only if a complete, intact value was read.
+//
+bool bsky_store_read(
+        uint32_t key,
+        void * buffer,
+        size_t capacity_bytes,
+        size_t * length_bytes);
+
+// Get the length of a stored value, for sizing a buffer to read it into.
+//
+// Returns: the length in bytes, or 0 if there is no value.
+//
+size_t bsky_store_length(uint32_t key);
+
+// Remove a value and all of its pages.
+//
+void bsky_store_delete(uint32_t key);
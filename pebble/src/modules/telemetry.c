@@ -0,0 +1,188 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "data.h"
+#include "memory.h"
+#include "telemetry.h"
+
+static uint16_t s_counters [BSKY_TELEMETRY_COUNTER_MAX];
+static uint16_t s_renders;
+static uint16_t s_render_ms_max;
+static uint32_t s_render_ms_total;
+
+// When the current record began.
+//
+static time_t s_record_start;
+
+// What went into the record attached to the message in the outbox, to be
+// taken off the current record once the phone has it.
+//
+static bool s_attached;
+static time_t s_attached_at;
+static uint16_t s_attached_counters [BSKY_TELEMETRY_COUNTER_MAX];
+static uint16_t s_attached_renders;
+static uint32_t s_attached_render_ms_total;
+
+// The slowest render since the record was attached.
+//
+static uint16_t s_render_ms_max_since_attached;
+
+static AppTimer * s_timer;
+
+static uint16_t bsky_telemetry_saturate(uint32_t value) {
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+static uint8_t * bsky_telemetry_put16(uint8_t * out, uint16_t value) {
+    out[0] = value & 0xff;
+    out[1] = value >> 8;
+    return out + 2;
+}
+
+static void bsky_telemetry_reset(time_t now) {
+    memset(s_counters, 0, sizeof(s_counters));
+    s_renders = 0;
+    s_render_ms_max = 0;
+    s_render_ms_total = 0;
+    s_record_start = now;
+    s_attached = false;
+    s_render_ms_max_since_attached = 0;
+}
+
+// Whether the current record has anything worth reporting.
+//
+static bool bsky_telemetry_pending(void) {
+    bool pending = s_renders > 0;
+    for (int i=0; i<BSKY_TELEMETRY_COUNTER_MAX; ++i) {
+        pending = pending || s_counters[i] > 0;
+    }
+    return pending;
+}
+
+static void bsky_telemetry_timer_callback(void * context);
+
+// (Re)start the countdown to the next stand-alone telemetry message.
+//
+static void bsky_telemetry_arm(void) {
+    const uint32_t timeout_ms
+        = BSKY_TELEMETRY_INTERVAL_HOURS * SECONDS_PER_HOUR * 1000;
+    if (!s_timer || !app_timer_reschedule(s_timer, timeout_ms)) {
+        s_timer = app_timer_register(
+                timeout_ms,
+                bsky_telemetry_timer_callback,
+                NULL);
+    }
+}
+
+// Matches AppTimerCallback.
+//
+static void bsky_telemetry_timer_callback(void * context) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_telemetry_timer_callback");
+    s_timer = NULL;
+    if (bsky_telemetry_pending()) {
+        // Sending calls bsky_telemetry_attach, which re-arms the timer.
+        bsky_data_send_outgoing();
+    }
+    if (!s_timer) {
+        bsky_telemetry_arm();
+    }
+}
+
+void bsky_telemetry_init(void) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_telemetry_init()");
+    bsky_telemetry_reset(time(NULL));
+    bsky_telemetry_arm();
+}
+
+void bsky_telemetry_deinit(void) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_telemetry_deinit()");
+    if (s_timer) {
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+}
+
+void bsky_telemetry_count(enum BSKY_TelemetryCounter counter) {
+    if (counter < BSKY_TELEMETRY_COUNTER_MAX
+            && s_counters[counter] < UINT16_MAX) {
+        ++s_counters[counter];
+    }
+}
+
+void bsky_telemetry_render(uint16_t milliseconds) {
+    if (s_renders < UINT16_MAX) {
+        ++s_renders;
+        s_render_ms_total += milliseconds;
+    }
+    if (milliseconds > s_render_ms_max) {
+        s_render_ms_max = milliseconds;
+    }
+    if (milliseconds > s_render_ms_max_since_attached) {
+        s_render_ms_max_since_attached = milliseconds;
+    }
+}
+
+void bsky_telemetry_attach(void) {
+    s_attached = false;
+    if (!bsky_telemetry_pending()) {
+        return;
+    }
+    const time_t now = time(NULL);
+
+    uint8_t record [BSKY_TELEMETRY_RECORD_BYTES];
+    uint8_t * out = record;
+    *out++ = BSKY_TELEMETRY_VERSION;
+    *out++ = 0;
+    out = bsky_telemetry_put16(out, bsky_telemetry_saturate(
+                (now - s_record_start) / SECONDS_PER_MINUTE));
+    out = bsky_telemetry_put16(out, s_counters[BSKY_TELEMETRY_INBOX_DROPPED]);
+    out = bsky_telemetry_put16(out, s_counters[BSKY_TELEMETRY_OUTBOX_FAILED]);
+    out = bsky_telemetry_put16(out, s_counters[BSKY_TELEMETRY_AGENDA_RELOADS]);
+    out = bsky_telemetry_put16(out, s_renders);
+    out = bsky_telemetry_put16(out, s_render_ms_max);
+    out = bsky_telemetry_put16(out, s_renders
+            ? s_render_ms_total / s_renders
+            : 0);
+    out = bsky_telemetry_put16(out, bsky_telemetry_saturate(
+                bsky_memory_min_free()));
+    bsky_data_set_outgoing_bytes(BSKY_DATAKEY_TELEMETRY, record, sizeof(record));
+    APP_LOG(APP_LOG_LEVEL_INFO, "bsky_telemetry_attach: attached record");
+
+    s_attached = true;
+    s_attached_at = now;
+    memcpy(s_attached_counters, s_counters, sizeof(s_counters));
+    s_attached_renders = s_renders;
+    s_attached_render_ms_total = s_render_ms_total;
+    s_render_ms_max_since_attached = 0;
+    bsky_telemetry_arm();
+}
+
+void bsky_telemetry_sent(void) {
+    if (!s_attached) {
+        return;
+    }
+    // Whatever happened while the message was in flight starts the next
+    // record.
+    for (int i=0; i<BSKY_TELEMETRY_COUNTER_MAX; ++i) {
+        s_counters[i] -= s_attached_counters[i];
+    }
+    s_renders -= s_attached_renders;
+    s_render_ms_total -= s_attached_render_ms_total;
+    s_render_ms_max = s_render_ms_max_since_attached;
+    s_record_start = s_attached_at;
+    s_attached = false;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Health telemetry, batched into a compact record that is sent to the phone
+// as BSKY_DATAKEY_TELEMETRY.
+//
+// The record piggybacks on any other outgoing message.  When there are none,
+// it is sent on its own at most once every BSKY_TELEMETRY_INTERVAL_HOURS.
+//
+// Record layout, all fields little-endian:
+//
+//     uint8   version (BSKY_TELEMETRY_VERSION)
+//     uint8   reserved, zero
+//     uint16  minutes covered by this record
+//     uint16  inbox messages dropped
+//     uint16  outbox messages failed
+//     uint16  agenda reloads
+//     uint16  sky layer renders
+//     uint16  slowest render, milliseconds
+//     uint16  mean render, milliseconds
+//     uint16  least free heap seen, bytes (saturated)
+//
+// Counters saturate rather than wrap.
+
+#define BSKY_TELEMETRY_VERSION 1
+#define BSKY_TELEMETRY_RECORD_BYTES 18
+#define BSKY_TELEMETRY_INTERVAL_HOURS 6
+
+enum BSKY_TelemetryCounter {
+    BSKY_TELEMETRY_INBOX_DROPPED,
+    BSKY_TELEMETRY_OUTBOX_FAILED,
+    BSKY_TELEMETRY_AGENDA_RELOADS,
+    BSKY_TELEMETRY_COUNTER_MAX,
+};
+
+// Start the periodic telemetry timer.
+//
+void bsky_telemetry_init(void);
+
+// Stop the periodic telemetry timer.
+//
+void bsky_telemetry_deinit(void);
+
+// Count one occurrence of something.
+//
+void bsky_telemetry_count(enum BSKY_TelemetryCounter counter);
+
+// Record how long one render of the sky layer took.
+//
+void bsky_telemetry_render(uint16_t milliseconds);
+
+// Hand the current record to the data module as an outgoing value if there
+// is anything worth reporting.
+//
+// Called by the data module just before it sends a message.
+//
+void bsky_telemetry_attach(void);
+
+// Start a new record, now that the phone has the one last attached.  Until
+// then the counts keep adding up, so that a message that fails to send loses
+// nothing.
+//
+// Called by the data module when a message is acknowledged.
+//
+void bsky_telemetry_sent(void);
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "tick.h"
+
+static void bsky_tick_fill(
+        struct BSKY_Tick * tick,
+        time_t unix_time,
+        const struct tm * wall_time) {
+    tick->unix_time = unix_time;
+    tick->wall_time = *wall_time;
+    tick->minute_of_day
+        = wall_time->tm_hour * MINUTES_PER_HOUR
+        + wall_time->tm_min;
+    tick->start_of_day
+        = tick->unix_time
+        - tick->minute_of_day * SECONDS_PER_MINUTE
+        - wall_time->tm_sec;
+}
+
+void bsky_tick_from_wall_time(
+        struct BSKY_Tick * tick,
+        const struct tm * wall_time) {
+    bsky_tick_fill(tick, time(NULL), wall_time);
+}
+
+void bsky_tick_now(struct BSKY_Tick * tick) {
+    const time_t now = time(NULL);
+    bsky_tick_fill(tick, now, localtime(&now));
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// A snapshot of the time, computed once per tick and shared by every module
+// that needs to know what time it is so that none of them need to call
+// time() or localtime() for themselves.
+//
+struct BSKY_Tick {
+
+    // The "absolute" moment.
+    //
+    time_t unix_time;
+
+    // The timezone-local moment.
+    //
+    struct tm wall_time;
+
+    // The "absolute" moment at which the current local day began.
+    //
+    time_t start_of_day;
+
+    // Minutes elapsed since start_of_day, which is the position of this tick
+    // within the daily cycle shown on the face.
+    //
+    int32_t minute_of_day;
+};
+
+// Fill a tick from a timezone-local time, such as the one passed to a
+// TickHandler.
+//
+void bsky_tick_from_wall_time(
+        struct BSKY_Tick * tick,
+        const struct tm * wall_time);
+
+// Fill a tick with the current time.
+//
+// Prefer bsky_tick_from_wall_time where a local time is already available.
+//
+void bsky_tick_now(struct BSKY_Tick * tick);
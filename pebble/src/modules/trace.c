@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble.h>
+
+#include "data.h"
+#include "trace.h"
+
+// The trace goes out as a single BSKY_DATAKEY_AGENDA_TRACE value.
+//
+_Static_assert(
+        BSKY_TRACE_RECORD_BYTES <= BSKY_DATA_AGENDA_TRACE_MAX_BYTES,
+        "trace record larger than data_keys.json allows");
+
+#define BSKY_TRACE_UNSEEN UINT16_MAX
+
+// Whether an update is being traced.
+//
+static bool s_open;
+
+// When the update arrived, in milliseconds.
+//
+static int64_t s_arrived_ms;
+
+static int32_t s_version;
+static uint16_t s_stages [BSKY_TRACE_STAGE_MAX];
+
+// Scheduled call to bsky_trace_send, or NULL.
+//
+static AppTimer * s_send_timer;
+
+static int64_t bsky_trace_now_ms(void) {
+    time_t seconds;
+    uint16_t milliseconds;
+    time_ms(&seconds, &milliseconds);
+    return (int64_t) seconds * 1000 + milliseconds;
+}
+
+static uint8_t * bsky_trace_put16(uint8_t * out, uint16_t value) {
+    out[0] = value & 0xff;
+    out[1] = value >> 8;
+    return out + 2;
+}
+
+// Send the finished trace.
+//
+// Matches AppTimerCallback.  Sent from a timer rather than from within the
+// render that finished the trace.
+//
+static void bsky_trace_send(void * context) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "bsky_trace_send");
+    s_send_timer = NULL;
+    bsky_data_send_outgoing();
+}
+
+// Hand the record to the data module and arrange for it to be sent.
+//
+static void bsky_trace_finish(void) {
+    uint8_t record [BSKY_TRACE_RECORD_BYTES];
+    uint8_t * out = record;
+    *out++ = BSKY_TRACE_VERSION;
+    *out++ = 0;
+    out = bsky_trace_put16(out, (uint32_t) s_version & 0xffff);
+    out = bsky_trace_put16(out, (uint32_t) s_version >> 16);
+    for (int i=0; i<BSKY_TRACE_STAGE_MAX; ++i) {
+        out = bsky_trace_put16(out, s_stages[i]);
+    }
+    bsky_data_set_outgoing_bytes(
+            BSKY_DATAKEY_AGENDA_TRACE,
+            record,
+            sizeof(record));
+    APP_LOG(APP_LOG_LEVEL_INFO,
+            "bsky_trace_finish: version %ld persisted %u reloaded %u drawn %u",
+            s_version,
+            s_stages[BSKY_TRACE_PERSISTED],
+            s_stages[BSKY_TRACE_RELOADED],
+            s_stages[BSKY_TRACE_DRAWN]);
+    s_open = false;
+    if (!s_send_timer) {
+        s_send_timer = app_timer_register(1, bsky_trace_send, NULL);
+    }
+}
+
+void bsky_trace_begin(void) {
+    s_open = true;
+    s_arrived_ms = bsky_trace_now_ms();
+    s_version = 0;
+    for (int i=0; i<BSKY_TRACE_STAGE_MAX; ++i) {
+        s_stages[i] = BSKY_TRACE_UNSEEN;
+    }
+}
+
+void bsky_trace_mark(enum BSKY_TraceStage stage, int32_t version) {
+    if (!s_open
+            || stage >= BSKY_TRACE_STAGE_MAX
+            || s_stages[stage] != BSKY_TRACE_UNSEEN) {
+        return;
+    }
+    if (stage == BSKY_TRACE_DRAWN
+            && (s_stages[BSKY_TRACE_RELOADED] == BSKY_TRACE_UNSEEN
+                || version != s_version)) {
+        // Still drawing the agenda from before the update.
+        return;
+    }
+    if (version) {
+        s_version = version;
+    }
+    const int64_t elapsed_ms = bsky_trace_now_ms() - s_arrived_ms;
+    s_stages[stage] = elapsed_ms < 0 || elapsed_ms >= BSKY_TRACE_UNSEEN
+        ? BSKY_TRACE_UNSEEN
+        : elapsed_ms;
+    if (stage == BSKY_TRACE_DRAWN) {
+        bsky_trace_finish();
+    }
+}
+
+void bsky_trace_deinit(void) {
+    s_open = false;
+    if (s_send_timer) {
+        app_timer_cancel(s_send_timer);
+        s_send_timer = NULL;
+    }
+}
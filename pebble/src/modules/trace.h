@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Latency tracing for agenda updates, from the message arriving to the first
+// render that shows it.
+//
+// Each stage is stamped in milliseconds after the agenda or patch arrived.
+// Once the update has been drawn, the stages are sent to the phone as
+// BSKY_DATAKEY_AGENDA_TRACE, where they are matched by agenda version with
+// the phone's own stages: AppMessage doesn't tell the watch the phone's
+// transaction ids.
+//
+// Record layout, all fields little-endian:
+//
+//     uint8   version (BSKY_TRACE_VERSION)
+//     uint8   reserved, zero
+//     int32   agenda version
+//     uint16  persisted, milliseconds after arrival
+//     uint16  reloaded, milliseconds after arrival
+//     uint16  drawn, milliseconds after arrival
+//
+// A stage that wasn't seen, or took over a minute, reads as UINT16_MAX.
+
+#define BSKY_TRACE_VERSION 1
+#define BSKY_TRACE_RECORD_BYTES 12
+
+enum BSKY_TraceStage {
+    // The new agenda has been written to storage.
+    BSKY_TRACE_PERSISTED,
+    // The new agenda has been installed, see bsky_agenda_read.
+    BSKY_TRACE_RELOADED,
+    // The sky layer has drawn the new agenda.
+    BSKY_TRACE_DRAWN,
+    BSKY_TRACE_STAGE_MAX,
+};
+
+// Start tracing an update: an agenda or patch has just arrived.  A trace
+// still open is abandoned.
+//
+void bsky_trace_begin(void);
+
+// Stamp a stage of the update being traced, unless it has been already.
+//
+// version: the agenda version the stage was reached with, or zero if not yet
+// known.  BSKY_TRACE_DRAWN only counts for the version that was reloaded, and
+// completes the trace.
+//
+void bsky_trace_mark(enum BSKY_TraceStage stage, int32_t version);
+
+// Stop tracing, dropping any open trace.
+//
+void bsky_trace_deinit(void);
@@ -15,8 +15,12 @@
  */
 #include <pebble.h>
 
-#include "modules/palette.h"
+#include "modules/agenda.h"
+#include "modules/clock_layer.h"
+#include "modules/data.h"
+#include "modules/memory.h"
 #include "modules/sky_layer.h"
+#include "modules/tick.h"
 
 static Window *s_main_window;
 
@@ -24,59 +28,97 @@ static Window *s_main_window;
 // Operations over layers are always in the same order except while
 // unloading the main window, when the order is reversed.
 static BSKY_SkyLayer *s_sky_layer;
-static TextLayer *s_time_layer;
-static TextLayer *s_date_layer;
-
-static void sprint_error(char * buffer, size_t n) {
-    static const char generic_error[] = "!ERROR";
-    memset(buffer, 0, n);
-    for (size_t i=0; i<n-1; ++i) {
-        buffer[i] = generic_error[i];
+static BSKY_ClockLayer *s_clock_layer;
+static TextLayer *s_countdown_layer;
+
+// Don't count down to anything further away than this.
+//
+#define COUNTDOWN_MAX_MINUTES (12 * MINUTES_PER_HOUR)
+
+// Describe how long until the user is next busy, or next free, such as
+// "next 12m", "free 2h" or "next 1h59m", or leave the buffer empty if there's
+// nothing soon enough to count down to.
+//
+static void sprint_countdown(
+        char * buffer,
+        size_t n,
+        const struct BSKY_AgendaMoment * moment) {
+    buffer[0] = '\0';
+    const time_t until
+        = moment->current_count ? moment->free_at : moment->next_start;
+    if (!until) {
+        return;
+    }
+    // Round up, so that "next 1m" is the last minute before it starts.
+    const int32_t minutes
+        = (until - moment->time + SECONDS_PER_MINUTE - 1) / SECONDS_PER_MINUTE;
+    if (minutes > COUNTDOWN_MAX_MINUTES) {
+        return;
+    }
+    const char * label = moment->current_count ? "free" : "next";
+    const long hours = minutes / MINUTES_PER_HOUR;
+    const long rest = minutes % MINUTES_PER_HOUR;
+    if (!hours) {
+        snprintf(buffer, n, "%s %ldm", label, rest);
+    } else if (!rest) {
+        snprintf(buffer, n, "%s %ldh", label, hours);
+    } else {
+        snprintf(buffer, n, "%s %ldh%02ldm", label, hours, rest);
     }
 }
 
-static void update_time() {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "update_time()");
-    const time_t now = time(NULL);
-    const struct tm *local_now = localtime(&now);
-
-    bsky_sky_layer_set_time(s_sky_layer, now);
-
-    // 6 characters is enough in my locale, but 7 are necessary to hold
-    // the generic_error message that will be displayed in case the
-    // buffer isn't large enough after all.
-    static char s_time_buffer[7];
-    if (0 == strftime(s_time_buffer,
-                sizeof(s_time_buffer),
-                clock_is_24h_style() ? "%H:%M" : "%l:%M",
-                local_now)) {
-        sprint_error(s_time_buffer, sizeof(s_time_buffer));
+// Show the countdown for the given tick.
+//
+// The text layer is only touched when the text changes, since setting its
+// text marks it dirty and so redraws the sky layer underneath as well.
+//
+static void update_countdown(const struct BSKY_Tick * tick) {
+    // Room for the longest countdown, "free 11h59m".
+    static char s_countdown_buffer[12];
+    char countdown[sizeof(s_countdown_buffer)];
+    if (bsky_data_int(BSKY_DATAKEY_FACE_COUNTDOWN)
+            == BSKY_DATA_FACE_COUNTDOWN_HIDDEN) {
+        countdown[0] = '\0';
+    } else {
+        sprint_countdown(
+                countdown,
+                sizeof(countdown),
+                bsky_agenda_moment(tick->unix_time));
     }
-    // Trim leading space character (output by "%l")
-    char * time_str = s_time_buffer;
-    if (*time_str==' ') { time_str++; }
-    text_layer_set_text(s_time_layer, time_str);
-
-    static char s_date_buffer[7];
-    if (0 == strftime(s_date_buffer,
-                sizeof(s_date_buffer),
-                "%a %d",
-                local_now)) {
-        sprint_error(s_date_buffer, sizeof(s_date_buffer));
+    if (0 == strcmp(countdown, s_countdown_buffer)) {
+        return;
     }
-    text_layer_set_text(s_date_layer, s_date_buffer);
+    strcpy(s_countdown_buffer, countdown);
+    text_layer_set_text(s_countdown_layer, s_countdown_buffer);
+    layer_set_hidden(
+            text_layer_get_layer(s_countdown_layer),
+            !s_countdown_buffer[0]);
+}
+
+// Bring every time-dependent layer up to date with the given tick.
+//
+static void update_time(const struct BSKY_Tick * tick) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "update_time()");
+    bsky_sky_layer_set_time(s_sky_layer, tick);
+    bsky_clock_layer_set_time(s_clock_layer, tick);
+    update_countdown(tick);
 }
 
 static void tick_handler(
         struct tm *tick_time,
         TimeUnits units_changed) {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "tick_handler()");
-    // Here we could forward tick_time to avoid having to recompute the
-    // local time in update_time, but we may very well want to call
-    // update_time in other contexts where we don't have an appropriate
-    // value to pass in.  Therefore, update_time will ultimately have to
-    // be responsible for computing the local time anyway.
-    update_time();
+    struct BSKY_Tick tick;
+    bsky_tick_from_wall_time(&tick, tick_time);
+    update_time(&tick);
+}
+
+// Count down to the new agenda straight away rather than on the next tick.
+//
+static void agenda_update(void * context) {
+    struct BSKY_Tick tick;
+    bsky_tick_now(&tick);
+    update_countdown(&tick);
 }
 
 static void main_window_load(Window *window) {
@@ -89,48 +131,41 @@ static void main_window_load(Window *window) {
             window_layer,
             bsky_sky_layer_get_layer(s_sky_layer));
 
-    // TODO: I'm not sure what I'm doing with fonts here.  How should a
-    // font be selected?  How should the layers be positioned and sized?
-    // At this point it's all just guess work and "good enough" results.
-
-    s_time_layer = text_layer_create(
-            GRect(0, bounds.size.h/2-23, bounds.size.w, 40));
-    text_layer_set_background_color(
-            s_time_layer,
-            GColorClear);
-    text_layer_set_font(
-            s_time_layer,
-            fonts_get_system_font(FONT_KEY_BITHAM_34_MEDIUM_NUMBERS));
-    text_layer_set_text_alignment(
-            s_time_layer,
-            GTextAlignmentCenter);
-    text_layer_set_text_color(
-            s_time_layer,
-            BSKY_PALETTE_SUN_DARK);
-    layer_add_child(window_layer, text_layer_get_layer(s_time_layer));
+    s_clock_layer = bsky_clock_layer_create(bounds);
+    layer_add_child(
+            window_layer,
+            bsky_clock_layer_get_layer(s_clock_layer));
 
-    s_date_layer = text_layer_create(GRect(0, bounds.size.h/2-38, bounds.size.w, 26));
+    // Narrow enough to stay within the cloud below the time.
+    s_countdown_layer = text_layer_create(
+            GRect(bounds.size.w/4, bounds.size.h/2+15, bounds.size.w/2, 18));
     text_layer_set_background_color(
-            s_date_layer,
+            s_countdown_layer,
             GColorClear);
     text_layer_set_font(
-            s_date_layer,
-            fonts_get_system_font(FONT_KEY_ROBOTO_CONDENSED_21));
+            s_countdown_layer,
+            fonts_get_system_font(FONT_KEY_GOTHIC_14));
     text_layer_set_text_alignment(
-            s_date_layer,
+            s_countdown_layer,
             GTextAlignmentCenter);
     text_layer_set_text_color(
-            s_date_layer,
+            s_countdown_layer,
             GColorBlack);
-    layer_add_child(window_layer, text_layer_get_layer(s_date_layer));
+    layer_set_hidden(text_layer_get_layer(s_countdown_layer), true);
+    layer_add_child(window_layer, text_layer_get_layer(s_countdown_layer));
+
+    bsky_agenda_subscribe(agenda_update, NULL);
+
+    bsky_memory_checkpoint("main_window_load");
 }
 
 static void main_window_unload(Window *window) {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "main_window_load(%p)", window);
-    text_layer_destroy(s_date_layer);
-    s_date_layer = NULL;
-    text_layer_destroy(s_time_layer);
-    s_time_layer = NULL;
+    bsky_agenda_unsubscribe(agenda_update, NULL);
+    text_layer_destroy(s_countdown_layer);
+    s_countdown_layer = NULL;
+    bsky_clock_layer_destroy(s_clock_layer);
+    s_clock_layer = NULL;
     bsky_sky_layer_destroy(s_sky_layer);
     s_sky_layer = NULL;
     window_destroy(s_main_window);
@@ -152,5 +187,7 @@ void main_window_push() {
 
     window_stack_push(s_main_window, true);
 
-    update_time();
+    struct BSKY_Tick tick;
+    bsky_tick_now(&tick);
+    update_time(&tick);
 }
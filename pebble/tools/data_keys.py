@@ -0,0 +1,288 @@
+#!/usr/bin/env python
+#
+# Copyright 2016 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Generate every definition of the AppMessage keys from data_keys.json.
+
+data_keys.json next to wscript lists each key once:
+
+    {
+        "keys": [
+            {"name": "AGENDA", "key": 3, "type": "bytes",
+             "max_bytes": "runtime", "incoming": true},
+            ...
+        ]
+    }
+
+type is "int" or "bytes".  max_bytes is the largest value of a "bytes" key,
+or "runtime" if the app decides it, and is always 4 for "int".  incoming and
+outgoing say which way the key travels, transient keys are used on arrival
+and never persisted, and shares_inbox keys never arrive along with the
+largest incoming values and so need no room of their own in the inbox.
+
+From it this writes:
+
+    src/modules/data_keys.h  the key enum, descriptors and inbox/outbox sizes
+    src/modules/data_keys.c  the descriptor table
+    appinfo.json             appKeys
+    BlueSkyConstants.java    the keys, between its "generated" comments
+
+wscript runs this with --check, which changes nothing and fails if any
+output is out of date.
+
+Usage:
+
+    data_keys.py [--check] [--root PEBBLE_DIR]
+"""
+
+from __future__ import print_function
+
+import argparse
+import collections
+import json
+import os.path
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PEBBLE_DIR = os.path.dirname(HERE)
+
+SCHEMA = 'data_keys.json'
+C_HEADER = os.path.join('src', 'modules', 'data_keys.h')
+C_SOURCE = os.path.join('src', 'modules', 'data_keys.c')
+APPINFO = 'appinfo.json'
+JAVA = os.path.join('..', 'android', 'src', 'main', 'java', 'ca',
+                    'joshuatacoma', 'bluesky', 'BlueSkyConstants.java')
+
+# Dictionary header, then per tuple: uint32 key, uint8 type, uint16 length.
+DICT_HEADER_BYTES = 1
+TUPLE_HEADER_BYTES = 7
+
+TUPLE_TYPES = {'int': 'TUPLE_INT', 'bytes': 'TUPLE_BYTE_ARRAY'}
+FLAGS = ('incoming', 'outgoing', 'transient')
+
+LICENSE = """\
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+"""
+
+JAVA_BEGIN = '    // Generated by pebble/tools/data_keys.py, do not edit.\n'
+JAVA_END = '    // End of generated keys.\n'
+
+
+def load(path):
+    """Return the keys in path, checked and sorted by key."""
+    with open(path) as schema_file:
+        keys = json.load(schema_file)['keys']
+    seen = set()
+    for key in keys:
+        if key['type'] not in TUPLE_TYPES:
+            raise ValueError('{}: unknown type {}'.format(
+                key['name'], key['type']))
+        if key['type'] == 'int':
+            key['max_bytes'] = 4
+        elif key.get('max_bytes') != 'runtime' and not (
+                0 < key.get('max_bytes', 0) <= 0xffff):
+            raise ValueError('{}: max_bytes must be 1 to 65535 or "runtime"'
+                             .format(key['name']))
+        if key['key'] <= 0 or key['key'] in seen:
+            raise ValueError('{}: key {} is not positive and unique'.format(
+                key['name'], key['key']))
+        seen.add(key['key'])
+    return sorted(keys, key=lambda key: key['key'])
+
+
+def box_bytes(keys, direction):
+    """Dictionary bytes for every key going in direction at its largest,
+    counting only the tuple header for keys sized at runtime."""
+    total = DICT_HEADER_BYTES
+    for key in keys:
+        if key.get(direction) and not key.get('shares_inbox'):
+            total += TUPLE_HEADER_BYTES
+            if key['max_bytes'] != 'runtime':
+                total += key['max_bytes']
+    return total
+
+
+def camel_case(name):
+    """AGENDA_NEED_SECONDS -> AgendaNeedSeconds"""
+    return ''.join(word.capitalize() for word in name.split('_'))
+
+
+def render_header(keys):
+    lines = [LICENSE + '#pragma once', '',
+             '// Generated by tools/data_keys.py from data_keys.json,'
+             ' do not edit.', '',
+             '// The worker gets the same types from <pebble_worker.h>.',
+             '#ifndef BSKY_WORKER', '#include <pebble.h>', '#endif', '',
+             '// All known data keys, as in appinfo.json#appKeys.', '//',
+             'enum BSKY_DataKey {']
+    for key in keys:
+        lines.append('    BSKY_DATAKEY_{} = {},'.format(key['name'], key['key']))
+    lines += ['    BSKY_DATAKEY_MAX = {}, // largest key + 1'.format(
+        keys[-1]['key'] + 1), '};', '']
+    lines += ['// Largest value of each byte array key with a fixed size.', '//']
+    for key in keys:
+        if key['type'] == 'bytes' and key['max_bytes'] != 'runtime':
+            lines.append('#define BSKY_DATA_{}_MAX_BYTES {}'.format(
+                key['name'], key['max_bytes']))
+    lines += [
+        '',
+        '// Inbox and outbox sizes for every key at its largest, except that',
+        '// values sized at runtime still need adding to the inbox.',
+        '//',
+        '#define BSKY_DATA_INBOX_BYTES {}'.format(box_bytes(keys, 'incoming')),
+        '#define BSKY_DATA_OUTBOX_BYTES {}'.format(
+            box_bytes(keys, 'outgoing')),
+        '',
+        'enum BSKY_DataKeyFlag {',
+        '    BSKY_DATAKEY_FLAG_INCOMING = 1 << 0,',
+        '    BSKY_DATAKEY_FLAG_OUTGOING = 1 << 1,',
+        '    // Used once on arrival and never persisted.',
+        '    BSKY_DATAKEY_FLAG_TRANSIENT = 1 << 2,',
+        '};',
+        '',
+        '// What is known about a key before the app runs.  Eight bytes, so',
+        '// that everything about a key is one load from bsky_data_keys.',
+        '//',
+        'struct BSKY_DataKeyInfo {',
+        '    const char * name;',
+        '    // Zero if decided at runtime.',
+        '    uint16_t max_bytes;',
+        '    // TupleType',
+        '    uint8_t type;',
+        '    // BSKY_DataKeyFlag values',
+        '    uint8_t flags;',
+        '};',
+        '',
+        '// Indexed by key.  Unused keys have a NULL name and are zero otherwise.',
+        '//',
+        'extern const struct BSKY_DataKeyInfo bsky_data_keys [BSKY_DATAKEY_MAX];',
+        '']
+    return '\n'.join(lines)
+
+
+def render_source(keys):
+    lines = [LICENSE + '// Generated by tools/data_keys.py from data_keys.json,'
+             ' do not edit.', '',
+             '#include "data_keys.h"', '',
+             'const struct BSKY_DataKeyInfo bsky_data_keys [BSKY_DATAKEY_MAX]'
+             ' = {']
+    for key in keys:
+        flags = ' | '.join('BSKY_DATAKEY_FLAG_' + flag.upper()
+                           for flag in FLAGS if key.get(flag)) or '0'
+        lines += [
+            '    [BSKY_DATAKEY_{}] = {{'.format(key['name']),
+            '        .name = "BSKY_DATAKEY_{}",'.format(key['name']),
+            '        .max_bytes = {},'.format(
+                0 if key['max_bytes'] == 'runtime' else key['max_bytes']),
+            '        .type = {},'.format(TUPLE_TYPES[key['type']]),
+            '        .flags = {},'.format(flags),
+            '    },']
+    lines += ['};', '']
+    return '\n'.join(lines)
+
+
+def render_appinfo(text, keys):
+    appinfo = json.loads(text, object_pairs_hook=collections.OrderedDict)
+    appinfo['appKeys'] = collections.OrderedDict(
+        (camel_case(key['name']) + 'Key', key['key']) for key in keys)
+    return json.dumps(appinfo, indent=4, separators=(',', ': ')) + '\n'
+
+
+def render_java(text, keys):
+    lines = [JAVA_BEGIN]
+    for key in keys:
+        lines.append('    static final int {}_KEY = {};\n'.format(
+            key['name'], key['key']))
+    for key in keys:
+        if key['type'] == 'bytes' and key['max_bytes'] != 'runtime':
+            lines += ['\n',
+                      '    /** Largest {} value, in bytes.\n'
+                      .format(key['name']),
+                      '     */\n',
+                      '    static final int {}_MAX_BYTES = {};\n'.format(
+                          key['name'], key['max_bytes'])]
+    lines.append(JAVA_END)
+    pattern = re.compile(
+        re.escape(JAVA_BEGIN) + '.*?' + re.escape(JAVA_END), re.DOTALL)
+    if not pattern.search(text):
+        raise ValueError('no generated section in ' + JAVA)
+    return pattern.sub(lambda match: ''.join(lines), text)
+
+
+def outputs(root):
+    """Return {path: (current text or None, generated text)}."""
+    keys = load(os.path.join(root, SCHEMA))
+    generated = {}
+    for path, render, optional in (
+            (C_HEADER, lambda text: render_header(keys), False),
+            (C_SOURCE, lambda text: render_source(keys), False),
+            (APPINFO, lambda text: render_appinfo(text, keys), False),
+            # The Android project isn't always checked out alongside.
+            (JAVA, lambda text: render_java(text, keys), True)):
+        full_path = os.path.join(root, path)
+        current = None
+        if os.path.exists(full_path):
+            with open(full_path) as current_file:
+                current = current_file.read()
+        elif optional:
+            continue
+        generated[full_path] = (current, render(current))
+    return generated
+
+
+def stale(root, generated=None):
+    """Return the outputs that don't match data_keys.json."""
+    generated = generated or outputs(root)
+    return sorted(path for path, (current, text) in generated.items()
+                  if current != text)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--check', action='store_true',
+                        help='fail if any output is out of date, instead of'
+                        ' writing it')
+    parser.add_argument('--root', default=PEBBLE_DIR,
+                        help='directory holding ' + SCHEMA)
+    args = parser.parse_args(argv)
+
+    generated = outputs(args.root)
+    out_of_date = stale(args.root, generated)
+    for path in out_of_date:
+        if args.check:
+            print('out of date: {}'.format(os.path.relpath(path)))
+        else:
+            with open(path, 'w') as output_file:
+                output_file.write(generated[path][1])
+            print('wrote {}'.format(os.path.relpath(path)))
+    return 1 if args.check and out_of_date else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,157 @@
+#!/usr/bin/env python
+#
+# Copyright 2016 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Run the whole watchface through a simulated day and estimate its energy.
+
+Builds every app source except main.c against host/pebble.h, starts the app
+as init() in main.c does, then replays a calendar fixture from sync_sim.py
+for a day of minute ticks.  Along the way the host counts what costs battery:
+redraws, pixels filled, persist writes and bytes, radio messages and bytes,
+APP_LOG calls and wakeups.  Each count is weighted by the costs in
+energy_model.json and the sum, scaled to 24 hours, is the day's energy score.
+
+The weights are rough and only meant for comparing one redraw or sync
+strategy against another, not for predicting battery life.
+
+Usage:
+
+    day_bench.py [--hours 24] [--battery 100] [--24h] [--model FILE]
+                 [--json] [sync_sim.py options...] [FIXTURE...]
+"""
+
+from __future__ import print_function
+
+import argparse
+import glob
+import json
+import os.path
+import shutil
+import sys
+import tempfile
+
+import sync_sim
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, '..', 'src')
+
+
+class DaySimulation(sync_sim.Simulation):
+    """A sync simulation with the window up, run for a set number of hours
+    at a set battery level."""
+
+    window = True
+
+    def __init__(self, fixture, library, scratch_dir, options):
+        fixture = dict(fixture, hours=options.hours)
+        super(DaySimulation, self).__init__(
+            fixture, library, scratch_dir, options)
+        self.watch.lib.host_set_battery(options.battery, False)
+        self.watch.lib.host_set_24h_style(options.clock_24h)
+
+    def run(self):
+        result = super(DaySimulation, self).run()
+        for index, name in enumerate(sync_sim.HOST_COSTS):
+            result[name] = self.watch.cost(index)
+        return result
+
+
+def energy(result, model, hours):
+    """{cost: energy per day}, plus 'total'."""
+    scale = 24.0 / hours
+    per_day = dict((name, result[name] * weight * scale)
+                   for name, weight in model['costs'].items())
+    per_day['total'] = sum(per_day.values())
+    return per_day
+
+
+def print_report(results, model, hours, out=sys.stdout):
+    names = list(sync_sim.HOST_COSTS)
+    print('{:<16} {:>14} {:>14} {:>7}'.format(
+        'cost', 'count/day', 'energy/day', 'share'),
+        file=out)
+    for fixture, result in results:
+        scores = energy(result, model, hours)
+        print('{}: {:.0f} per day'.format(fixture, scores['total']), file=out)
+        for name in names:
+            print('  {:<14} {:>14.0f} {:>14.0f} {:>6.1f}%'.format(
+                name,
+                result[name] * 24.0 / hours,
+                scores.get(name, 0),
+                100.0 * scores.get(name, 0) / (scores['total'] or 1)),
+                file=out)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--cc', default='gcc', help='host C compiler')
+    parser.add_argument('--hours', type=int, default=24,
+                        help='how long to run each fixture for')
+    parser.add_argument('--battery', type=int, default=100,
+                        help='battery charge percent, which picks the render'
+                        ' quality tier')
+    parser.add_argument('--24h', dest='clock_24h', action='store_true',
+                        help='use a 24 hour clock face')
+    parser.add_argument('--model',
+                        default=os.path.join(HERE, 'energy_model.json'),
+                        help='energy cost of each counted operation')
+    parser.add_argument('--latency-ms', type=int, default=100)
+    parser.add_argument('--timeout-ms', type=int, default=3000)
+    parser.add_argument('--loss', type=float, default=0.0)
+    parser.add_argument('--nack', type=float, default=0.0)
+    parser.add_argument('--inbox-max', type=int, default=8200)
+    parser.add_argument('--outbox-max', type=int, default=8200)
+    parser.add_argument('--heap-free', type=int, default=24000)
+    parser.add_argument('--query-ms', type=int, default=50)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--log-level', type=int, default=0)
+    parser.add_argument('--json', action='store_true',
+                        help='print results as JSON')
+    parser.add_argument('fixtures', nargs='*', help='fixture files, default'
+                        ' all of fixtures/*.json')
+    args = parser.parse_args(argv)
+
+    os.environ.setdefault('TZ', 'UTC')
+    with open(args.model) as model_file:
+        model = json.load(model_file)
+    paths = args.fixtures or sorted(
+        glob.glob(os.path.join(HERE, 'fixtures', '*.json')))
+    sources = [path for path in glob.glob(os.path.join(SRC_DIR, '**', '*.c'))
+               + glob.glob(os.path.join(SRC_DIR, '*.c'))
+               if os.path.basename(path) != 'main.c']
+    scratch_dir = tempfile.mkdtemp(prefix='day_bench')
+    try:
+        library = sync_sim.build_library(args.cc, scratch_dir, sorted(sources))
+        results = []
+        for path in paths:
+            with open(path) as fixture_file:
+                fixture = json.load(fixture_file)
+            name = os.path.splitext(os.path.basename(path))[0]
+            result = DaySimulation(fixture, library, scratch_dir, args).run()
+            results.append((name, result))
+    finally:
+        shutil.rmtree(scratch_dir)
+
+    if args.json:
+        json.dump(dict((name, dict(result, energy=energy(
+            result, model, args.hours))) for name, result in results),
+            sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        print_report(results, model, args.hours)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
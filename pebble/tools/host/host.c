@@ -0,0 +1,541 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "host.h"
+
+static int s_log_level = 0;
+
+static int64_t s_now_ms = 0;
+
+static uint32_t s_inbox_max = 0;
+static uint32_t s_outbox_max = 0;
+static uint32_t s_heap_free = 0;
+
+static uint64_t s_costs [HOST_COST_MAX];
+
+void host_cost_add(enum HostCost which, uint64_t amount) {
+    s_costs[which] += amount;
+}
+
+uint64_t host_cost(int32_t which) {
+    return which >= 0 && which < HOST_COST_MAX ? s_costs[which] : 0;
+}
+
+void host_log(int level, const char * fmt, ...) {
+    host_cost_add(HOST_COST_LOGS, 1);
+    if (level <= s_log_level) {
+        fprintf(stderr, "[%lld] %s\n", (long long)s_now_ms, fmt);
+    }
+}
+
+void host_set_log_level(int level) {
+    s_log_level = level;
+}
+
+time_t host_time(time_t * tloc) {
+    const time_t now = s_now_ms / 1000;
+    if (tloc) {
+        *tloc = now;
+    }
+    return now;
+}
+
+int64_t host_now_ms(void) {
+    return s_now_ms;
+}
+
+// Timers.
+//
+// A fixed pool, like everything else here.  Slots are handed out as the
+// AppTimer pointers the app holds on to.
+//
+
+#define HOST_TIMER_MAX 32
+
+struct AppTimer {
+    bool used;
+    int64_t due_ms;
+    uint32_t sequence;
+    AppTimerCallback callback;
+    void * data;
+};
+
+static struct AppTimer s_timers [HOST_TIMER_MAX];
+static uint32_t s_timer_sequence = 0;
+
+AppTimer * app_timer_register(
+        uint32_t timeout_ms,
+        AppTimerCallback callback,
+        void * callback_data) {
+    for (int i=0; i<HOST_TIMER_MAX; ++i) {
+        if (!s_timers[i].used) {
+            s_timers[i] = (struct AppTimer) {
+                .used = true,
+                .due_ms = s_now_ms + timeout_ms,
+                .sequence = s_timer_sequence++,
+                .callback = callback,
+                .data = callback_data,
+            };
+            return &s_timers[i];
+        }
+    }
+    host_log(APP_LOG_LEVEL_ERROR, "app_timer_register: out of timers");
+    return NULL;
+}
+
+bool app_timer_reschedule(AppTimer * timer, uint32_t new_timeout_ms) {
+    if (!timer || !timer->used) {
+        return false;
+    }
+    timer->due_ms = s_now_ms + new_timeout_ms;
+    timer->sequence = s_timer_sequence++;
+    return true;
+}
+
+void app_timer_cancel(AppTimer * timer) {
+    if (timer) {
+        timer->used = false;
+    }
+}
+
+static struct AppTimer * host_next_timer(void) {
+    struct AppTimer * next = NULL;
+    for (int i=0; i<HOST_TIMER_MAX; ++i) {
+        struct AppTimer * timer = &s_timers[i];
+        if (timer->used
+                && (!next
+                    || timer->due_ms < next->due_ms
+                    || (timer->due_ms == next->due_ms
+                        && timer->sequence < next->sequence))) {
+            next = timer;
+        }
+    }
+    return next;
+}
+
+int64_t host_next_timer_ms(void) {
+    const struct AppTimer * next = host_next_timer();
+    const int64_t tick_ms = host_ui_next_tick_ms();
+    if (next && (tick_ms < 0 || next->due_ms <= tick_ms)) {
+        return next->due_ms;
+    }
+    return tick_ms;
+}
+
+// Ticks and timers both wake the app, and as on the watch, any layer marked
+// dirty along the way is redrawn before it sleeps again.
+//
+void host_run_until(int64_t until_ms) {
+    int64_t due_ms;
+    while ((due_ms = host_next_timer_ms()) >= 0 && due_ms <= until_ms) {
+        if (due_ms > s_now_ms) {
+            s_now_ms = due_ms;
+        }
+        host_cost_add(HOST_COST_WAKEUPS, 1);
+        struct AppTimer * next = host_next_timer();
+        if (next && next->due_ms == due_ms) {
+            next->used = false;
+            next->callback(next->data);
+        } else {
+            host_ui_tick();
+        }
+        host_ui_render();
+    }
+    if (until_ms > s_now_ms) {
+        s_now_ms = until_ms;
+    }
+}
+
+// Heap.
+//
+
+size_t heap_bytes_used(void) {
+    return 0;
+}
+
+size_t heap_bytes_free(void) {
+    return s_heap_free;
+}
+
+// Persistent storage.
+//
+// As on the watch: values of up to PERSIST_DATA_MAX_LENGTH bytes and about 4
+// KB in all.
+//
+
+#define HOST_PERSIST_MAX_KEYS 128
+#define HOST_PERSIST_MAX_BYTES 4096
+
+struct HostPersistEntry {
+    bool used;
+    uint32_t key;
+    uint16_t length;
+    uint8_t data [PERSIST_DATA_MAX_LENGTH];
+};
+
+static struct HostPersistEntry s_persist [HOST_PERSIST_MAX_KEYS];
+static uint32_t s_persist_writes = 0;
+
+static struct HostPersistEntry * host_persist_find(uint32_t key) {
+    for (int i=0; i<HOST_PERSIST_MAX_KEYS; ++i) {
+        if (s_persist[i].used && s_persist[i].key == key) {
+            return &s_persist[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t host_persist_bytes(void) {
+    uint32_t total = 0;
+    for (int i=0; i<HOST_PERSIST_MAX_KEYS; ++i) {
+        if (s_persist[i].used) {
+            total += s_persist[i].length;
+        }
+    }
+    return total;
+}
+
+uint32_t host_persist_writes(void) {
+    return s_persist_writes;
+}
+
+bool persist_exists(uint32_t key) {
+    return host_persist_find(key) != NULL;
+}
+
+int persist_get_size(uint32_t key) {
+    const struct HostPersistEntry * entry = host_persist_find(key);
+    return entry ? entry->length : E_DOES_NOT_EXIST;
+}
+
+int persist_read_data(uint32_t key, void * buffer, size_t buffer_size) {
+    const struct HostPersistEntry * entry = host_persist_find(key);
+    if (!entry) {
+        return E_DOES_NOT_EXIST;
+    }
+    const size_t length
+        = entry->length < buffer_size ? entry->length : buffer_size;
+    memcpy(buffer, entry->data, length);
+    return length;
+}
+
+int persist_write_data(uint32_t key, const void * data, size_t size) {
+    if (size > PERSIST_DATA_MAX_LENGTH) {
+        size = PERSIST_DATA_MAX_LENGTH;
+    }
+    struct HostPersistEntry * entry = host_persist_find(key);
+    const uint32_t others
+        = host_persist_bytes() - (entry ? entry->length : 0);
+    if (others + size > HOST_PERSIST_MAX_BYTES) {
+        return E_OUT_OF_STORAGE;
+    }
+    for (int i=0; !entry && i<HOST_PERSIST_MAX_KEYS; ++i) {
+        if (!s_persist[i].used) {
+            entry = &s_persist[i];
+        }
+    }
+    if (!entry) {
+        return E_OUT_OF_STORAGE;
+    }
+    entry->used = true;
+    entry->key = key;
+    entry->length = size;
+    memcpy(entry->data, data, size);
+    ++s_persist_writes;
+    host_cost_add(HOST_COST_PERSIST_WRITES, 1);
+    host_cost_add(HOST_COST_PERSIST_BYTES, size);
+    return size;
+}
+
+int32_t persist_read_int(uint32_t key) {
+    int32_t value = 0;
+    persist_read_data(key, &value, sizeof(value));
+    return value;
+}
+
+status_t persist_write_int(uint32_t key, int32_t value) {
+    const int result = persist_write_data(key, &value, sizeof(value));
+    return result < 0 ? result : S_SUCCESS;
+}
+
+status_t persist_delete(uint32_t key) {
+    struct HostPersistEntry * entry = host_persist_find(key);
+    if (!entry) {
+        return E_DOES_NOT_EXIST;
+    }
+    entry->used = false;
+    return S_SUCCESS;
+}
+
+// Dictionaries.
+//
+
+#define HOST_TUPLE_HEADER_BYTES 7
+
+static Tuple * host_dict_tuple(DictionaryIterator * iter) {
+    if (iter->cursor + HOST_TUPLE_HEADER_BYTES > iter->end) {
+        return NULL;
+    }
+    Tuple * tuple = (Tuple *) iter->cursor;
+    if (iter->cursor + HOST_TUPLE_HEADER_BYTES + tuple->length > iter->end) {
+        return NULL;
+    }
+    return tuple;
+}
+
+Tuple * dict_read_first(DictionaryIterator * iter) {
+    iter->cursor = iter->begin + 1;
+    return host_dict_tuple(iter);
+}
+
+Tuple * dict_read_next(DictionaryIterator * iter) {
+    Tuple * tuple = host_dict_tuple(iter);
+    if (!tuple) {
+        return NULL;
+    }
+    iter->cursor += HOST_TUPLE_HEADER_BYTES + tuple->length;
+    return host_dict_tuple(iter);
+}
+
+static DictionaryResult host_dict_write(
+        DictionaryIterator * iter,
+        uint32_t key,
+        TupleType type,
+        const void * data,
+        uint16_t size) {
+    if (iter->cursor + HOST_TUPLE_HEADER_BYTES + size > iter->end) {
+        return DICT_NOT_ENOUGH_STORAGE;
+    }
+    Tuple * tuple = (Tuple *) iter->cursor;
+    tuple->key = key;
+    tuple->type = type;
+    tuple->length = size;
+    memcpy(tuple->value->data, data, size);
+    iter->cursor += HOST_TUPLE_HEADER_BYTES + size;
+    iter->begin[0] += 1;
+    return DICT_OK;
+}
+
+DictionaryResult dict_write_int(
+        DictionaryIterator * iter,
+        uint32_t key,
+        const void * integer,
+        uint8_t width_bytes,
+        bool is_signed) {
+    if (width_bytes != 1 && width_bytes != 2 && width_bytes != 4) {
+        return DICT_INVALID_ARGS;
+    }
+    return host_dict_write(
+            iter,
+            key,
+            is_signed ? TUPLE_INT : TUPLE_UINT,
+            integer,
+            width_bytes);
+}
+
+DictionaryResult dict_write_data(
+        DictionaryIterator * iter,
+        uint32_t key,
+        const uint8_t * data,
+        uint16_t size) {
+    return host_dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+// AppMessage.
+//
+// The outbox holds one message at a time: from app_message_outbox_send until
+// the driver reports what became of it, further sends are refused as busy.
+//
+
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageInboxDropped s_inbox_dropped;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+
+static uint32_t s_inbox_size = 0;
+static uint32_t s_outbox_size = 0;
+
+static uint8_t * s_inbox = NULL;
+static uint8_t * s_outbox = NULL;
+static DictionaryIterator s_outbox_iter;
+static bool s_outbox_sending = false;
+static bool s_outbox_taken = false;
+
+void app_message_register_inbox_received(AppMessageInboxReceived callback) {
+    s_inbox_received = callback;
+}
+
+void app_message_register_inbox_dropped(AppMessageInboxDropped callback) {
+    s_inbox_dropped = callback;
+}
+
+void app_message_register_outbox_sent(AppMessageOutboxSent callback) {
+    s_outbox_sent = callback;
+}
+
+void app_message_register_outbox_failed(AppMessageOutboxFailed callback) {
+    s_outbox_failed = callback;
+}
+
+AppMessageResult app_message_open(uint32_t size_inbound, uint32_t size_outbound) {
+    if (s_inbox) {
+        return APP_MSG_BUSY;
+    }
+    s_inbox_size = size_inbound < s_inbox_max ? size_inbound : s_inbox_max;
+    s_outbox_size = size_outbound < s_outbox_max ? size_outbound : s_outbox_max;
+    s_inbox = malloc(s_inbox_size);
+    s_outbox = malloc(s_outbox_size);
+    return s_inbox && s_outbox ? APP_MSG_OK : APP_MSG_OUT_OF_MEMORY;
+}
+
+uint32_t app_message_inbox_size_maximum(void) {
+    return s_inbox_max;
+}
+
+uint32_t app_message_outbox_size_maximum(void) {
+    return s_outbox_max;
+}
+
+uint32_t host_inbox_size(void) {
+    return s_inbox_size;
+}
+
+uint32_t host_outbox_size(void) {
+    return s_outbox_size;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator ** iterator) {
+    if (!s_outbox) {
+        return APP_MSG_NOT_CONNECTED;
+    }
+    if (s_outbox_sending) {
+        return APP_MSG_BUSY;
+    }
+    s_outbox[0] = 0;
+    s_outbox_iter = (DictionaryIterator) {
+        .begin = s_outbox,
+        .end = s_outbox + s_outbox_size,
+        .cursor = s_outbox + 1,
+    };
+    *iterator = &s_outbox_iter;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+    if (!s_outbox) {
+        return APP_MSG_NOT_CONNECTED;
+    }
+    if (s_outbox_sending) {
+        return APP_MSG_BUSY;
+    }
+    s_outbox_sending = true;
+    s_outbox_taken = false;
+    return APP_MSG_OK;
+}
+
+uint32_t host_outbox_take(uint8_t * buffer, uint32_t capacity_bytes) {
+    if (!s_outbox_sending || s_outbox_taken) {
+        return 0;
+    }
+    s_outbox_taken = true;
+    uint32_t length = s_outbox_iter.cursor - s_outbox_iter.begin;
+    host_cost_add(HOST_COST_RADIO_MESSAGES, 1);
+    host_cost_add(HOST_COST_RADIO_BYTES, length);
+    if (length > capacity_bytes) {
+        length = capacity_bytes;
+    }
+    memcpy(buffer, s_outbox, length);
+    return length;
+}
+
+void host_outbox_result(bool acked) {
+    if (!s_outbox_sending) {
+        return;
+    }
+    s_outbox_sending = false;
+    DictionaryIterator iter = s_outbox_iter;
+    iter.cursor = iter.begin + 1;
+    host_cost_add(HOST_COST_WAKEUPS, 1);
+    if (acked && s_outbox_sent) {
+        s_outbox_sent(&iter, NULL);
+    } else if (!acked && s_outbox_failed) {
+        s_outbox_failed(&iter, APP_MSG_SEND_TIMEOUT, NULL);
+    }
+    host_ui_render();
+}
+
+int32_t host_deliver(const uint8_t * dict, uint32_t length_bytes) {
+    if (!s_inbox) {
+        return APP_MSG_NOT_CONNECTED;
+    }
+    host_cost_add(HOST_COST_RADIO_MESSAGES, 1);
+    host_cost_add(HOST_COST_RADIO_BYTES, length_bytes);
+    host_cost_add(HOST_COST_WAKEUPS, 1);
+    if (length_bytes > s_inbox_size) {
+        if (s_inbox_dropped) {
+            s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+        }
+        return APP_MSG_BUFFER_OVERFLOW;
+    }
+    memcpy(s_inbox, dict, length_bytes);
+    DictionaryIterator iter = {
+        .begin = s_inbox,
+        .end = s_inbox + length_bytes,
+        .cursor = s_inbox + 1,
+    };
+    if (s_inbox_received) {
+        s_inbox_received(&iter, NULL);
+    }
+    host_ui_render();
+    return APP_MSG_OK;
+}
+
+// The background worker.
+//
+
+bool app_worker_is_running(void) {
+    return false;
+}
+
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler) {
+    return false;
+}
+
+bool app_worker_message_unsubscribe(void) {
+    return false;
+}
+
+void app_worker_send_message(uint8_t type, AppWorkerMessage * data) {
+}
+
+void host_reset(uint32_t inbox_max, uint32_t outbox_max, uint32_t heap_free) {
+    s_now_ms = 0;
+    s_inbox_max = inbox_max;
+    s_outbox_max = outbox_max;
+    s_heap_free = heap_free;
+    memset(s_timers, 0, sizeof(s_timers));
+    memset(s_persist, 0, sizeof(s_persist));
+    s_persist_writes = 0;
+    free(s_inbox);
+    free(s_outbox);
+    s_inbox = s_outbox = NULL;
+    s_inbox_size = s_outbox_size = 0;
+    s_outbox_sending = s_outbox_taken = false;
+    memset(s_costs, 0, sizeof(s_costs));
+    host_ui_reset();
+}
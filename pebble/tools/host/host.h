@@ -0,0 +1,117 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Driver interface to the host stand-in for the Pebble SDK, see pebble.h.
+//
+// The driver plays the part of the phone and of the passage of time.  It is
+// meant to be loaded with ctypes by ../sync_sim.py and ../day_bench.py, and so
+// sticks to plain integer and pointer types.
+
+#include <pebble.h>
+
+// Start over with empty storage, no timers and a clock at zero.  Modules
+// keep their own static state, so the driver loads a fresh copy of the
+// library instead of calling this more than once.
+//
+// inbox_max, outbox_max: what app_message_*_size_maximum report.
+// heap_free: what heap_bytes_free reports.
+//
+void host_reset(uint32_t inbox_max, uint32_t outbox_max, uint32_t heap_free);
+
+// Log every APP_LOG format string at or below level to stderr.
+//
+void host_set_log_level(int level);
+
+// The virtual clock, in milliseconds since the Unix epoch.
+//
+int64_t host_now_ms(void);
+
+// When the next timer is due, or -1 if there is none.
+//
+int64_t host_next_timer_ms(void);
+
+// Fire every timer due up to and including until_ms, in order, then leave
+// the clock at until_ms.
+//
+void host_run_until(int64_t until_ms);
+
+// Offer a dictionary from the phone to the inbox.
+//
+// Returns: APP_MSG_OK if the watch accepted it, which the phone sees as an
+// ACK, otherwise the reason it was dropped, which the phone sees as a NACK.
+//
+int32_t host_deliver(const uint8_t * dict, uint32_t length_bytes);
+
+// Take the message the watch has just sent, if any.
+//
+// Returns: its length, or 0 if nothing has been sent since the last call.
+// Messages longer than capacity_bytes are truncated.
+//
+uint32_t host_outbox_take(uint8_t * buffer, uint32_t capacity_bytes);
+
+// Tell the watch what became of the message last taken: acked or not.
+//
+void host_outbox_result(bool acked);
+
+// The inbox and outbox sizes the app opened AppMessage with, or 0.
+//
+uint32_t host_inbox_size(void);
+uint32_t host_outbox_size(void);
+
+// Total bytes held in persistent storage, and the number of writes so far.
+//
+uint32_t host_persist_bytes(void);
+uint32_t host_persist_writes(void);
+
+// What the app has done that costs battery, counted since host_reset.
+//
+enum HostCost {
+    // Frames rendered: each redraws the whole window.
+    HOST_COST_REDRAWS,
+    // Pixels touched by graphics calls, estimated from their geometry.
+    HOST_COST_PIXELS,
+    // Calls to persist_write_*, and the bytes they wrote.
+    HOST_COST_PERSIST_WRITES,
+    HOST_COST_PERSIST_BYTES,
+    // AppMessages in either direction, and their dictionary bytes.
+    HOST_COST_RADIO_MESSAGES,
+    HOST_COST_RADIO_BYTES,
+    // Calls to APP_LOG, whether printed or not.
+    HOST_COST_LOGS,
+    // Times the app was woken: timers, ticks and incoming messages.
+    HOST_COST_WAKEUPS,
+    HOST_COST_MAX,
+};
+
+uint64_t host_cost(int32_t which);
+
+// Set what the battery reports, calling the app's battery handler if it has
+// changed.
+//
+void host_set_battery(uint8_t charge_percent, bool is_plugged);
+
+// Set what clock_is_24h_style reports.
+//
+void host_set_24h_style(bool is_24h);
+
+// Hooks between host.c and host_ui.c, not for the driver.
+//
+void host_cost_add(enum HostCost which, uint64_t amount);
+int64_t host_ui_next_tick_ms(void);
+void host_ui_tick(void);
+void host_ui_render(void);
+void host_ui_reset(void);
@@ -0,0 +1,629 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <math.h>
+
+#include "host.h"
+
+// Screen size, as on chalk.
+//
+#define HOST_SCREEN_WIDTH 180
+#define HOST_SCREEN_HEIGHT 180
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Graphics.
+//
+
+struct GContext {
+    uint8_t stroke_width;
+    GColor fill_color;
+    GColor text_color;
+};
+
+static struct GContext s_context = { .stroke_width = 1 };
+
+struct GBitmap {
+    uint8_t * data;
+    GColor * palette;
+    GSize size;
+    GBitmapFormat format;
+    uint16_t bytes_per_row;
+};
+
+// The frame buffer, 8 bits per pixel and rectangular.
+//
+static uint8_t s_frame_pixels[HOST_SCREEN_WIDTH * HOST_SCREEN_HEIGHT];
+static GBitmap s_frame = {
+    .data = s_frame_pixels,
+    .size = { HOST_SCREEN_WIDTH, HOST_SCREEN_HEIGHT },
+    .format = GBitmapFormat8Bit,
+    .bytes_per_row = HOST_SCREEN_WIDTH,
+};
+
+static void host_pixels(double pixels) {
+    if (pixels > 0) {
+        host_cost_add(HOST_COST_PIXELS, (uint64_t)pixels);
+    }
+}
+
+GFont fonts_get_system_font(const char * font_key) {
+    return font_key;
+}
+
+// Fill the part of rect that is on screen.
+//
+static void host_frame_fill(GRect rect, GColor color) {
+    for (int y = rect.origin.y; y < rect.origin.y + rect.size.h; ++y) {
+        for (int x = rect.origin.x; x < rect.origin.x + rect.size.w; ++x) {
+            if (0 <= x && x < HOST_SCREEN_WIDTH
+                    && 0 <= y && y < HOST_SCREEN_HEIGHT) {
+                s_frame_pixels[y * HOST_SCREEN_WIDTH + x] = color.argb;
+            }
+        }
+    }
+}
+
+// A font's line height, taken from the number in its key.
+//
+static int host_font_height(GFont font) {
+    while (*font && (*font < '0' || '9' < *font)) {
+        ++font;
+    }
+    return *font ? atoi(font) : 14;
+}
+
+void graphics_context_set_fill_color(GContext * ctx, GColor color) {
+    ctx->fill_color = color;
+}
+
+void graphics_context_set_stroke_color(GContext * ctx, GColor color) {
+}
+
+void graphics_context_set_text_color(GContext * ctx, GColor color) {
+    ctx->text_color = color;
+}
+
+void graphics_context_set_stroke_width(GContext * ctx, uint8_t stroke_width) {
+    ctx->stroke_width = stroke_width ? stroke_width : 1;
+}
+
+void graphics_context_set_antialiased(GContext * ctx, bool enable) {
+}
+
+void graphics_context_set_compositing_mode(GContext * ctx, GCompOp mode) {
+}
+
+void graphics_fill_rect(
+        GContext * ctx,
+        GRect rect,
+        uint16_t corner_radius,
+        GCornerMask corner_mask) {
+    host_pixels((double)rect.size.w * rect.size.h);
+    host_frame_fill(rect, ctx->fill_color);
+}
+
+void graphics_fill_circle(GContext * ctx, GPoint p, uint16_t radius) {
+    host_pixels(M_PI * radius * radius);
+}
+
+void graphics_draw_circle(GContext * ctx, GPoint p, uint16_t radius) {
+    host_pixels(2 * M_PI * radius * ctx->stroke_width);
+}
+
+void graphics_draw_line(GContext * ctx, GPoint p0, GPoint p1) {
+    const int dx = abs(p1.x - p0.x);
+    const int dy = abs(p1.y - p0.y);
+    host_pixels((double)((dx > dy ? dx : dy) + 1) * ctx->stroke_width);
+}
+
+void graphics_fill_radial(
+        GContext * ctx,
+        GRect rect,
+        GOvalScaleMode scale_mode,
+        uint16_t inset_thickness,
+        int32_t angle_start,
+        int32_t angle_end) {
+    const double outer
+        = (rect.size.w < rect.size.h ? rect.size.w : rect.size.h) / 2.0;
+    const double inner = outer > inset_thickness ? outer - inset_thickness : 0;
+    const double sweep = (double)(angle_end - angle_start) / TRIG_MAX_ANGLE;
+    host_pixels(sweep * M_PI * (outer * outer - inner * inner));
+}
+
+// Glyphs are taken to be half as wide as the box is tall, and about half of
+// each glyph's cell is ink.  In the frame buffer, the ink is a block across
+// the middle of the line, half a line high.
+//
+void graphics_draw_text(
+        GContext * ctx,
+        const char * text,
+        GFont font,
+        GRect box,
+        GTextOverflowMode overflow_mode,
+        GTextAlignment alignment,
+        void * text_attributes) {
+    const double cell = box.size.h * box.size.h / 2.0;
+    host_pixels(strlen(text) * cell / 2);
+
+    const int height = host_font_height(font);
+    int width = 0;
+    for (const char * c = text; *c; ++c) {
+        width += *c == ' ' ? 0 : height / 2;
+    }
+    host_frame_fill(
+            GRect(box.origin.x,
+                box.origin.y + height / 4,
+                width < box.size.w ? width : box.size.w,
+                height / 2),
+            ctx->text_color);
+}
+
+GSize graphics_text_layout_get_content_size(
+        const char * text,
+        GFont font,
+        GRect box,
+        GTextOverflowMode overflow_mode,
+        GTextAlignment alignment) {
+    const int height = host_font_height(font);
+    return GSize(strlen(text) * height / 2, height);
+}
+
+void graphics_draw_bitmap_in_rect(
+        GContext * ctx,
+        const GBitmap * bitmap,
+        GRect rect) {
+    host_pixels((double)rect.size.w * rect.size.h);
+}
+
+GBitmap * graphics_capture_frame_buffer(GContext * ctx) {
+    return &s_frame;
+}
+
+bool graphics_release_frame_buffer(GContext * ctx, GBitmap * buffer) {
+    return buffer == &s_frame;
+}
+
+// Bitmaps.
+//
+
+GBitmap * gbitmap_create_blank(GSize size, GBitmapFormat format) {
+    int bits_per_pixel;
+    switch (format) {
+    case GBitmapFormat1Bit:
+    case GBitmapFormat1BitPalette:
+        bits_per_pixel = 1;
+        break;
+    case GBitmapFormat2BitPalette:
+        bits_per_pixel = 2;
+        break;
+    case GBitmapFormat4BitPalette:
+        bits_per_pixel = 4;
+        break;
+    default:
+        bits_per_pixel = 8;
+        break;
+    }
+    GBitmap * bitmap = calloc(1, sizeof(GBitmap));
+    if (!bitmap) {
+        return NULL;
+    }
+    bitmap->size = size;
+    bitmap->format = format;
+    bitmap->bytes_per_row = (size.w * bits_per_pixel + 7) / 8;
+    bitmap->data = calloc(size.h, bitmap->bytes_per_row);
+    if (format != GBitmapFormat1Bit && bits_per_pixel < 8) {
+        bitmap->palette = calloc(1 << bits_per_pixel, sizeof(GColor));
+    }
+    return bitmap;
+}
+
+void gbitmap_destroy(GBitmap * bitmap) {
+    if (bitmap && bitmap != &s_frame) {
+        free(bitmap->data);
+        free(bitmap->palette);
+        free(bitmap);
+    }
+}
+
+GRect gbitmap_get_bounds(const GBitmap * bitmap) {
+    return GRect(0, 0, bitmap->size.w, bitmap->size.h);
+}
+
+uint16_t gbitmap_get_bytes_per_row(const GBitmap * bitmap) {
+    return bitmap->bytes_per_row;
+}
+
+uint8_t * gbitmap_get_data(const GBitmap * bitmap) {
+    return bitmap->data;
+}
+
+GColor * gbitmap_get_palette(const GBitmap * bitmap) {
+    return bitmap->palette;
+}
+
+GBitmapDataRowInfo gbitmap_get_data_row_info(
+        const GBitmap * bitmap,
+        uint16_t y) {
+    return (GBitmapDataRowInfo) {
+        .data = bitmap->data + y * bitmap->bytes_per_row,
+        .min_x = 0,
+        .max_x = bitmap->size.w - 1,
+    };
+}
+
+GPoint gpoint_from_polar(GRect rect, GOvalScaleMode scale_mode, int32_t angle) {
+    const double radius
+        = (rect.size.w < rect.size.h ? rect.size.w : rect.size.h) / 2.0;
+    const double radians = 2 * M_PI * angle / TRIG_MAX_ANGLE;
+    return GPoint(
+            rect.origin.x + rect.size.w / 2 + (int16_t)(radius * sin(radians)),
+            rect.origin.y + rect.size.h / 2 - (int16_t)(radius * cos(radians)));
+}
+
+// Layers.
+//
+
+struct Layer {
+    GRect frame;
+    bool hidden;
+    LayerUpdateProc update_proc;
+    Layer * parent;
+    Layer * first_child;
+    Layer * next_sibling;
+    void * data;
+};
+
+// Whether any layer has been marked dirty since the last render.
+//
+static bool s_dirty = false;
+
+Layer * layer_create_with_data(GRect frame, size_t data_size) {
+    Layer * layer = calloc(1, sizeof(Layer) + data_size);
+    if (layer) {
+        layer->frame = frame;
+        layer->data = data_size ? layer + 1 : NULL;
+    }
+    return layer;
+}
+
+Layer * layer_create(GRect frame) {
+    return layer_create_with_data(frame, 0);
+}
+
+void layer_destroy(Layer * layer) {
+    if (!layer) {
+        return;
+    }
+    if (layer->parent) {
+        Layer ** link = &layer->parent->first_child;
+        while (*link && *link != layer) {
+            link = &(*link)->next_sibling;
+        }
+        if (*link) {
+            *link = layer->next_sibling;
+        }
+    }
+    for (Layer * child = layer->first_child; child; child = child->next_sibling) {
+        child->parent = NULL;
+    }
+    free(layer);
+}
+
+void * layer_get_data(const Layer * layer) {
+    return layer->data;
+}
+
+GRect layer_get_bounds(const Layer * layer) {
+    return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+
+GRect layer_get_frame(const Layer * layer) {
+    return layer->frame;
+}
+
+void layer_set_update_proc(Layer * layer, LayerUpdateProc update_proc) {
+    layer->update_proc = update_proc;
+}
+
+void layer_mark_dirty(Layer * layer) {
+    s_dirty = true;
+}
+
+void layer_add_child(Layer * parent, Layer * child) {
+    child->parent = parent;
+    child->next_sibling = NULL;
+    Layer ** link = &parent->first_child;
+    while (*link) {
+        link = &(*link)->next_sibling;
+    }
+    *link = child;
+}
+
+void layer_set_hidden(Layer * layer, bool hidden) {
+    layer->hidden = hidden;
+    s_dirty = true;
+}
+
+static void host_render_layer(Layer * layer) {
+    if (layer->hidden) {
+        return;
+    }
+    if (layer->update_proc) {
+        layer->update_proc(layer, &s_context);
+    }
+    for (Layer * child = layer->first_child; child; child = child->next_sibling) {
+        host_render_layer(child);
+    }
+}
+
+// Text layers.
+//
+
+struct TextLayer {
+    Layer * layer;
+    const char * text;
+    GColor background_color;
+    GFont font;
+};
+
+static void host_text_layer_update(Layer * layer, GContext * ctx) {
+    const TextLayer * text_layer = *(TextLayer **) layer_get_data(layer);
+    const GRect bounds = layer_get_bounds(layer);
+    if (text_layer->background_color.argb != GColorClear.argb) {
+        graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+    }
+    if (text_layer->text) {
+        graphics_draw_text(
+                ctx,
+                text_layer->text,
+                text_layer->font,
+                bounds,
+                GTextOverflowModeWordWrap,
+                GTextAlignmentLeft,
+                NULL);
+    }
+}
+
+TextLayer * text_layer_create(GRect frame) {
+    TextLayer * text_layer = calloc(1, sizeof(TextLayer));
+    if (!text_layer) {
+        return NULL;
+    }
+    text_layer->layer = layer_create_with_data(frame, sizeof(TextLayer *));
+    if (!text_layer->layer) {
+        free(text_layer);
+        return NULL;
+    }
+    *(TextLayer **) layer_get_data(text_layer->layer) = text_layer;
+    text_layer->background_color = GColorWhite;
+    layer_set_update_proc(text_layer->layer, host_text_layer_update);
+    return text_layer;
+}
+
+void text_layer_destroy(TextLayer * text_layer) {
+    if (text_layer) {
+        layer_destroy(text_layer->layer);
+        free(text_layer);
+    }
+}
+
+Layer * text_layer_get_layer(TextLayer * text_layer) {
+    return text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer * text_layer, const char * text) {
+    text_layer->text = text;
+    s_dirty = true;
+}
+
+void text_layer_set_background_color(TextLayer * text_layer, GColor color) {
+    text_layer->background_color = color;
+    s_dirty = true;
+}
+
+void text_layer_set_text_color(TextLayer * text_layer, GColor color) {
+    s_dirty = true;
+}
+
+void text_layer_set_font(TextLayer * text_layer, GFont font) {
+    text_layer->font = font;
+    s_dirty = true;
+}
+
+void text_layer_set_text_alignment(
+        TextLayer * text_layer,
+        GTextAlignment text_alignment) {
+    s_dirty = true;
+}
+
+// Windows.
+//
+
+struct Window {
+    Layer * root;
+    WindowHandlers handlers;
+    bool loaded;
+};
+
+// The top of the window stack, or NULL.
+//
+static Window * s_window = NULL;
+
+Window * window_create(void) {
+    Window * window = calloc(1, sizeof(Window));
+    if (window) {
+        window->root = layer_create(
+                GRect(0, 0, HOST_SCREEN_WIDTH, HOST_SCREEN_HEIGHT));
+    }
+    return window;
+}
+
+void window_destroy(Window * window) {
+    if (!window) {
+        return;
+    }
+    if (s_window == window) {
+        s_window = NULL;
+    }
+    layer_destroy(window->root);
+    free(window);
+}
+
+void window_set_window_handlers(Window * window, WindowHandlers handlers) {
+    window->handlers = handlers;
+}
+
+Layer * window_get_root_layer(const Window * window) {
+    return window->root;
+}
+
+void window_stack_push(Window * window, bool animated) {
+    s_window = window;
+    if (!window->loaded) {
+        window->loaded = true;
+        if (window->handlers.load) {
+            window->handlers.load(window);
+        }
+    }
+    s_dirty = true;
+}
+
+void host_ui_render(void) {
+    if (!s_dirty || !s_window) {
+        return;
+    }
+    s_dirty = false;
+    host_cost_add(HOST_COST_REDRAWS, 1);
+    host_render_layer(s_window->root);
+}
+
+// Wall time.
+//
+
+static TimeUnits s_tick_units = 0;
+static TickHandler s_tick_handler = NULL;
+static int64_t s_last_tick_ms = -1;
+static bool s_24h_style = false;
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+    s_tick_units = tick_units;
+    s_tick_handler = handler;
+    s_last_tick_ms = host_now_ms();
+}
+
+void tick_timer_service_unsubscribe(void) {
+    s_tick_handler = NULL;
+}
+
+bool clock_is_24h_style(void) {
+    return s_24h_style;
+}
+
+void host_set_24h_style(bool is_24h) {
+    s_24h_style = is_24h;
+}
+
+uint16_t time_ms(time_t * tloc, uint16_t * out_ms) {
+    const int64_t now_ms = host_now_ms();
+    const uint16_t ms = now_ms % 1000;
+    if (tloc) {
+        *tloc = now_ms / 1000;
+    }
+    if (out_ms) {
+        *out_ms = ms;
+    }
+    return ms;
+}
+
+// The length of the smallest unit ticked, in milliseconds.
+//
+static int64_t host_tick_period_ms(void) {
+    return s_tick_units & SECOND_UNIT ? 1000
+        : s_tick_units & MINUTE_UNIT ? 60 * 1000
+        : s_tick_units & HOUR_UNIT ? 60 * 60 * 1000
+        : 24 * 60 * 60 * 1000;
+}
+
+int64_t host_ui_next_tick_ms(void) {
+    if (!s_tick_handler) {
+        return -1;
+    }
+    const int64_t period = host_tick_period_ms();
+    return (s_last_tick_ms / period + 1) * period;
+}
+
+void host_ui_tick(void) {
+    const time_t last = s_last_tick_ms / 1000;
+    const time_t now = host_now_ms() / 1000;
+    struct tm last_tm = *localtime(&last);
+    struct tm now_tm = *localtime(&now);
+    s_last_tick_ms = host_now_ms();
+
+    TimeUnits units = 0;
+    units |= last_tm.tm_sec != now_tm.tm_sec ? SECOND_UNIT : 0;
+    units |= last_tm.tm_min != now_tm.tm_min ? MINUTE_UNIT : 0;
+    units |= last_tm.tm_hour != now_tm.tm_hour ? HOUR_UNIT : 0;
+    units |= last_tm.tm_mday != now_tm.tm_mday ? DAY_UNIT : 0;
+    units |= last_tm.tm_mon != now_tm.tm_mon ? MONTH_UNIT : 0;
+    units |= last_tm.tm_year != now_tm.tm_year ? YEAR_UNIT : 0;
+    if (s_tick_handler && (units & s_tick_units)) {
+        s_tick_handler(&now_tm, units);
+    }
+}
+
+// Battery.
+//
+
+static BatteryChargeState s_battery = { .charge_percent = 100 };
+static BatteryStateHandler s_battery_handler = NULL;
+
+BatteryChargeState battery_state_service_peek(void) {
+    return s_battery;
+}
+
+void battery_state_service_subscribe(BatteryStateHandler handler) {
+    s_battery_handler = handler;
+}
+
+void battery_state_service_unsubscribe(void) {
+    s_battery_handler = NULL;
+}
+
+void host_set_battery(uint8_t charge_percent, bool is_plugged) {
+    const BatteryChargeState state = {
+        .charge_percent = charge_percent,
+        .is_charging = is_plugged && charge_percent < 100,
+        .is_plugged = is_plugged,
+    };
+    const bool changed
+        = state.charge_percent != s_battery.charge_percent
+        || state.is_plugged != s_battery.is_plugged;
+    s_battery = state;
+    if (changed && s_battery_handler) {
+        s_battery_handler(state);
+    }
+}
+
+void host_ui_reset(void) {
+    s_dirty = false;
+    s_window = NULL;
+    s_tick_handler = NULL;
+    s_last_tick_ms = -1;
+    s_battery_handler = NULL;
+    s_battery = (BatteryChargeState) { .charge_percent = 100 };
+}
@@ -0,0 +1,425 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// A host stand-in for the parts of the Pebble SDK used by the app, so that it
+// can be built and exercised on a workstation.
+//
+// Everything runs on a virtual clock that only moves when the host driver
+// says so, see host_run_until.  AppMessage is modelled as one inbox and one
+// outbox whose contents the driver carries to and from its model of the
+// phone, see host_deliver and host_outbox_take.  Nothing here is meant to be
+// faithful beyond what those modules rely on.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Logging.  Arguments are evaluated but only the format is printed, and only
+// when verbose, since the app's format strings assume a 32-bit target.
+//
+enum {
+    APP_LOG_LEVEL_ERROR = 1,
+    APP_LOG_LEVEL_WARNING = 50,
+    APP_LOG_LEVEL_INFO = 100,
+    APP_LOG_LEVEL_DEBUG = 200,
+    APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+};
+
+void host_log(int level, const char * fmt, ...);
+
+#define APP_LOG(level, fmt, ...) host_log((level), (fmt), ##__VA_ARGS__)
+
+// Time.
+//
+#define SECONDS_PER_MINUTE 60
+#define MINUTES_PER_HOUR 60
+#define SECONDS_PER_HOUR 3600
+#define HOURS_PER_DAY 24
+#define SECONDS_PER_DAY 86400
+
+time_t host_time(time_t * tloc);
+#define time(tloc) host_time(tloc)
+
+// Timers.
+//
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void * data);
+
+AppTimer * app_timer_register(
+        uint32_t timeout_ms,
+        AppTimerCallback callback,
+        void * callback_data);
+bool app_timer_reschedule(AppTimer * timer, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer * timer);
+
+// Heap.
+//
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+
+// Persistent storage, limited as on the watch.
+//
+typedef int32_t status_t;
+
+#define S_SUCCESS 0
+#define E_DOES_NOT_EXIST -4
+#define E_OUT_OF_STORAGE -8
+#define PERSIST_DATA_MAX_LENGTH 256
+
+bool persist_exists(uint32_t key);
+int persist_get_size(uint32_t key);
+int32_t persist_read_int(uint32_t key);
+status_t persist_write_int(uint32_t key, int32_t value);
+int persist_read_data(uint32_t key, void * buffer, size_t buffer_size);
+int persist_write_data(uint32_t key, const void * data, size_t size);
+status_t persist_delete(uint32_t key);
+
+// Dictionaries, in the same wire format as on the watch: a count byte, then
+// for each tuple a 32-bit key, a type byte, a 16-bit length and the value.
+//
+typedef enum {
+    TUPLE_BYTE_ARRAY = 0,
+    TUPLE_CSTRING = 1,
+    TUPLE_UINT = 2,
+    TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) {
+    uint32_t key;
+    TupleType type:8;
+    uint16_t length;
+    union {
+        uint8_t data[0];
+        char cstring[0];
+        uint8_t uint8;
+        uint16_t uint16;
+        uint32_t uint32;
+        int8_t int8;
+        int16_t int16;
+        int32_t int32;
+    } __attribute__((__packed__)) value[];
+} Tuple;
+
+typedef struct {
+    uint8_t * begin;
+    uint8_t * end;
+    uint8_t * cursor;
+} DictionaryIterator;
+
+typedef enum {
+    DICT_OK = 0,
+    DICT_NOT_ENOUGH_STORAGE = 2,
+    DICT_INVALID_ARGS = 4,
+} DictionaryResult;
+
+Tuple * dict_read_first(DictionaryIterator * iter);
+Tuple * dict_read_next(DictionaryIterator * iter);
+DictionaryResult dict_write_int(
+        DictionaryIterator * iter,
+        uint32_t key,
+        const void * integer,
+        uint8_t width_bytes,
+        bool is_signed);
+DictionaryResult dict_write_data(
+        DictionaryIterator * iter,
+        uint32_t key,
+        const uint8_t * data,
+        uint16_t size);
+
+// AppMessage.
+//
+typedef enum {
+    APP_MSG_OK = 0,
+    APP_MSG_SEND_TIMEOUT = 2,
+    APP_MSG_SEND_REJECTED = 4,
+    APP_MSG_NOT_CONNECTED = 8,
+    APP_MSG_BUSY = 64,
+    APP_MSG_BUFFER_OVERFLOW = 128,
+    APP_MSG_OUT_OF_MEMORY = 1024,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(
+        DictionaryIterator * iterator,
+        void * context);
+typedef void (*AppMessageInboxDropped)(
+        AppMessageResult reason,
+        void * context);
+typedef void (*AppMessageOutboxSent)(
+        DictionaryIterator * iterator,
+        void * context);
+typedef void (*AppMessageOutboxFailed)(
+        DictionaryIterator * iterator,
+        AppMessageResult reason,
+        void * context);
+
+void app_message_register_inbox_received(AppMessageInboxReceived callback);
+void app_message_register_inbox_dropped(AppMessageInboxDropped callback);
+void app_message_register_outbox_sent(AppMessageOutboxSent callback);
+void app_message_register_outbox_failed(AppMessageOutboxFailed callback);
+AppMessageResult app_message_open(uint32_t size_inbound, uint32_t size_outbound);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+AppMessageResult app_message_outbox_begin(DictionaryIterator ** iterator);
+AppMessageResult app_message_outbox_send(void);
+
+// Graphics.  Each call adds the pixels it would have touched to the host's
+// cost counters, see host.h.  Only rects and blocks standing in for text are
+// drawn into the frame buffer, which is enough for reading glyphs back.
+//
+typedef struct {
+    int16_t x;
+    int16_t y;
+} GPoint;
+
+typedef struct {
+    int16_t w;
+    int16_t h;
+} GSize;
+
+typedef struct {
+    GPoint origin;
+    GSize size;
+} GRect;
+
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GSize(w, h) ((GSize){(w), (h)})
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+
+typedef union {
+    uint8_t argb;
+} GColor8;
+typedef GColor8 GColor;
+
+#define GColorClear ((GColor8){.argb=0x00})
+#define GColorBlack ((GColor8){.argb=0xC0})
+#define GColorWhite ((GColor8){.argb=0xFF})
+#define GColorYellow ((GColor8){.argb=0xFC})
+#define GColorBulgarianRose ((GColor8){.argb=0xD0})
+#define GColorVividCerulean ((GColor8){.argb=0xDB})
+#define GColorLiberty ((GColor8){.argb=0xD6})
+#define GColorRoseVale ((GColor8){.argb=0xE5})
+#define GColorDarkGray ((GColor8){.argb=0xD5})
+#define GColorLightGray ((GColor8){.argb=0xEA})
+
+#define TRIG_MAX_ANGLE 0x10000
+#define DEG_TO_TRIGANGLE(angle) (((angle) * TRIG_MAX_ANGLE) / 360)
+
+typedef enum {
+    GOvalScaleModeFitCircle,
+    GOvalScaleModeFillCircle,
+} GOvalScaleMode;
+
+typedef enum {
+    GTextAlignmentLeft,
+    GTextAlignmentCenter,
+    GTextAlignmentRight,
+} GTextAlignment;
+
+typedef enum {
+    GTextOverflowModeWordWrap,
+    GTextOverflowModeTrailingEllipsis,
+    GTextOverflowModeFill,
+} GTextOverflowMode;
+
+typedef enum {
+    GCornerNone = 0,
+} GCornerMask;
+
+typedef enum {
+    GCompOpAssign,
+    GCompOpSet,
+} GCompOp;
+
+typedef struct GContext GContext;
+typedef const char * GFont;
+
+typedef enum {
+    GBitmapFormat1Bit = 0,
+    GBitmapFormat8Bit,
+    GBitmapFormat1BitPalette,
+    GBitmapFormat2BitPalette,
+    GBitmapFormat4BitPalette,
+    GBitmapFormat8BitCircular,
+} GBitmapFormat;
+
+typedef struct GBitmap GBitmap;
+
+typedef struct {
+    uint8_t * data;
+    int16_t min_x;
+    int16_t max_x;
+} GBitmapDataRowInfo;
+
+GBitmap * gbitmap_create_blank(GSize size, GBitmapFormat format);
+void gbitmap_destroy(GBitmap * bitmap);
+GRect gbitmap_get_bounds(const GBitmap * bitmap);
+uint16_t gbitmap_get_bytes_per_row(const GBitmap * bitmap);
+uint8_t * gbitmap_get_data(const GBitmap * bitmap);
+GColor * gbitmap_get_palette(const GBitmap * bitmap);
+GBitmapDataRowInfo gbitmap_get_data_row_info(
+        const GBitmap * bitmap,
+        uint16_t y);
+
+#define FONT_KEY_GOTHIC_14 "GOTHIC_14"
+#define FONT_KEY_GOTHIC_18_BOLD "GOTHIC_18_BOLD"
+#define FONT_KEY_ROBOTO_CONDENSED_21 "ROBOTO_CONDENSED_21"
+#define FONT_KEY_BITHAM_34_MEDIUM_NUMBERS "BITHAM_34_MEDIUM_NUMBERS"
+
+GFont fonts_get_system_font(const char * font_key);
+
+void graphics_context_set_fill_color(GContext * ctx, GColor color);
+void graphics_context_set_stroke_color(GContext * ctx, GColor color);
+void graphics_context_set_text_color(GContext * ctx, GColor color);
+void graphics_context_set_stroke_width(GContext * ctx, uint8_t stroke_width);
+void graphics_context_set_antialiased(GContext * ctx, bool enable);
+void graphics_context_set_compositing_mode(GContext * ctx, GCompOp mode);
+void graphics_fill_rect(
+        GContext * ctx,
+        GRect rect,
+        uint16_t corner_radius,
+        GCornerMask corner_mask);
+void graphics_fill_circle(GContext * ctx, GPoint p, uint16_t radius);
+void graphics_draw_circle(GContext * ctx, GPoint p, uint16_t radius);
+void graphics_draw_line(GContext * ctx, GPoint p0, GPoint p1);
+void graphics_fill_radial(
+        GContext * ctx,
+        GRect rect,
+        GOvalScaleMode scale_mode,
+        uint16_t inset_thickness,
+        int32_t angle_start,
+        int32_t angle_end);
+void graphics_draw_text(
+        GContext * ctx,
+        const char * text,
+        GFont font,
+        GRect box,
+        GTextOverflowMode overflow_mode,
+        GTextAlignment alignment,
+        void * text_attributes);
+GSize graphics_text_layout_get_content_size(
+        const char * text,
+        GFont font,
+        GRect box,
+        GTextOverflowMode overflow_mode,
+        GTextAlignment alignment);
+void graphics_draw_bitmap_in_rect(
+        GContext * ctx,
+        const GBitmap * bitmap,
+        GRect rect);
+GBitmap * graphics_capture_frame_buffer(GContext * ctx);
+bool graphics_release_frame_buffer(GContext * ctx, GBitmap * buffer);
+GPoint gpoint_from_polar(GRect rect, GOvalScaleMode scale_mode, int32_t angle);
+
+// Layers and windows.  The window stack holds one window, redrawn whole
+// whenever any of its layers is marked dirty, as on the watch.
+//
+typedef struct Layer Layer;
+typedef void (*LayerUpdateProc)(Layer * layer, GContext * ctx);
+
+Layer * layer_create(GRect frame);
+Layer * layer_create_with_data(GRect frame, size_t data_size);
+void layer_destroy(Layer * layer);
+void * layer_get_data(const Layer * layer);
+GRect layer_get_bounds(const Layer * layer);
+GRect layer_get_frame(const Layer * layer);
+void layer_set_update_proc(Layer * layer, LayerUpdateProc update_proc);
+void layer_mark_dirty(Layer * layer);
+void layer_add_child(Layer * parent, Layer * child);
+void layer_set_hidden(Layer * layer, bool hidden);
+
+typedef struct TextLayer TextLayer;
+
+TextLayer * text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer * text_layer);
+Layer * text_layer_get_layer(TextLayer * text_layer);
+void text_layer_set_text(TextLayer * text_layer, const char * text);
+void text_layer_set_background_color(TextLayer * text_layer, GColor color);
+void text_layer_set_text_color(TextLayer * text_layer, GColor color);
+void text_layer_set_font(TextLayer * text_layer, GFont font);
+void text_layer_set_text_alignment(
+        TextLayer * text_layer,
+        GTextAlignment text_alignment);
+
+typedef struct Window Window;
+typedef void (*WindowHandler)(Window * window);
+
+typedef struct {
+    WindowHandler load;
+    WindowHandler appear;
+    WindowHandler disappear;
+    WindowHandler unload;
+} WindowHandlers;
+
+Window * window_create(void);
+void window_destroy(Window * window);
+void window_set_window_handlers(Window * window, WindowHandlers handlers);
+Layer * window_get_root_layer(const Window * window);
+void window_stack_push(Window * window, bool animated);
+
+// Wall time.  Local time is whatever the C library makes of TZ.
+//
+typedef enum {
+    SECOND_UNIT = 1 << 0,
+    MINUTE_UNIT = 1 << 1,
+    HOUR_UNIT = 1 << 2,
+    DAY_UNIT = 1 << 3,
+    MONTH_UNIT = 1 << 4,
+    YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm * tick_time, TimeUnits units_changed);
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+bool clock_is_24h_style(void);
+uint16_t time_ms(time_t * tloc, uint16_t * out_ms);
+
+// Battery.
+//
+typedef struct {
+    uint8_t charge_percent;
+    bool is_charging;
+    bool is_plugged;
+} BatteryChargeState;
+
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+
+BatteryChargeState battery_state_service_peek(void);
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+
+// The background worker, which never runs on the host: snapshots are always
+// built in the foreground.
+//
+typedef struct {
+    uint16_t data0;
+    uint16_t data1;
+    uint16_t data2;
+} AppWorkerMessage;
+
+typedef void (*AppWorkerMessageHandler)(
+        uint16_t type,
+        AppWorkerMessage * data);
+
+bool app_worker_is_running(void);
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler);
+bool app_worker_message_unsubscribe(void);
+void app_worker_send_message(uint8_t type, AppWorkerMessage * data);
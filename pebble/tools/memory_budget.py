@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+#
+# Copyright 2016 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Report per-module static memory use and enforce budgets.
+
+Reads the .bss and .data section sizes of each compiled object file with a
+binutils `size` program and compares them against the budgets in a JSON file
+shaped like memory_budget.json next to wscript:
+
+    {
+        "modules": {"data": {"bss": 1536, "data": 128}, ...},
+        "total": {"bss": 2048, "data": 256}
+    }
+
+Modules are named after their source file without extension.  Modules that
+have no budget are reported but never fail the check.
+
+Usage:
+
+    memory_budget.py [--size arm-none-eabi-size] --budget FILE OBJECT...
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os.path
+import re
+import subprocess
+import sys
+
+SECTIONS = ('bss', 'data')
+
+
+def module_name(object_path):
+    """data.c.3.o -> data, data.o -> data"""
+    return os.path.basename(object_path).split('.')[0]
+
+
+def section_sizes(size_program, object_path):
+    """Return {section: bytes} for SECTIONS, using `size -A` output."""
+    output = subprocess.check_output([size_program, '-A', object_path])
+    sizes = dict((section, 0) for section in SECTIONS)
+    for line in output.decode('utf-8', 'replace').splitlines():
+        match = re.match(r'^\.(\w+)\S*\s+(\d+)', line)
+        if match and match.group(1) in SECTIONS:
+            sizes[match.group(1)] += int(match.group(2))
+    return sizes
+
+
+def check(size_program, budget, object_paths, out=sys.stdout):
+    """Print a report and return the list of budget violations."""
+    usage = {}
+    for path in object_paths:
+        sizes = section_sizes(size_program, path)
+        module = usage.setdefault(module_name(path),
+                                  dict((s, 0) for s in SECTIONS))
+        for section in SECTIONS:
+            module[section] += sizes[section]
+
+    total = dict((s, sum(m[s] for m in usage.values())) for s in SECTIONS)
+    module_budgets = budget.get('modules', {})
+    violations = []
+
+    def line(name, used, limits):
+        cells = []
+        for section in SECTIONS:
+            limit = limits.get(section)
+            cells.append('{:>6}{}'.format(
+                used[section],
+                ' / {:<6}'.format(limit) if limit is not None else ' ' * 9))
+            if limit is not None and used[section] > limit:
+                violations.append('{} .{} is {} bytes, budget is {}'.format(
+                    name, section, used[section], limit))
+        print('{:<16} {}'.format(name, ' '.join(cells)), file=out)
+
+    print('{:<16} {:<15} {:<15}'.format('module', '.bss', '.data'), file=out)
+    for name in sorted(usage):
+        line(name, usage[name], module_budgets.get(name, {}))
+    line('TOTAL', total, budget.get('total', {}))
+    return violations
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--size', default='arm-none-eabi-size',
+                        help='binutils size program for the target')
+    parser.add_argument('--budget', required=True,
+                        help='JSON file of per-module and total budgets')
+    parser.add_argument('objects', nargs='+', help='object files to check')
+    args = parser.parse_args(argv)
+
+    with open(args.budget) as budget_file:
+        budget = json.load(budget_file)
+    violations = check(args.size, budget, args.objects)
+    for violation in violations:
+        print('memory budget exceeded: ' + violation, file=sys.stderr)
+    return 1 if violations else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
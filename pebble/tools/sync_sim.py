@@ -0,0 +1,964 @@
+#!/usr/bin/env python
+#
+# Copyright 2016 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Simulate agenda sync between watch and phone, and benchmark it.
+
+The watch is the app's own data, agenda, snapshot, store and telemetry
+modules, built for the host against host/pebble.h and loaded with ctypes.  The
+phone is a model of the companion's CalendarBridge, PebbleSender,
+TransactionWindow, AgendaUpdateScheduler and PebbleState, kept in step with the
+Java by hand.  Between them is a link with configurable latency, loss and
+injected NACKs, on a virtual clock.
+
+Each fixture is a calendar that changes over time, in minutes from its start:
+
+    {
+        "description": "...",
+        "start": 1460361600,
+        "hours": 12,
+        "events": [{"id": 1, "start": 60, "minutes": 15,
+                    "every": 1440, "count": 5}, ...],
+        "changes": [{"at": 90, "set": [{"id": 2, ...}]},
+                    {"at": 120, "remove": [1]},
+                    {"at": 150, "touch": true}, ...]
+    }
+
+"set" adds or replaces events by id, "remove" deletes them and "touch" is a
+change the watch never shows, such as an edit to an all-day event.  Replaying
+a fixture reports messages and bytes each way, NACKs, retries, and how long
+the watch took to show each change.
+
+Usage:
+
+    sync_sim.py [--latency-ms 100] [--loss 0.0] [--nack 0.0]
+                [--inbox-max 8200] [--json] [FIXTURE...]
+"""
+
+from __future__ import print_function
+
+import argparse
+import collections
+import ctypes
+import glob
+import heapq
+import json
+import os.path
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+import data_keys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MODULES_DIR = os.path.join(HERE, '..', 'src', 'modules')
+HOST_DIR = os.path.join(HERE, 'host')
+
+# The modules the watch side of the simulation is built from.
+WATCH_MODULES = ('data', 'data_keys', 'store', 'telemetry', 'trace',
+                 'memory', 'agenda', 'snapshot')
+
+# Keys, from data_keys.json.
+KEY_SCHEMA = data_keys.load(os.path.join(HERE, '..', data_keys.SCHEMA))
+KEYS = dict((key['name'], key['key']) for key in KEY_SCHEMA)
+MAX_BYTES = dict((key['name'], key['max_bytes']) for key in KEY_SCHEMA)
+AGENDA_NEED_SECONDS_KEY = KEYS['AGENDA_NEED_SECONDS']
+AGENDA_CAPACITY_BYTES_KEY = KEYS['AGENDA_CAPACITY_BYTES']
+AGENDA_KEY = KEYS['AGENDA']
+AGENDA_VERSION_KEY = KEYS['AGENDA_VERSION']
+PEBBLE_NOW_UNIX_TIME_KEY = KEYS['PEBBLE_NOW_UNIX_TIME']
+AGENDA_EPOCH_KEY = KEYS['AGENDA_EPOCH']
+TELEMETRY_KEY = KEYS['TELEMETRY']
+AGENDA_PATCH_KEY = KEYS['AGENDA_PATCH']
+AGENDA_TRACE_KEY = KEYS['AGENDA_TRACE']
+AGENDA_FORMAT_KEY = KEYS['AGENDA_FORMAT']
+AGENDA_FORMAT_PLAIN = 0
+AGENDA_FORMAT_REPEATS = 1
+
+TUPLE_BYTE_ARRAY = 0
+TUPLE_INT = 3
+
+APP_MSG_OK = 0
+
+MINUTE_MS = 60 * 1000
+
+# enum HostCost, in order.
+HOST_COSTS = ('redraws', 'pixels', 'persist_writes', 'persist_bytes',
+              'radio_messages', 'radio_bytes', 'logs', 'wakeups')
+
+
+# Dictionaries, in the AppMessage wire format.
+
+def encode_dict(values):
+    """{key: int or bytes} -> bytes, ints as signed 32-bit."""
+    out = bytearray([len(values)])
+    for key in sorted(values):
+        value = values[key]
+        if isinstance(value, (bytes, bytearray)):
+            out += struct.pack('<IBH', key, TUPLE_BYTE_ARRAY, len(value))
+            out += value
+        else:
+            out += struct.pack('<IBHi', key, TUPLE_INT, 4, value)
+    return bytes(out)
+
+
+def decode_dict(data):
+    """bytes -> {key: int or bytes}"""
+    values = {}
+    offset = 1
+    for _ in range(bytearray(data)[0] if data else 0):
+        key, kind, length = struct.unpack_from('<IBH', data, offset)
+        offset += 7
+        value = data[offset:offset + length]
+        offset += length
+        if kind == TUPLE_BYTE_ARRAY:
+            values[key] = bytes(value)
+        else:
+            values[key] = struct.unpack('<i', value.ljust(4, b'\0')[:4])[0]
+    return values
+
+
+# The watch.
+
+def build_library(cc, out_dir, sources=None):
+    """Build watch sources, by default WATCH_MODULES, and the host stand-in
+    as a shared library."""
+    if sources is None:
+        sources = [os.path.join(MODULES_DIR, module + '.c')
+                   for module in WATCH_MODULES]
+    sources = sorted(glob.glob(os.path.join(HOST_DIR, '*.c'))) + sources
+    library = os.path.join(out_dir, 'libbsky_host.so')
+    subprocess.check_call(
+        [cc, '-shared', '-fPIC', '-O1', '-I' + HOST_DIR,
+         '-I' + os.path.dirname(MODULES_DIR), '-I' + MODULES_DIR,
+         '-o', library] + sources + ['-lm'])
+    return library
+
+
+class Agenda(ctypes.Structure):
+    """struct BSKY_Agenda"""
+    _fields_ = [('starts', ctypes.POINTER(ctypes.c_int16)),
+                ('durations', ctypes.POINTER(ctypes.c_uint16)),
+                ('instances_length', ctypes.c_int32),
+                ('duration_max', ctypes.c_int32),
+                ('epoch', ctypes.c_int32),
+                ('version', ctypes.c_int32)]
+
+
+class Watch(object):
+    """One run of the watch app, in its own copy of the library, since the
+    modules' static state can't be reset."""
+
+    def __init__(self, library, scratch_dir, options):
+        copy = tempfile.mktemp(suffix='.so', dir=scratch_dir)
+        shutil.copy(library, copy)
+        self.lib = lib = ctypes.CDLL(copy)
+        lib.host_now_ms.restype = ctypes.c_int64
+        lib.host_next_timer_ms.restype = ctypes.c_int64
+        lib.host_run_until.argtypes = [ctypes.c_int64]
+        lib.host_deliver.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        lib.host_deliver.restype = ctypes.c_int32
+        lib.host_outbox_take.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        lib.host_outbox_take.restype = ctypes.c_uint32
+        lib.host_outbox_result.argtypes = [ctypes.c_bool]
+        lib.host_persist_writes.restype = ctypes.c_uint32
+        lib.host_cost.argtypes = [ctypes.c_int32]
+        lib.host_cost.restype = ctypes.c_uint64
+        lib.host_set_battery.argtypes = [ctypes.c_uint8, ctypes.c_bool]
+        lib.host_set_24h_style.argtypes = [ctypes.c_bool]
+        lib.bsky_data_init.restype = ctypes.c_bool
+        lib.bsky_agenda_read.argtypes = [ctypes.c_long]
+        lib.bsky_agenda_read.restype = ctypes.POINTER(Agenda)
+        lib.host_reset(options.inbox_max, options.outbox_max, options.heap_free)
+        lib.host_set_log_level(options.log_level)
+
+    def start(self, now_ms, window=False):
+        """As init() in main.c, with the window only if asked for and built
+        in."""
+        self.lib.host_run_until(now_ms)
+        if not self.lib.bsky_data_init():
+            raise RuntimeError('bsky_data_init failed')
+        if window:
+            self.lib.bsky_quality_init()
+        self.lib.bsky_telemetry_init()
+        self.lib.bsky_agenda_init()
+        if window:
+            self.lib.main_window_push()
+            self.lib.host_ui_render()
+
+    def next_timer_ms(self):
+        due = self.lib.host_next_timer_ms()
+        return None if due < 0 else due
+
+    def run_until(self, now_ms):
+        self.lib.host_run_until(now_ms)
+
+    def deliver(self, data):
+        return self.lib.host_deliver(data, len(data))
+
+    def take_outbox(self):
+        buffer = ctypes.create_string_buffer(8192)
+        length = self.lib.host_outbox_take(buffer, len(buffer))
+        return buffer.raw[:length] if length else None
+
+    def outbox_result(self, acked):
+        self.lib.host_outbox_result(acked)
+
+    def persist_writes(self):
+        return self.lib.host_persist_writes()
+
+    def cost(self, which):
+        """host_cost, by index into HOST_COSTS."""
+        return self.lib.host_cost(which)
+
+    def shown(self, now_ms):
+        """What the watch draws: [(begin_ms, end_ms)], as read by the sky
+        layer, which is also when the agenda asks for updates."""
+        agenda = self.lib.bsky_agenda_read(now_ms // 1000).contents
+        epoch_ms = agenda.epoch * 1000
+        return [(epoch_ms + agenda.starts[i] * MINUTE_MS,
+                 epoch_ms + (agenda.starts[i] + agenda.durations[i]) * MINUTE_MS)
+                for i in range(agenda.instances_length)]
+
+
+# The phone: a model of the Android companion.  Names follow the Java.
+
+REPEAT_MARK = -0x8000
+REPEAT_MAX = 256
+SHORT_MAX = 0x7fff
+PATCH_HEADER_BYTES = 8
+SPLICE_MAX_RECORDS = 255
+
+DEFAULT_AGENDA_CAPACITY_BYTES = 1024
+DEFAULT_AGENDA_NEED_SECONDS = 24 * 60 * 60
+MAX_AGENDA_WINDOW_SECONDS = 7 * 24 * 60 * 60
+AGENDA_PATCH_MAX_BYTES = MAX_BYTES['AGENDA_PATCH']
+PAYLOAD_MAX_AGE_MILLISECONDS = 30 * 60 * 1000
+PATCH_BASE_MAX_AGE_MILLISECONDS = 12 * 60 * 60 * 1000
+QUIET_MILLIS = 2 * 1000
+MAX_DELAY_MILLIS = 10 * 1000
+WINDOW_SIZE = 4
+MAX_ATTEMPTS = 3
+TRANSACTION_TIMEOUT_MILLIS = 30 * 1000
+MAX_TRANSACTION_ID = 0x7f
+
+
+def java_div(a, b):
+    """Integer division truncating toward zero, as in Java."""
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def java_int(value):
+    """(int) cast of a long."""
+    value &= 0xffffffff
+    return value - (1 << 32) if value >= 1 << 31 else value
+
+
+def encode(instances, epoch_ms, capacity_bytes, repeats=True, encoded=None):
+    """AgendaEncoder.encode"""
+    runs = []
+    open_runs = {}
+    for instance in instances:
+        short = [java_div(instance[i] - epoch_ms, MINUTE_MS) for i in (0, 1)]
+        if any(t < REPEAT_MARK + REPEAT_MAX or SHORT_MAX < t for t in short):
+            continue
+        start, duration = short[0], short[1] - short[0]
+        run = open_runs.get(instance[2]) if repeats else None
+        if run and run['duration'] == duration and run['count'] <= REPEAT_MAX:
+            stride = start - run['last_start']
+            if (0 < stride <= SHORT_MAX
+                    and (run['count'] == 1 or stride == run['stride'])):
+                run['stride'] = stride
+                run['count'] += 1
+                run['last_start'] = start
+                run['instances'].append(instance)
+                continue
+        run = dict(start=start, duration=duration, stride=0, count=1,
+                   last_start=start, instances=[instance])
+        runs.append(run)
+        open_runs[instance[2]] = run
+
+    agenda = bytearray()
+    for run in runs:
+        if len(agenda) + 4 > capacity_bytes:
+            break
+        agenda += struct.pack('<hh', run['start'],
+                              run['start'] + run['duration'])
+        repeated = run['count'] > 1 and len(agenda) + 4 <= capacity_bytes
+        if repeated:
+            agenda += struct.pack('<hh', REPEAT_MARK + run['count'] - 2,
+                                  run['stride'])
+        if encoded is not None:
+            encoded += run['instances'] if repeated else run['instances'][:1]
+    return bytes(agenda)
+
+
+def patch(base, base_version, target, version, max_bytes):
+    """AgendaEncoder.patch"""
+    base_records = [base[i:i + 4] for i in range(0, len(base), 4)]
+    target_records = [target[i:i + 4] for i in range(0, len(target), 4)]
+    prefix = 0
+    while (prefix < len(base_records) and prefix < len(target_records)
+           and base_records[prefix] == target_records[prefix]):
+        prefix += 1
+    suffix = 0
+    while (suffix < len(base_records) - prefix
+           and suffix < len(target_records) - prefix
+           and base_records[-1 - suffix] == target_records[-1 - suffix]):
+        suffix += 1
+    remove = len(base_records) - prefix - suffix
+    insert = len(target_records) - prefix - suffix
+    if prefix > 0xffff:
+        return None
+    splices = max(-(-remove // SPLICE_MAX_RECORDS),
+                  -(-insert // SPLICE_MAX_RECORDS))
+    if PATCH_HEADER_BYTES + splices * 4 + insert * 4 > max_bytes:
+        return None
+
+    out = bytearray(struct.pack('<ii', base_version, version))
+    index = prefix
+    inserted = target_records[prefix:prefix + insert]
+    while remove > 0 or insert > 0:
+        remove_count = min(remove, SPLICE_MAX_RECORDS)
+        insert_count = min(insert, SPLICE_MAX_RECORDS)
+        out += struct.pack('<HBB', index, remove_count, insert_count)
+        out += b''.join(inserted[:insert_count])
+        inserted = inserted[insert_count:]
+        index += insert_count
+        remove -= remove_count
+        insert -= insert_count
+    return bytes(out)
+
+
+def same_within(a, b, from_ms, to_ms):
+    """InstanceSnapshot.sameWithin, on lists of (begin, end, event, id)."""
+    def overlapping(instances):
+        return sorted((i[0], i[3], i[1], i[2]) for i in instances
+                      if i[0] < to_ms and i[1] > from_ms)
+    return overlapping(a) == overlapping(b)
+
+
+class Scheduler(object):
+    """AgendaUpdateScheduler"""
+
+    def __init__(self):
+        self.pending = False
+        self.first = self.last = self.not_before = 0
+
+    def request(self, now):
+        if not self.pending:
+            self.pending = True
+            self.first = now
+        self.last = now
+
+    def defer(self, not_before, now):
+        if not self.pending:
+            self.request(now)
+        self.not_before = not_before
+
+    def millis_until_due(self, now):
+        if not self.pending:
+            return -1
+        due = min(self.last + QUIET_MILLIS, self.first + MAX_DELAY_MILLIS)
+        return max(0, max(due, self.not_before) - now)
+
+    def take(self, in_progress, now):
+        if in_progress or self.millis_until_due(now) != 0:
+            return False
+        self.pending = False
+        self.not_before = 0
+        return True
+
+
+class Transaction(object):
+    def __init__(self, key, message):
+        self.key = key
+        self.message = message
+        self.id = 0
+        self.attempts = 0
+        self.sent_ms = 0
+        self.superseded = False
+
+
+class TransactionWindow(object):
+    """TransactionWindow, returning 'unknown', 'retrying' or 'dropped' from
+    nack."""
+
+    def __init__(self, size, max_attempts, timeout_ms):
+        self.size = size
+        self.max_attempts = max_attempts
+        self.timeout_ms = timeout_ms
+        self.queue = collections.deque()
+        self.outstanding = collections.OrderedDict()
+        self.next_id = 1
+        self.abandoned = False
+
+    def enqueue(self, key, message):
+        self.queue = collections.deque(
+            t for t in self.queue if t.key != key)
+        for transaction in self.outstanding.values():
+            if transaction.key == key:
+                transaction.superseded = True
+        self.queue.append(Transaction(key, message))
+
+    def take_sendable(self, now_ms):
+        self.expire(now_ms)
+        sendable = []
+        while len(self.outstanding) < self.size and self.queue:
+            transaction = self.queue.popleft()
+            while self.next_id in self.outstanding:
+                self.next_id = self.next_id % MAX_TRANSACTION_ID + 1
+            transaction.id = self.next_id
+            self.next_id = self.next_id % MAX_TRANSACTION_ID + 1
+            transaction.attempts += 1
+            transaction.sent_ms = now_ms
+            self.outstanding[transaction.id] = transaction
+            sendable.append(transaction)
+        return sendable
+
+    def ack(self, transaction_id):
+        return self.outstanding.pop(transaction_id, None)
+
+    def nack(self, transaction_id):
+        transaction = self.outstanding.pop(transaction_id, None)
+        if transaction is None:
+            return 'unknown'
+        if not self.is_worth_retrying(transaction):
+            return 'dropped'
+        self.queue.appendleft(transaction)
+        return 'retrying'
+
+    def is_full(self, now_ms):
+        self.expire(now_ms)
+        return len(self.outstanding) >= self.size
+
+    def millis_until_timeout(self, now_ms):
+        if not self.outstanding:
+            return -1
+        first = min(t.sent_ms for t in self.outstanding.values())
+        return max(0, first + self.timeout_ms - now_ms)
+
+    def is_worth_retrying(self, transaction):
+        return (not transaction.superseded
+                and transaction.attempts < self.max_attempts)
+
+    def expire(self, now_ms):
+        expired = [t for t in self.outstanding.values()
+                   if now_ms - t.sent_ms >= self.timeout_ms]
+        for transaction in reversed(expired):
+            del self.outstanding[transaction.id]
+            if self.is_worth_retrying(transaction):
+                self.queue.appendleft(transaction)
+            elif not transaction.superseded:
+                self.abandoned = True
+
+    def take_abandoned(self):
+        abandoned, self.abandoned = self.abandoned, False
+        return abandoned
+
+
+class Payload(object):
+    pass
+
+
+class Phone(object):
+    """MainService, CalendarBridge, PebbleSender and PebbleState."""
+
+    def __init__(self, sim):
+        self.sim = sim
+        self.calendar = []
+        self.need_seconds = DEFAULT_AGENDA_NEED_SECONDS
+        self.capacity_bytes = DEFAULT_AGENDA_CAPACITY_BYTES
+        self.agenda_format = AGENDA_FORMAT_PLAIN
+        self.attempt_time = 0
+        self.nack_count = 0
+        self.scheduler = Scheduler()
+        self.window = TransactionWindow(WINDOW_SIZE, MAX_ATTEMPTS,
+                                        TRANSACTION_TIMEOUT_MILLIS)
+        self.handler_token = 0
+        self.generation = 0
+        self.cached = None
+        self.watch_payload = None
+
+    # CalendarChangeReceiver
+
+    def on_calendar_changed(self, instances):
+        self.calendar = instances
+        self.generation += 1
+        self.maybe_send_agenda_update()
+
+    # MainService
+
+    def maybe_send_agenda_update(self):
+        self.scheduler.request(self.sim.now_ms)
+        self.schedule_agenda_update()
+
+    def on_transaction_finished(self):
+        self.schedule_agenda_update()
+
+    def schedule_agenda_update(self):
+        self.handler_token += 1
+        token = self.handler_token
+        delay = (-1 if self.window.is_full(self.sim.now_ms)
+                 else self.scheduler.millis_until_due(self.sim.now_ms))
+        timeout = self.window.millis_until_timeout(self.sim.now_ms)
+        if delay < 0 or 0 <= timeout < delay:
+            delay = timeout
+        if delay < 0:
+            return
+
+        def run():
+            if token == self.handler_token:
+                self.pump()
+                if self.window.take_abandoned():
+                    self.scheduler.request(self.sim.now_ms)
+                if self.scheduler.pending:
+                    self.send_due_agenda_update()
+                else:
+                    self.schedule_agenda_update()
+        self.sim.at(self.sim.now_ms + delay, run)
+
+    def send_due_agenda_update(self):
+        now = self.sim.now_ms
+        in_progress = self.window.is_full(now)
+        if not self.scheduler.take(in_progress, now):
+            self.schedule_agenda_update()
+            return
+        retry_time = self.attempt_time + 10 * 1000
+        if self.nack_count > 5 and retry_time >= now:
+            self.scheduler.defer(retry_time, now)
+            self.schedule_agenda_update()
+            return
+        need, capacity = self.need_seconds, self.capacity_bytes
+        repeats = self.agenda_format >= AGENDA_FORMAT_REPEATS
+        self.sim.at(now + self.sim.options.query_ms,
+                    lambda: self.send_agenda(need, capacity, repeats))
+
+    # CalendarBridge
+
+    def get_cached_payload(self, now, need_seconds, capacity_bytes, repeats):
+        p = self.cached
+        fresh = (p is not None and p.generation == self.generation
+                 and p.need_seconds == need_seconds
+                 and p.capacity_bytes == capacity_bytes
+                 and p.repeats == repeats
+                 and p.built_ms <= now
+                 and now - p.built_ms < PAYLOAD_MAX_AGE_MILLISECONDS)
+        return p if fresh else None
+
+    def get_patch_base(self, now):
+        base = self.watch_payload
+        usable = (base is not None and base.epoch_ms <= now
+                  and now - base.epoch_ms < PATCH_BASE_MAX_AGE_MILLISECONDS)
+        return base if usable else None
+
+    def is_unchanged_for_watch(self, base, payload, now):
+        return (base is not None
+                and base.need_seconds == payload.need_seconds
+                and base.capacity_bytes == payload.capacity_bytes
+                and base.repeats == payload.repeats
+                and base.built_ms <= now
+                and now - base.built_ms < PAYLOAD_MAX_AGE_MILLISECONDS
+                and same_within(base.instances, payload.instances, now,
+                                now + payload.need_seconds * 1000))
+
+    def send_agenda(self, need_seconds, capacity_bytes, repeats):
+        now = self.sim.now_ms
+        capacity_bytes -= capacity_bytes % 4
+        payload = self.get_cached_payload(now, need_seconds, capacity_bytes,
+                                          repeats)
+        base = self.get_patch_base(now)
+        if (payload is not None and base is not None
+                and base.version == payload.version):
+            self.sim.stats['skipped'] += 1
+            return
+        if payload is None:
+            payload = self.build_payload(
+                now, base.epoch_ms if base else now, need_seconds,
+                capacity_bytes, repeats)
+            if self.is_unchanged_for_watch(base, payload, now):
+                self.sim.stats['skipped'] += 1
+                base.generation = payload.generation
+                self.cached = base
+                return
+            self.cached = payload
+
+        agenda_patch = None
+        if base is not None and base.epoch_ms == payload.epoch_ms:
+            agenda_patch = patch(base.agenda, base.version, payload.agenda,
+                                 payload.version,
+                                 min(AGENDA_PATCH_MAX_BYTES, capacity_bytes))
+        if agenda_patch is not None:
+            message = {AGENDA_PATCH_KEY: agenda_patch}
+            self.sim.stats['patches'] += 1
+        else:
+            message = {AGENDA_KEY: payload.agenda,
+                       AGENDA_EPOCH_KEY: java_int(payload.epoch_ms // 1000),
+                       AGENDA_VERSION_KEY: payload.version}
+            self.sim.stats['whole'] += 1
+        self.window.enqueue('agenda', message)
+        self.pump()
+
+    def build_payload(self, start_ms, epoch_ms, need_seconds, capacity_bytes,
+                      repeats):
+        payload = Payload()
+        payload.generation = self.generation
+        payload.need_seconds = need_seconds
+        payload.capacity_bytes = capacity_bytes
+        payload.repeats = repeats
+        payload.built_ms = start_ms
+        payload.epoch_ms = epoch_ms
+        payload.version = java_int(start_ms % 0xffffffff)
+        window_ms = max(60, need_seconds) * 1000
+        max_window_ms = max(window_ms, MAX_AGENDA_WINDOW_SECONDS * 1000)
+        while True:
+            end_ms = start_ms + min(window_ms, max_window_ms)
+            instances = [i for i in self.calendar
+                         if i[1] > start_ms and i[0] < end_ms]
+            encoded = []
+            payload.agenda = encode(instances, epoch_ms, capacity_bytes,
+                                    repeats, encoded)
+            if (end_ms >= start_ms + max_window_ms
+                    or len(payload.agenda) + 4 > capacity_bytes):
+                break
+            window_ms *= 2
+        payload.instances = encoded
+        return payload
+
+    def on_agenda_acked(self, message):
+        version = message.get(AGENDA_VERSION_KEY)
+        if version is None and AGENDA_PATCH_KEY in message:
+            version = struct.unpack_from('<i', message[AGENDA_PATCH_KEY], 4)[0]
+        if (version is not None and self.cached is not None
+                and self.cached.version == version):
+            self.watch_payload = self.cached
+
+    def on_watch_agenda_version(self, version):
+        if (self.watch_payload is not None
+                and self.watch_payload.version != version):
+            self.watch_payload = None
+
+    # PebbleSender
+
+    def pump(self):
+        sendable = self.window.take_sendable(self.sim.now_ms)
+        for transaction in sendable:
+            self.attempt_time = self.sim.now_ms
+            if transaction.attempts > 1:
+                self.sim.stats['retries'] += 1
+            self.sim.send_to_watch(transaction.id, transaction.message)
+        if sendable:
+            self.schedule_agenda_update()
+
+    def on_ack(self, transaction_id):
+        transaction = self.window.ack(transaction_id)
+        if transaction is not None:
+            self.nack_count = 0
+            if transaction.key == 'agenda':
+                self.on_agenda_acked(transaction.message)
+        self.pump()
+        self.on_transaction_finished()
+
+    def on_nack(self, transaction_id):
+        result = self.window.nack(transaction_id)
+        if result != 'unknown':
+            self.nack_count += 1
+        self.pump()
+        if result == 'dropped':
+            self.maybe_send_agenda_update()
+        else:
+            self.on_transaction_finished()
+
+    # PebbleDataReceiver
+
+    def receive_data(self, message):
+        if AGENDA_VERSION_KEY in message:
+            self.on_watch_agenda_version(message[AGENDA_VERSION_KEY])
+        elif AGENDA_CAPACITY_BYTES_KEY in message:
+            # A request from a watch with no agenda at all.
+            self.watch_payload = None
+        if message.get(AGENDA_NEED_SECONDS_KEY, 0) > 0:
+            self.need_seconds = message[AGENDA_NEED_SECONDS_KEY]
+        if AGENDA_CAPACITY_BYTES_KEY in message:
+            if message[AGENDA_CAPACITY_BYTES_KEY] > 0:
+                self.capacity_bytes = message[AGENDA_CAPACITY_BYTES_KEY]
+            self.agenda_format = message.get(AGENDA_FORMAT_KEY,
+                                             AGENDA_FORMAT_PLAIN)
+            self.maybe_send_agenda_update()
+
+
+# The fixture, the link and the clock.
+
+def expand(events, start_ms):
+    """Fixture events -> [(begin, end, event id, instance id)], by begin."""
+    instances = []
+    for event in events.values():
+        for k in range(event.get('count', 1)):
+            begin = start_ms + (event['start'] + k * event.get('every', 0)) \
+                * MINUTE_MS
+            instances.append((begin, begin + event['minutes'] * MINUTE_MS,
+                              event['id'], event['id'] * 1000 + k))
+    return sorted(instances)
+
+
+class Simulation(object):
+
+    # Whether the watch has its window, which reads the agenda itself.
+    window = False
+
+    def __init__(self, fixture, library, scratch_dir, options):
+        self.fixture = fixture
+        self.options = options
+        self.random = random.Random(options.seed)
+        self.start_ms = fixture['start'] * 1000
+        self.hours = fixture['hours']
+        self.end_ms = self.start_ms + self.hours * 60 * MINUTE_MS
+        self.now_ms = self.start_ms
+        self.queue = []
+        self.sequence = 0
+        self.stats = collections.Counter()
+        self.changes = []
+        self.converge_ms = []
+        self.watch = Watch(library, scratch_dir, options)
+        self.phone = Phone(self)
+
+    def at(self, time_ms, callback):
+        heapq.heappush(self.queue, (time_ms, self.sequence, callback))
+        self.sequence += 1
+
+    def lost(self):
+        return self.random.random() < self.options.loss
+
+    def send_to_watch(self, transaction_id, message):
+        data = encode_dict(message)
+        self.stats['to_watch_messages'] += 1
+        self.stats['to_watch_bytes'] += len(data)
+        latency = self.options.latency_ms
+        if self.lost():
+            self.stats['lost'] += 1
+            self.at(self.now_ms + self.options.timeout_ms,
+                    lambda: self.phone.on_nack(transaction_id))
+            return
+
+        def arrive():
+            if self.random.random() < self.options.nack:
+                result = -1
+            else:
+                result = self.watch.deliver(data)
+            if result != APP_MSG_OK:
+                self.stats['nacks'] += 1
+                self.at(self.now_ms + latency,
+                        lambda: self.phone.on_nack(transaction_id))
+            elif self.lost():
+                # A lost reply never turns into a NACK; the phone's window
+                # times the transaction out instead.
+                self.stats['lost'] += 1
+            else:
+                self.at(self.now_ms + latency,
+                        lambda: self.phone.on_ack(transaction_id))
+        self.at(self.now_ms + latency, arrive)
+
+    def pump_watch_outbox(self):
+        data = self.watch.take_outbox()
+        if data is None:
+            return
+        self.stats['to_phone_messages'] += 1
+        self.stats['to_phone_bytes'] += len(data)
+        latency = self.options.latency_ms
+        if self.lost():
+            self.stats['lost'] += 1
+            self.at(self.now_ms + self.options.timeout_ms,
+                    lambda: self.watch.outbox_result(False))
+            return
+
+        def arrive():
+            self.phone.receive_data(decode_dict(data))
+            self.at(self.now_ms + latency,
+                    lambda: self.watch.outbox_result(True))
+        self.at(self.now_ms + latency, arrive)
+
+    def calendar(self, events):
+        return expand(events, self.start_ms)
+
+    def converged(self):
+        """Whether the watch shows what the calendar has, as far ahead as
+        the watch needs, to within the minute the agenda is rounded to.
+        Instances near either end of that span are left out, since rounding
+        can move them across it."""
+        margin = MINUTE_MS
+        lo = self.now_ms + 2 * margin
+        hi = self.now_ms + self.phone.need_seconds * 1000 - 2 * margin
+        shown = self.watch.shown(self.now_ms)
+        wanted = [i[:2] for i in self.phone.calendar]
+
+        def inside(instance):
+            return instance[1] > lo and instance[0] < hi
+
+        def found(instance, pool):
+            return any(abs(instance[0] - other[0]) < margin
+                       and abs(instance[1] - other[1]) < margin
+                       for other in pool)
+        return (all(found(i, shown) for i in wanted if inside(i))
+                and all(found(i, wanted) for i in shown if inside(i)))
+
+    def check_convergence(self):
+        if self.changes and self.converged():
+            for change_ms in self.changes:
+                self.converge_ms.append(self.now_ms - change_ms)
+            self.changes = []
+
+    def change(self, events):
+        self.changes.append(self.now_ms)
+        self.phone.on_calendar_changed(self.calendar(events))
+
+    def schedule_fixture(self):
+        events = dict((e['id'], e) for e in self.fixture['events'])
+        self.at(self.start_ms, lambda: self.change(dict(events)))
+        for change in self.fixture.get('changes', []):
+            for event in change.get('set', []):
+                events[event['id']] = event
+            for event_id in change.get('remove', []):
+                events.pop(event_id, None)
+            self.at(self.start_ms + int(change['at'] * MINUTE_MS),
+                    lambda snapshot=dict(events): self.change(snapshot))
+        # Without its window, stand in for the sky layer reading the agenda
+        # once a minute.
+        if not self.window:
+            for minute in range(0, self.hours * 60 + 1):
+                self.at(self.start_ms + minute * MINUTE_MS,
+                        lambda: self.watch.shown(self.now_ms))
+
+    def run(self):
+        self.watch.start(self.start_ms, window=self.window)
+        self.schedule_fixture()
+        while True:
+            timer_ms = self.watch.next_timer_ms()
+            event_ms = self.queue[0][0] if self.queue else None
+            if event_ms is None and timer_ms is None:
+                break
+            if event_ms is None or (timer_ms is not None
+                                    and timer_ms < event_ms):
+                if timer_ms > self.end_ms:
+                    break
+                self.now_ms = max(self.now_ms, timer_ms)
+                self.watch.run_until(timer_ms)
+            else:
+                if event_ms > self.end_ms:
+                    break
+                _, _, callback = heapq.heappop(self.queue)
+                self.now_ms = max(self.now_ms, event_ms)
+                self.watch.run_until(self.now_ms)
+                callback()
+            self.pump_watch_outbox()
+            self.check_convergence()
+        self.stats['persist_writes'] = self.watch.persist_writes()
+        self.stats['unconverged'] = len(self.changes)
+        return self.report()
+
+    def report(self):
+        latencies = sorted(self.converge_ms)
+        result = dict((key, self.stats[key]) for key, _ in COLUMNS)
+        result['changes'] = len(latencies) + len(self.changes)
+        result['converge_median_ms'] = (
+            latencies[len(latencies) // 2] if latencies else None)
+        result['converge_max_ms'] = latencies[-1] if latencies else None
+        return result
+
+
+COLUMNS = (
+    ('to_watch_messages', 'msgs>w'),
+    ('to_watch_bytes', 'bytes>w'),
+    ('to_phone_messages', 'msgs>p'),
+    ('to_phone_bytes', 'bytes>p'),
+    ('whole', 'whole'),
+    ('patches', 'patch'),
+    ('skipped', 'skip'),
+    ('nacks', 'nack'),
+    ('lost', 'lost'),
+    ('retries', 'retry'),
+    ('persist_writes', 'writes'),
+    ('changes', 'chg'),
+    ('converge_median_ms', 'conv50ms'),
+    ('converge_max_ms', 'convmax'),
+    ('unconverged', 'stale'),
+)
+
+
+def print_table(results, out=sys.stdout):
+    print('{:<16} '.format('fixture')
+          + ' '.join('{:>8}'.format(label) for _, label in COLUMNS), file=out)
+    for name, result in results:
+        print('{:<16} '.format(name) + ' '.join(
+            '{:>8}'.format('-' if result.get(key) is None
+                           else result.get(key, 0))
+            for key, _ in COLUMNS), file=out)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--cc', default='gcc', help='host C compiler')
+    parser.add_argument('--latency-ms', type=int, default=100,
+                        help='one-way delay of every message and reply')
+    parser.add_argument('--timeout-ms', type=int, default=3000,
+                        help='how long a lost message takes to be NACKed')
+    parser.add_argument('--loss', type=float, default=0.0,
+                        help='chance of losing any one message or reply')
+    parser.add_argument('--nack', type=float, default=0.0,
+                        help='chance of the watch NACKing a message')
+    parser.add_argument('--inbox-max', type=int, default=8200,
+                        help='app_message_inbox_size_maximum()')
+    parser.add_argument('--outbox-max', type=int, default=8200,
+                        help='app_message_outbox_size_maximum()')
+    parser.add_argument('--heap-free', type=int, default=24000,
+                        help='heap_bytes_free()')
+    parser.add_argument('--query-ms', type=int, default=50,
+                        help='how long the phone takes to query the calendar')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--log-level', type=int, default=0,
+                        help='print watch APP_LOGs up to this level')
+    parser.add_argument('--json', action='store_true',
+                        help='print results as JSON')
+    parser.add_argument('fixtures', nargs='*', help='fixture files, default'
+                        ' all of fixtures/*.json')
+    args = parser.parse_args(argv)
+
+    paths = args.fixtures or sorted(
+        glob.glob(os.path.join(HERE, 'fixtures', '*.json')))
+    scratch_dir = tempfile.mkdtemp(prefix='sync_sim')
+    try:
+        library = build_library(args.cc, scratch_dir)
+        results = []
+        for path in paths:
+            with open(path) as fixture_file:
+                fixture = json.load(fixture_file)
+            name = os.path.splitext(os.path.basename(path))[0]
+            results.append(
+                (name, Simulation(fixture, library, scratch_dir, args).run()))
+    finally:
+        shutil.rmtree(scratch_dir)
+
+    if args.json:
+        json.dump(dict(results), sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        print_table(results)
+    return 1 if any(r['unconverged'] for _, r in results) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
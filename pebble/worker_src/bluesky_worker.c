@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pebble_worker.h>
+
+// The app's modules include <pebble.h> unless told they are being built into
+// the worker, which only has <pebble_worker.h>.  Workers are built from
+// worker_src alone, so the few modules shared with the app are compiled in
+// here directly.
+//
+#define BSKY_WORKER
+
+#include "../src/modules/data.h"
+#include "../src/modules/snapshot.h"
+#include "../src/modules/store.h"
+#include "../src/modules/snapshot.c"
+#include "../src/modules/store.c"
+
+// Build and persist a snapshot from the agenda the app has persisted.
+//
+// The worker can't receive AppMessages itself, so the app still receives and
+// persists the agenda; everything from there on happens here, off the app's
+// event loop.
+//
+static void bsky_worker_build(int32_t version) {
+    const int32_t raw_epoch = persist_read_int(BSKY_DATAKEY_AGENDA_EPOCH);
+    const int32_t persisted_version
+        = persist_read_int(BSKY_DATAKEY_AGENDA_VERSION);
+    if (version != persisted_version) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_worker_build: asked for %ld, %ld is persisted",
+                version,
+                persisted_version);
+        return;
+    }
+
+    const size_t capacity = bsky_store_length(BSKY_DATAKEY_AGENDA);
+    void * events = malloc(capacity + 1);
+    size_t num_bytes;
+    if (!events
+            || !bsky_store_read(
+                BSKY_DATAKEY_AGENDA, events, capacity, &num_bytes)) {
+        APP_LOG(APP_LOG_LEVEL_WARNING,
+                "bsky_worker_build: no agenda to build from");
+        free(events);
+        return;
+    }
+
+    size_t length;
+    struct BSKY_SnapshotHeader * snapshot = bsky_snapshot_build(
+            events,
+            num_bytes / sizeof(struct BSKY_AgendaEvent),
+            version,
+            raw_epoch,
+            time(NULL),
+            &length);
+    free(events);
+    if (!snapshot) {
+        return;
+    }
+    const bool saved
+        = bsky_store_write(BSKY_SNAPSHOT_STORE_KEY, snapshot, length);
+    free(snapshot);
+    if (!saved) {
+        return;
+    }
+    AppWorkerMessage message = {
+        .data0 = (uint32_t)version & 0xffff,
+        .data1 = (uint32_t)version >> 16,
+    };
+    app_worker_send_message(BSKY_SNAPSHOT_MSG_READY, &message);
+}
+
+// Matches AppWorkerMessageHandler.
+//
+static void bsky_worker_message(uint16_t type, AppWorkerMessage * message) {
+    if (type == BSKY_SNAPSHOT_MSG_BUILD) {
+        bsky_worker_build(
+                (int32_t)((uint32_t)message->data1 << 16 | message->data0));
+    }
+}
+
+int main(void) {
+    app_worker_message_subscribe(bsky_worker_message);
+    worker_event_loop();
+    app_worker_message_unsubscribe();
+}